@@ -0,0 +1,1131 @@
+/*
+ * 基准测试: 对各引擎运行插入/查找/删除/混合/扫描/遍历等负载, 输出吞吐, 延迟分位数和内存.
+ *
+ *     bench [--engines rb,fixed,...] [--workloads insert_rand,...] [--sizes 1000,1000000]
+ *           [--ops N] [--threads 1,2,4] [--seed N] [--dir DIR] [--json FILE]
+ *
+ * key 为 8 字节整数; 预填充的 key 为 0, 2, 4, ...(乱序插入), 奇数 key 用于未命中查找.
+ * 延迟每 LAT_SAMPLE 次操作采样一次, 吞吐按整个循环的耗时计算.
+ * 多线程负载(sharded_*, par_*)对 --threads 中的每个线程数各跑一次, 用于看扩展性.
+ */
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bptree.h"
+#include "compact.h"
+#include "frozen.h"
+#include "parallel.h"
+#include "rbtree.h"
+#include "rbtree_typed.h"
+#include "sharded.h"
+#include "stats.h"
+#include "thpool.h"
+#include "utils.h"
+#include "wal.h"
+
+#define LAT_SAMPLE 16  // 必须是 2 的幂
+#define SCAN_LEN 100
+#define WAL_MAX_OPS 20000
+
+RBT_DEFINE(u64tree, uint64_t, RBT_CMP_NUM(a, b))
+
+typedef struct Result {
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t *lat;
+    size_t nlat;
+    size_t cap;
+} Result;
+
+typedef struct Ctx {
+    size_t n;         // 预填充的 key 个数
+    size_t ops;       // 查找/混合等负载的操作次数
+    uint64_t *keys;   // 0, 2, ..., 2(n-1) 的随机排列
+    uint64_t seed;
+    uint32_t threads;
+    const char *dir;
+} Ctx;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 计时起点; 同时清零本线程的树统计, 使其只覆盖计时部分(预填充不计入) */
+static uint64_t timer_start(void) {
+    rbt_stats_reset();
+    return now_ns();
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* splitmix64 */
+static uint64_t rng_next(uint64_t *state) {
+    *state += 0x9e3779b97f4a7c15ULL;
+    return mix64(*state);
+}
+
+static void lat_add(Result *res, uint64_t ns) {
+    if (res->nlat == res->cap) {
+        res->cap = res->cap ? res->cap * 2 : 1024;
+        res->lat = realloc(res->lat, res->cap * sizeof(uint64_t));
+        if (NULL == res->lat) {
+            die("realloc latency samples");
+        }
+    }
+    res->lat[res->nlat++] = ns;
+}
+
+#define TIMED(res, i, stmt)                            \
+    do {                                               \
+        if (((i) & (LAT_SAMPLE - 1)) == 0) {           \
+            uint64_t t0_ = now_ns();                   \
+            stmt;                                      \
+            lat_add((res), now_ns() - t0_);            \
+        } else {                                       \
+            stmt;                                      \
+        }                                              \
+    } while (0)
+
+static volatile uint64_t sink;  // 防止查找结果被优化掉
+
+/* ---------- Zipf 分布(Gray et al., YCSB 使用的生成方法) ---------- */
+
+typedef struct Zipf {
+    uint64_t n;
+    double theta, alpha, zetan, eta, half_pow;
+} Zipf;
+
+static void zipf_init(Zipf *z, uint64_t n, double theta) {
+    double zeta2 = 1.0 + pow(0.5, theta);
+
+    z->n = n;
+    z->theta = theta;
+    z->zetan = 0;
+    for (uint64_t i = 1; i <= n; i++) z->zetan += 1.0 / pow((double)i, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+    z->half_pow = 1.0 + pow(0.5, theta);
+}
+
+/* 热门 rank 经哈希打散到整个 key 空间, 避免热点恰好相邻 */
+static uint64_t zipf_key(Zipf *z, uint64_t *rng) {
+    double u = (double)(rng_next(rng) >> 11) / (double)(1ULL << 53);
+    double uz = u * z->zetan;
+    uint64_t rank;
+
+    if (uz < 1.0) {
+        rank = 0;
+    } else if (uz < z->half_pow) {
+        rank = 1;
+    } else {
+        rank = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+        if (rank >= z->n) rank = z->n - 1;
+    }
+    return 2 * (mix64(rank) % z->n);
+}
+
+/* ---------- 引擎 ---------- */
+
+static int u64_cmp(Data *src, Data *dest) {
+    uint64_t a, b;
+    memcpy(&a, src->buffer, sizeof(a));
+    memcpy(&b, dest->buffer, sizeof(b));
+    return (a > b) - (a < b);
+}
+
+typedef struct Engine {
+    const char *name;
+    void *(*create)(size_t n);
+    void (*destroy)(void *t);
+    void (*insert)(void *t, uint64_t key);  // 已存在时替换
+    bool (*lookup)(void *t, uint64_t key);
+    bool (*erase)(void *t, uint64_t key);
+    size_t (*scan)(void *t, uint64_t lo, size_t count);  // 从 lo 起访问 count 个 key
+    uint64_t (*traverse)(void *t);                        // 中序遍历, 返回 key 之和
+    RBTree *(*rbtree)(void *t);                           // 底层为 RBTree 时非空, 供批量/冻结查找使用
+} Engine;
+
+typedef struct ScanArg {
+    size_t left;
+    uint64_t sum;
+} ScanArg;
+
+/* RBTree: 普通(每个结点和 key 各一次 malloc)与定长内联池化两种配置 */
+static void *rb_create(size_t n) {
+    (void)n;
+    return rbt_rbtree_new();
+}
+
+static void *fixed_create(size_t n) {
+    return rbt_rbtree_new_fixed(sizeof(uint64_t), n);
+}
+
+static void rb_destroy(void *t) {
+    rbt_delete_tree(t);
+}
+
+static void rb_insert(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    rbt_upsert(t, &d, u64_cmp, NULL);
+}
+
+static bool rb_lookup(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    return rbt_search_node(t, &d, u64_cmp) != NULL;
+}
+
+static bool rb_erase(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    RBNode *node = rbt_search_node(t, &d, u64_cmp);
+    if (node) rbt_erase_node(t, node);
+    return node != NULL;
+}
+
+static int rb_scan_cb(RBNode *node, void *arg) {
+    ScanArg *sa = arg;
+    uint64_t key;
+    memcpy(&key, node->data.buffer, sizeof(key));
+    sa->sum += key;
+    return --sa->left == 0;
+}
+
+static size_t rb_scan(void *t, uint64_t lo, size_t count) {
+    Data d = {&lo, sizeof(lo)};
+    ScanArg sa = {count, 0};
+    size_t n = rbt_range_scan(t, &d, NULL, u64_cmp, rb_scan_cb, &sa);
+    sink += sa.sum;
+    return n;
+}
+
+static uint64_t rb_traverse(void *t) {
+    uint64_t sum = 0, key;
+    for (RBNode *node = rbt_min(t); node; node = rbt_successor(node)) {
+        memcpy(&key, node->data.buffer, sizeof(key));
+        sum += key;
+    }
+    return sum;
+}
+
+static RBTree *rb_rbtree(void *t) {
+    return t;
+}
+
+/* RBT_DEFINE 生成的类型化树, 比较直接内联 */
+static void *typed_create(size_t n) {
+    (void)n;
+    u64tree *tree = malloc(sizeof(u64tree));
+    if (NULL == tree) {
+        die("malloc bench typed tree");
+    }
+    u64tree_init(tree);
+    return tree;
+}
+
+static void typed_destroy(void *t) {
+    u64tree_clear(t);
+    free(t);
+}
+
+static void typed_insert(void *t, uint64_t key) {
+    if (!u64tree_search(t, key)) u64tree_insert(t, key);
+}
+
+static bool typed_lookup(void *t, uint64_t key) {
+    return u64tree_search(t, key) != NULL;
+}
+
+static bool typed_erase(void *t, uint64_t key) {
+    return u64tree_delete(t, key);
+}
+
+static u64tree_node *typed_lower(u64tree *tree, uint64_t key) {
+    u64tree_node *p = tree->root, *found = NULL;
+    while (p) {
+        if (key <= p->key) {
+            found = p;
+            p = p->left;
+        } else {
+            p = p->right;
+        }
+    }
+    return found;
+}
+
+static size_t typed_scan(void *t, uint64_t lo, size_t count) {
+    size_t n = 0;
+    uint64_t sum = 0;
+    for (u64tree_node *p = typed_lower(t, lo); p && n < count; p = u64tree_next(p), n++) {
+        sum += p->key;
+    }
+    sink += sum;
+    return n;
+}
+
+static uint64_t typed_traverse(void *t) {
+    uint64_t sum = 0;
+    for (u64tree_node *p = u64tree_first(t); p; p = u64tree_next(p)) sum += p->key;
+    return sum;
+}
+
+/* 颜色压进指针的紧凑结点 */
+static void *compact_create(size_t n) {
+    return rbt_compact_new(sizeof(uint64_t), n);
+}
+
+static void compact_destroy(void *t) {
+    rbt_compact_free(t);
+}
+
+static void compact_insert(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    rbt_compact_upsert(t, &d, u64_cmp, NULL);
+}
+
+static bool compact_lookup(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    return rbt_compact_search(t, &d, u64_cmp) != NULL;
+}
+
+static bool compact_erase(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    return rbt_compact_delete(t, &d, u64_cmp);
+}
+
+static size_t compact_scan(void *t, uint64_t lo, size_t count) {
+    RBCompactTree *tree = t;
+    RBCompactNode *p = tree->root, *found = NULL;
+    while (p) {
+        uint64_t key;
+        memcpy(&key, p->key, sizeof(key));
+        if (lo <= key) {
+            found = p;
+            p = p->left;
+        } else {
+            p = p->right;
+        }
+    }
+
+    size_t n = 0;
+    uint64_t sum = 0, key;
+    for (p = found; p && n < count; p = rbt_compact_next(p), n++) {
+        memcpy(&key, p->key, sizeof(key));
+        sum += key;
+    }
+    sink += sum;
+    return n;
+}
+
+static uint64_t compact_traverse(void *t) {
+    uint64_t sum = 0, key;
+    for (RBCompactNode *p = rbt_compact_first(t); p; p = rbt_compact_next(p)) {
+        memcpy(&key, p->key, sizeof(key));
+        sum += key;
+    }
+    return sum;
+}
+
+/* 数组 + 32 位下标 */
+static void *index_create(size_t n) {
+    return rbt_index_new(sizeof(uint64_t), n);
+}
+
+static void index_destroy(void *t) {
+    rbt_index_free(t);
+}
+
+static void index_insert(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    rbt_index_upsert(t, &d, u64_cmp, NULL);
+}
+
+static bool index_lookup(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    return rbt_index_search(t, &d, u64_cmp) != 0;
+}
+
+static bool index_erase(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    return rbt_index_delete(t, &d, u64_cmp);
+}
+
+static size_t index_scan(void *t, uint64_t lo, size_t count) {
+    RBIndexTree *tree = t;
+    uint32_t p = tree->root, found = 0;
+    while (p) {
+        uint64_t key;
+        memcpy(&key, rbt_index_key(tree, p).buffer, sizeof(key));
+        RBIndexNode *node = (RBIndexNode *)(tree->nodes + (size_t)p * tree->stride);
+        if (lo <= key) {
+            found = p;
+            p = node->left;
+        } else {
+            p = node->right;
+        }
+    }
+
+    size_t n = 0;
+    uint64_t sum = 0, key;
+    for (p = found; p && n < count; p = rbt_index_next(tree, p), n++) {
+        memcpy(&key, rbt_index_key(tree, p).buffer, sizeof(key));
+        sum += key;
+    }
+    sink += sum;
+    return n;
+}
+
+static uint64_t index_traverse(void *t) {
+    uint64_t sum = 0, key;
+    for (uint32_t p = rbt_index_first(t); p; p = rbt_index_next(t, p)) {
+        memcpy(&key, rbt_index_key(t, p).buffer, sizeof(key));
+        sum += key;
+    }
+    return sum;
+}
+
+/* B+ 树 */
+static void *bplus_create(size_t n) {
+    (void)n;
+    return bp_tree_new(sizeof(uint64_t), 0);
+}
+
+static void bplus_destroy(void *t) {
+    bp_tree_free(t);
+}
+
+static void bplus_insert(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    bp_upsert(t, &d, u64_cmp);
+}
+
+static bool bplus_lookup(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    return bp_search(t, &d, u64_cmp, NULL);
+}
+
+static bool bplus_erase(void *t, uint64_t key) {
+    Data d = {&key, sizeof(key)};
+    return bp_delete(t, &d, u64_cmp);
+}
+
+static size_t bplus_scan(void *t, uint64_t lo, size_t count) {
+    Data d = {&lo, sizeof(lo)}, key;
+    BPCursor cursor;
+    size_t n = 0;
+    uint64_t sum = 0, k;
+
+    bp_lower_bound(t, &d, u64_cmp, &cursor);
+    for (; n < count && bp_cursor_get(t, &cursor, &key); bp_cursor_next(&cursor), n++) {
+        memcpy(&k, key.buffer, sizeof(k));
+        sum += k;
+    }
+    sink += sum;
+    return n;
+}
+
+static uint64_t bplus_traverse(void *t) {
+    BPCursor cursor;
+    Data key;
+    uint64_t sum = 0, k;
+
+    for (bp_first(t, &cursor); bp_cursor_get(t, &cursor, &key); bp_cursor_next(&cursor)) {
+        memcpy(&k, key.buffer, sizeof(k));
+        sum += k;
+    }
+    return sum;
+}
+
+static const Engine engines[] = {
+    {"rb", rb_create, rb_destroy, rb_insert, rb_lookup, rb_erase, rb_scan, rb_traverse, rb_rbtree},
+    {"fixed", fixed_create, rb_destroy, rb_insert, rb_lookup, rb_erase, rb_scan, rb_traverse, rb_rbtree},
+    {"typed", typed_create, typed_destroy, typed_insert, typed_lookup, typed_erase, typed_scan, typed_traverse, NULL},
+    {"compact", compact_create, compact_destroy, compact_insert, compact_lookup, compact_erase, compact_scan,
+     compact_traverse, NULL},
+    {"index", index_create, index_destroy, index_insert, index_lookup, index_erase, index_scan, index_traverse, NULL},
+    {"bplus", bplus_create, bplus_destroy, bplus_insert, bplus_lookup, bplus_erase, bplus_scan, bplus_traverse, NULL},
+};
+
+#define NENGINES (sizeof(engines) / sizeof(engines[0]))
+
+/* ---------- 负载 ---------- */
+
+static void *prefilled(Ctx *ctx, const Engine *e) {
+    void *t = e->create(ctx->n);
+    for (size_t i = 0; i < ctx->n; i++) e->insert(t, ctx->keys[i]);
+    return t;
+}
+
+/* 插入类负载从空树开始计时, 返回的树用于统计内存 */
+static void *wl_insert(Ctx *ctx, const Engine *e, Result *res, int order) {
+    void *t = e->create(ctx->n);
+    Zipf zipf;
+    uint64_t rng = ctx->seed;
+    if (order == 3) zipf_init(&zipf, ctx->n, 0.99);
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ctx->n; i++) {
+        uint64_t key;
+        switch (order) {
+            case 0: key = 2 * i; break;
+            case 1: key = 2 * (ctx->n - 1 - i); break;
+            case 2: key = ctx->keys[i]; break;
+            default: key = zipf_key(&zipf, &rng); break;
+        }
+        TIMED(res, i, e->insert(t, key));
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->n;
+    return t;
+}
+
+static void *wl_insert_seq(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_insert(ctx, e, res, 0);
+}
+
+static void *wl_insert_rev(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_insert(ctx, e, res, 1);
+}
+
+static void *wl_insert_rand(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_insert(ctx, e, res, 2);
+}
+
+static void *wl_insert_zipf(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_insert(ctx, e, res, 3);
+}
+
+static void *wl_lookup(Ctx *ctx, const Engine *e, Result *res, int kind) {
+    void *t = prefilled(ctx, e);
+    uint64_t rng = ctx->seed, hits = 0;
+    Zipf zipf;
+    if (kind == 2) zipf_init(&zipf, ctx->n, 0.99);
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ctx->ops; i++) {
+        uint64_t r = rng_next(&rng);
+        uint64_t key = kind == 0 ? ctx->keys[r % ctx->n] : kind == 1 ? 2 * (r % ctx->n) + 1 : zipf_key(&zipf, &rng);
+        TIMED(res, i, hits += e->lookup(t, key));
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->ops;
+    sink += hits;
+    return t;
+}
+
+static void *wl_lookup_hit(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_lookup(ctx, e, res, 0);
+}
+
+static void *wl_lookup_miss(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_lookup(ctx, e, res, 1);
+}
+
+static void *wl_lookup_zipf(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_lookup(ctx, e, res, 2);
+}
+
+/* 以 RBT_BATCH_WIDTH 个为一批调用 rbt_search_batch, 延迟按批内平均计 */
+static void *wl_lookup_batch(Ctx *ctx, const Engine *e, Result *res) {
+    enum { BATCH = 256 };
+    void *t = prefilled(ctx, e);
+    RBTree *tree = e->rbtree(t);
+    uint64_t rng = ctx->seed, keys[BATCH];
+    Data data[BATCH], *refs[BATCH];
+    RBNode *out[BATCH];
+
+    for (int j = 0; j < BATCH; j++) {
+        data[j].buffer = &keys[j];
+        data[j].buffer_type = sizeof(uint64_t);
+        refs[j] = &data[j];
+    }
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ctx->ops; i += BATCH) {
+        size_t m = ctx->ops - i < BATCH ? ctx->ops - i : BATCH;
+        for (size_t j = 0; j < m; j++) keys[j] = ctx->keys[rng_next(&rng) % ctx->n];
+
+        uint64_t t0 = now_ns();
+        rbt_search_batch(tree, refs, m, out, u64_cmp);
+        lat_add(res, (now_ns() - t0) / m);
+        sink += out[0] != NULL;
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->ops;
+    return t;
+}
+
+static void *wl_lookup_frozen(Ctx *ctx, const Engine *e, Result *res) {
+    void *t = prefilled(ctx, e);
+    RBFrozen *frozen = rbt_freeze(e->rbtree(t), u64_cmp);
+    uint64_t rng = ctx->seed, hits = 0;
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ctx->ops; i++) {
+        uint64_t key = ctx->keys[rng_next(&rng) % ctx->n];
+        Data d = {&key, sizeof(key)};
+        TIMED(res, i, hits += rbt_frozen_search(frozen, &d, NULL));
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->ops;
+    sink += hits;
+
+    rbt_frozen_free(frozen);
+    return t;
+}
+
+static void *wl_delete_rand(Ctx *ctx, const Engine *e, Result *res) {
+    void *t = prefilled(ctx, e);
+    uint64_t rng = ctx->seed;
+
+    /* 换一种随机顺序删除, 与插入顺序无关 */
+    uint64_t *order = malloc(ctx->n * sizeof(uint64_t));
+    if (NULL == order) {
+        die("malloc bench delete order");
+    }
+    memcpy(order, ctx->keys, ctx->n * sizeof(uint64_t));
+    for (size_t i = ctx->n; i > 1; i--) {
+        size_t j = rng_next(&rng) % i;
+        uint64_t tmp = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = tmp;
+    }
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ctx->n; i++) {
+        TIMED(res, i, e->erase(t, order[i]));
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->n;
+
+    free(order);
+    return t;
+}
+
+/* 读比例为 read_pct, 写操作一半插入奇数 key 一半删除, 规模大致不变 */
+static void *wl_mixed(Ctx *ctx, const Engine *e, Result *res, unsigned read_pct) {
+    void *t = prefilled(ctx, e);
+    uint64_t rng = ctx->seed, hits = 0;
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ctx->ops; i++) {
+        uint64_t r = rng_next(&rng);
+        uint64_t key = 2 * ((r >> 8) % ctx->n) + ((r >> 7) & 1);
+        unsigned pct = r % 100;
+        if (pct < read_pct) {
+            TIMED(res, i, hits += e->lookup(t, key));
+        } else if (pct & 1) {
+            TIMED(res, i, e->insert(t, key));
+        } else {
+            TIMED(res, i, e->erase(t, key));
+        }
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->ops;
+    sink += hits;
+    return t;
+}
+
+static void *wl_mixed_r90(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_mixed(ctx, e, res, 90);
+}
+
+static void *wl_mixed_r50(Ctx *ctx, const Engine *e, Result *res) {
+    return wl_mixed(ctx, e, res, 50);
+}
+
+/* 删一个插一个, 考察分配器在稳定规模下的回收复用 */
+static void *wl_churn(Ctx *ctx, const Engine *e, Result *res) {
+    void *t = prefilled(ctx, e);
+    uint64_t rng = ctx->seed;
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ctx->ops; i++) {
+        size_t j = rng_next(&rng) % ctx->n;
+        uint64_t old = ctx->keys[j];
+        uint64_t new = old ^ 1;  // 在偶数和奇数之间来回切换
+        ctx->keys[j] = new;
+        TIMED(res, i, (e->erase(t, old), e->insert(t, new)));
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->ops;
+
+    /* 还原 key 数组, 后续负载仍以偶数为命中 */
+    for (size_t j = 0; j < ctx->n; j++) ctx->keys[j] &= ~1ULL;
+    return t;
+}
+
+static void *wl_scan(Ctx *ctx, const Engine *e, Result *res) {
+    void *t = prefilled(ctx, e);
+    uint64_t rng = ctx->seed;
+    size_t scans = ctx->ops / SCAN_LEN ? ctx->ops / SCAN_LEN : 1, visited = 0;
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < scans; i++) {
+        uint64_t lo = ctx->keys[rng_next(&rng) % ctx->n];
+        uint64_t t0 = now_ns();
+        visited += e->scan(t, lo, SCAN_LEN);
+        lat_add(res, now_ns() - t0);
+    }
+    res->ns = now_ns() - start;
+    res->ops = scans;
+    sink += visited;
+    return t;
+}
+
+/* ops 按访问的 key 个数计, 延迟为一次完整遍历 */
+static void *wl_traverse(Ctx *ctx, const Engine *e, Result *res) {
+    void *t = prefilled(ctx, e);
+
+    uint64_t start = timer_start();
+    for (int i = 0; i < 3; i++) {
+        uint64_t t0 = now_ns();
+        sink += e->traverse(t);
+        lat_add(res, now_ns() - t0);
+    }
+    res->ns = now_ns() - start;
+    res->ops = 3 * ctx->n;
+    return t;
+}
+
+/* ---------- 与引擎无关的负载: 多线程和持久化 ---------- */
+
+typedef struct ShardJob {
+    RBShardedTree *st;
+    Ctx *ctx;
+    uint64_t seed;
+    size_t ops;
+    Result res;
+} ShardJob;
+
+static void *shard_worker(void *arg) {
+    ShardJob *job = arg;
+    uint64_t rng = job->seed;
+
+    for (size_t i = 0; i < job->ops; i++) {
+        uint64_t r = rng_next(&rng);
+        uint64_t key = 2 * ((r >> 8) % job->ctx->n) + ((r >> 7) & 1), out;
+        Data d = {&key, sizeof(key)}, o = {&out, sizeof(out)};
+        if (r % 100 < 90) {
+            TIMED(&job->res, i, rbt_sharded_search(job->st, &d, &o));
+        } else if (r & 1) {
+            TIMED(&job->res, i, rbt_sharded_upsert(job->st, &d));
+        } else {
+            TIMED(&job->res, i, rbt_sharded_delete(job->st, &d));
+        }
+    }
+    return NULL;
+}
+
+/* 90/10 读写, threads 个线程; nshards 为 1 时等价于单把读写锁 */
+static void run_sharded(Ctx *ctx, uint32_t nshards, Result *res) {
+    RBShardedTree *st = rbt_sharded_new_hash(nshards, NULL, sizeof(uint64_t), u64_cmp, sizeof(uint64_t), ctx->n / nshards + 1);
+    for (size_t i = 0; i < ctx->n; i++) {
+        Data d = {&ctx->keys[i], sizeof(uint64_t)};
+        rbt_sharded_upsert(st, &d);
+    }
+
+    uint32_t nt = ctx->threads;
+    ShardJob *jobs = calloc(nt, sizeof(ShardJob));
+    pthread_t *tids = malloc(nt * sizeof(pthread_t));
+    if (NULL == jobs || NULL == tids) {
+        die("malloc bench shard jobs");
+    }
+
+    uint64_t start = timer_start();
+    for (uint32_t i = 0; i < nt; i++) {
+        jobs[i] = (ShardJob){st, ctx, ctx->seed + i, ctx->ops / nt, {0}};
+        pthread_create(&tids[i], NULL, shard_worker, &jobs[i]);
+    }
+    for (uint32_t i = 0; i < nt; i++) {
+        pthread_join(tids[i], NULL);
+        for (size_t j = 0; j < jobs[i].res.nlat; j++) lat_add(res, jobs[i].res.lat[j]);
+        free(jobs[i].res.lat);
+    }
+    res->ns = now_ns() - start;
+    res->ops = ctx->ops / nt * nt;
+
+    free(jobs);
+    free(tids);
+    rbt_sharded_free(st);
+}
+
+static void *wl_sharded_1(Ctx *ctx, const Engine *e, Result *res) {
+    (void)e;
+    run_sharded(ctx, 1, res);
+    return NULL;
+}
+
+static void *wl_sharded_16(Ctx *ctx, const Engine *e, Result *res) {
+    (void)e;
+    run_sharded(ctx, 16, res);
+    return NULL;
+}
+
+static int bench_sort_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* 已排序输入建树, threads 个工作线程 */
+static void *wl_par_build(Ctx *ctx, const Engine *e, Result *res) {
+    (void)e;
+    uint64_t *sorted = malloc(ctx->n * sizeof(uint64_t));
+    Data *items = malloc(ctx->n * sizeof(Data));
+    if (NULL == sorted || NULL == items) {
+        die("malloc bench build items");
+    }
+    memcpy(sorted, ctx->keys, ctx->n * sizeof(uint64_t));
+    qsort(sorted, ctx->n, sizeof(uint64_t), bench_sort_u64);
+    for (size_t i = 0; i < ctx->n; i++) {
+        items[i].buffer = &sorted[i];
+        items[i].buffer_type = sizeof(uint64_t);
+    }
+
+    ThreadPool *pool = tpool_new(ctx->threads);
+    RBTree *tree = rbt_rbtree_new_fixed(sizeof(uint64_t), 0);  // 不用池, 否则退化为串行
+
+    uint64_t start = timer_start();
+    rbt_par_build_sorted(pool, tree, items, ctx->n, u64_cmp);
+    res->ns = now_ns() - start;
+    res->ops = ctx->n;
+    lat_add(res, res->ns);
+
+    rbt_par_destroy(pool, tree);
+    tpool_free(pool);
+    free(items);
+    free(sorted);
+    return NULL;
+}
+
+static int64_t bench_map_key(RBNode *node, void *arg) {
+    (void)arg;
+    uint64_t key;
+    memcpy(&key, node->data.buffer, sizeof(key));
+    return (int64_t)key;
+}
+
+static int64_t bench_add(int64_t x, int64_t y) {
+    return x + y;
+}
+
+/* 对预填充的树并行求和, threads 个工作线程; 每轮遍历整棵树, 按结点数计吞吐 */
+static void *wl_par_reduce(Ctx *ctx, const Engine *e, Result *res) {
+    (void)e;
+    RBTree *tree = rbt_rbtree_new_fixed(sizeof(uint64_t), 0);
+    for (size_t i = 0; i < ctx->n; i++) {
+        Data d = {&ctx->keys[i], sizeof(uint64_t)};
+        rbt_insert_data(tree, &d, u64_cmp);
+    }
+    ThreadPool *pool = tpool_new(ctx->threads);
+    size_t rounds = ctx->ops / ctx->n + 1;
+
+    uint64_t start = timer_start();
+    for (size_t r = 0; r < rounds; r++) {
+        uint64_t t0 = now_ns();
+        sink += rbt_par_reduce(pool, tree, bench_map_key, bench_add, 0, NULL);
+        lat_add(res, now_ns() - t0);
+    }
+    res->ns = now_ns() - start;
+    res->ops = rounds * ctx->n;
+
+    rbt_par_destroy(pool, tree);
+    tpool_free(pool);
+    return NULL;
+}
+
+static void run_wal(Ctx *ctx, RBSyncPolicy policy, Result *res) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/rbt_bench_%d", ctx->dir, (int)getpid());
+
+    RBTree *tree = rbt_rbtree_new_fixed(sizeof(uint64_t), ctx->n);
+    RBWal *wal = rbt_wal_open(tree, path, u64_cmp, policy, 10);
+    size_t ops = ctx->n < WAL_MAX_OPS ? ctx->n : WAL_MAX_OPS;
+
+    uint64_t start = timer_start();
+    for (size_t i = 0; i < ops; i++) {
+        Data d = {&ctx->keys[i], sizeof(uint64_t)};
+        TIMED(res, i, rbt_wal_upsert(wal, &d));
+    }
+    rbt_wal_sync(wal);
+    res->ns = now_ns() - start;
+    res->ops = ops;
+
+    rbt_wal_close(wal);
+    rbt_delete_tree(tree);
+
+    char file[4200];
+    snprintf(file, sizeof(file), "%s.wal", path);
+    unlink(file);
+    snprintf(file, sizeof(file), "%s.snap", path);
+    unlink(file);
+}
+
+static void *wl_wal_each(Ctx *ctx, const Engine *e, Result *res) {
+    (void)e;
+    run_wal(ctx, RBT_SYNC_EACH, res);
+    return NULL;
+}
+
+static void *wl_wal_interval(Ctx *ctx, const Engine *e, Result *res) {
+    (void)e;
+    run_wal(ctx, RBT_SYNC_INTERVAL, res);
+    return NULL;
+}
+
+static void *wl_wal_none(Ctx *ctx, const Engine *e, Result *res) {
+    (void)e;
+    run_wal(ctx, RBT_SYNC_NONE, res);
+    return NULL;
+}
+
+typedef struct Workload {
+    const char *name;
+    void *(*run)(Ctx *ctx, const Engine *e, Result *res);  // 返回仍存活的树, 测完内存后销毁
+    int kind;  // 0 各引擎都跑, 1 仅 RBTree 引擎, 2 与引擎无关
+} Workload;
+
+static const Workload workloads[] = {
+    {"insert_seq", wl_insert_seq, 0},
+    {"insert_rev", wl_insert_rev, 0},
+    {"insert_rand", wl_insert_rand, 0},
+    {"insert_zipf", wl_insert_zipf, 0},
+    {"lookup_hit", wl_lookup_hit, 0},
+    {"lookup_miss", wl_lookup_miss, 0},
+    {"lookup_zipf", wl_lookup_zipf, 0},
+    {"lookup_batch", wl_lookup_batch, 1},
+    {"lookup_frozen", wl_lookup_frozen, 1},
+    {"delete_rand", wl_delete_rand, 0},
+    {"mixed_r90", wl_mixed_r90, 0},
+    {"mixed_r50", wl_mixed_r50, 0},
+    {"churn", wl_churn, 0},
+    {"scan_100", wl_scan, 0},
+    {"traverse", wl_traverse, 0},
+    {"sharded_1", wl_sharded_1, 2},
+    {"sharded_16", wl_sharded_16, 2},
+    {"par_build", wl_par_build, 2},
+    {"par_reduce", wl_par_reduce, 2},
+    {"wal_each", wl_wal_each, 2},
+    {"wal_interval", wl_wal_interval, 2},
+    {"wal_none", wl_wal_none, 2},
+};
+
+#define NWORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/* ---------- 报告 ---------- */
+
+static int cmp_u64(const void *a, const void *b) {
+    return bench_sort_u64(a, b);
+}
+
+static uint64_t percentile(Result *res, double p) {
+    if (!res->nlat) return 0;
+    size_t i = (size_t)(p * (res->nlat - 1) + 0.5);
+    return res->lat[i];
+}
+
+static long rss_kb(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static bool in_list(const char *list, const char *name) {
+    if (!list) return true;
+
+    size_t len = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)); p += len) {
+        bool start = p == list || p[-1] == ',';
+        bool end = p[len] == '\0' || p[len] == ',';
+        if (start && end) return true;
+    }
+    return false;
+}
+
+static void report(FILE *json, bool *first, const char *engine, const char *workload, Ctx *ctx, Result *res,
+                   long rss, RBStats *st) {
+    qsort(res->lat, res->nlat, sizeof(uint64_t), cmp_u64);
+    double secs = res->ns / 1e9;
+    double ops_s = secs > 0 ? res->ops / secs : 0;
+    uint64_t p50 = percentile(res, 0.50), p99 = percentile(res, 0.99), p999 = percentile(res, 0.999);
+    long peak = peak_rss_kb();
+
+    printf("%-8s %-14s %10zu %3u %12.0f %9llu %9llu %9llu %10ld %10ld\n", engine, workload, ctx->n, ctx->threads,
+           ops_s, (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999, rss, peak);
+    if (st->enabled && res->ops) {
+        printf("         stats/op: cmp %.2f, rotations %.3f, recolors %.3f, fixups %.3f+%.3f, mallocs %.3f, frees %.3f\n",
+               (double)st->cmp_calls / res->ops, (double)st->rotations / res->ops, (double)st->recolors / res->ops,
+               (double)st->insert_fixups / res->ops, (double)st->delete_fixups / res->ops,
+               (double)st->mallocs / res->ops, (double)st->frees / res->ops);
+    }
+    fflush(stdout);
+
+    if (json) {
+        fprintf(json,
+                "%s  {\"engine\": \"%s\", \"workload\": \"%s\", \"size\": %zu, \"threads\": %u, \"ops\": %llu, "
+                "\"seconds\": %.6f, \"ops_per_sec\": %.1f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+                "\"rss_kb\": %ld, \"peak_rss_kb\": %ld",
+                *first ? "" : ",\n", engine, workload, ctx->n, ctx->threads, (unsigned long long)res->ops, secs,
+                ops_s, (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999, rss, peak);
+        if (st->enabled) {
+            fprintf(json,
+                    ", \"cmp_calls\": %llu, \"rotations\": %llu, \"recolors\": %llu, \"insert_fixups\": %llu, "
+                    "\"delete_fixups\": %llu, \"mallocs\": %llu, \"frees\": %llu",
+                    (unsigned long long)st->cmp_calls, (unsigned long long)st->rotations,
+                    (unsigned long long)st->recolors, (unsigned long long)st->insert_fixups,
+                    (unsigned long long)st->delete_fixups, (unsigned long long)st->mallocs,
+                    (unsigned long long)st->frees);
+        }
+        fprintf(json, "}");
+        *first = false;
+    }
+}
+
+static void run_one(FILE *json, bool *first, Ctx *ctx, const Engine *e, const Workload *w) {
+    Result res = {0};
+    RBStats st;
+    void *t = w->run(ctx, e, &res);
+    long rss = rss_kb();
+    rbt_stats(NULL, &st);  // 只统计本线程, 多线程负载中工作线程的计数不在其中
+    if (t) e->destroy(t);
+
+    report(json, first, e ? e->name : "-", w->name, ctx, &res, rss, &st);
+    free(res.lat);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --engines LIST    rb,fixed,typed,compact,index,bplus (default: all)\n"
+            "  --workloads LIST  workload names, see below (default: all)\n"
+            "  --sizes LIST      prefilled key counts, e.g. 1000,1000000,100000000 (default: 1000,100000,1000000)\n"
+            "  --ops N           operations for lookup/mixed/scan workloads (default: min(size, 1000000))\n"
+            "  --threads LIST    thread counts for sharded_* and par_*, e.g. 1,2,4 (default: CPU count)\n"
+            "  --seed N          random seed (default: 42)\n"
+            "  --dir DIR         directory for wal_* files (default: /tmp)\n"
+            "  --json FILE       also write results as a JSON array\n"
+            "workloads:",
+            prog);
+    for (size_t i = 0; i < NWORKLOADS; i++) fprintf(stderr, " %s", workloads[i].name);
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *engine_list = NULL, *workload_list = NULL, *json_path = NULL;
+    const char *size_list = "1000,100000,1000000";
+    char ncpu[16];
+    snprintf(ncpu, sizeof(ncpu), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    const char *thread_list = ncpu;
+    size_t ops = 0;
+    Ctx ctx = {.seed = 42, .threads = 1, .dir = "/tmp"};
+
+    static const struct option opts[] = {
+        {"engines", required_argument, NULL, 'e'}, {"workloads", required_argument, NULL, 'w'},
+        {"sizes", required_argument, NULL, 's'},   {"ops", required_argument, NULL, 'o'},
+        {"threads", required_argument, NULL, 't'}, {"seed", required_argument, NULL, 'r'},
+        {"dir", required_argument, NULL, 'd'},     {"json", required_argument, NULL, 'j'},
+        {"help", no_argument, NULL, 'h'},          {NULL, 0, NULL, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "e:w:s:o:t:r:d:j:h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'e': engine_list = optarg; break;
+            case 'w': workload_list = optarg; break;
+            case 's': size_list = optarg; break;
+            case 'o': ops = strtoull(optarg, NULL, 10); break;
+            case 't': thread_list = optarg; break;
+            case 'r': ctx.seed = strtoull(optarg, NULL, 10); break;
+            case 'd': ctx.dir = optarg; break;
+            case 'j': json_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    FILE *json = NULL;
+    if (json_path) {
+        json = fopen(json_path, "w");
+        if (!json) {
+            die("open %s:", json_path);
+        }
+        fprintf(json, "[\n");
+    }
+    bool first = true;
+
+    printf("%-8s %-14s %10s %3s %12s %9s %9s %9s %10s %10s\n", "engine", "workload", "size", "thr", "ops/s",
+           "p50_ns", "p99_ns", "p999_ns", "rss_kb", "peak_kb");
+
+    for (const char *p = size_list; *p;) {
+        ctx.n = strtoull(p, (char **)&p, 10);
+        if (*p == ',') p++;
+        if (ctx.n == 0) continue;
+        ctx.ops = ops ? ops : (ctx.n < 1000000 ? ctx.n : 1000000);
+
+        ctx.keys = malloc(ctx.n * sizeof(uint64_t));
+        if (NULL == ctx.keys) {
+            die("malloc bench keys");
+        }
+        uint64_t rng = ctx.seed;
+        for (size_t i = 0; i < ctx.n; i++) ctx.keys[i] = 2 * i;
+        for (size_t i = ctx.n; i > 1; i--) {
+            size_t j = rng_next(&rng) % i;
+            uint64_t tmp = ctx.keys[i - 1];
+            ctx.keys[i - 1] = ctx.keys[j];
+            ctx.keys[j] = tmp;
+        }
+
+        for (size_t wi = 0; wi < NWORKLOADS; wi++) {
+            const Workload *w = &workloads[wi];
+            if (!in_list(workload_list, w->name)) continue;
+
+            if (w->kind == 2) {
+                for (const char *t = thread_list; *t;) {
+                    ctx.threads = strtoul(t, (char **)&t, 10);
+                    if (*t == ',') t++;
+                    if (ctx.threads == 0) continue;
+                    run_one(json, &first, &ctx, NULL, w);
+                }
+                ctx.threads = 1;
+                continue;
+            }
+            for (size_t ei = 0; ei < NENGINES; ei++) {
+                const Engine *e = &engines[ei];
+                if (!in_list(engine_list, e->name)) continue;
+                if (w->kind == 1 && !e->rbtree) continue;
+                run_one(json, &first, &ctx, e, w);
+            }
+        }
+        free(ctx.keys);
+    }
+
+    if (json) {
+        fprintf(json, "\n]\n");
+        fclose(json);
+    }
+    return 0;
+}
@@ -0,0 +1,369 @@
+#include "bptree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+/* 结点按正常容量 +1 分配, 插入可以先放进去再分裂 */
+#define BP_CHILDREN(node) ((BPNode **)(node)->body)
+#define BP_KEYS(tree, node) \
+    ((node)->leaf ? (node)->body : (node)->body + ((tree)->inner_cap + 2) * sizeof(BPNode *))
+#define BP_KEY(tree, node, i) (BP_KEYS(tree, node) + (size_t)(i) * (tree)->key_size)
+
+static BPNode *bp_node_new(BPTree *tree, bool leaf) {
+    BPNode *node = aligned_alloc(BP_NODE_ALIGN, tree->alloc_bytes);
+    if (NULL == node) {
+        die("malloc new_bpnode");
+    }
+
+    node->leaf = leaf;
+    node->n = 0;
+    node->prev = node->next = NULL;
+    return node;
+}
+
+BPTree *bp_tree_new(uint32_t key_size, uint32_t node_bytes) {
+    if (key_size == 0) {
+        die("bp_tree_new: key_size must be positive");
+    }
+
+    BPTree *new_tree = malloc(sizeof(BPTree));
+    if (NULL == new_tree) {
+        die("malloc new_bptree");
+    }
+    if (!node_bytes) node_bytes = BP_DEFAULT_NODE_BYTES;
+
+    node_bytes = (node_bytes + BP_NODE_ALIGN - 1) & ~(uint32_t)(BP_NODE_ALIGN - 1);
+
+    /* 容量按含 1 个余量的分配恰好装进 node_bytes 计算; 大 key 时放大结点, 保证分裂合并时两侧都不为空 */
+    for (;; node_bytes *= 2) {
+        if (node_bytes > UINT32_MAX / 2) {
+            die("bp_tree_new: key size %u too large", key_size);
+        }
+        new_tree->leaf_cap = (node_bytes - sizeof(BPNode)) / key_size - 1;
+        new_tree->inner_cap = (node_bytes - sizeof(BPNode) - sizeof(BPNode *)) / (key_size + sizeof(BPNode *)) - 1;
+        if (node_bytes >= sizeof(BPNode) + 5 * (key_size + sizeof(BPNode *)) + sizeof(BPNode *) &&
+            new_tree->leaf_cap >= 4 && new_tree->inner_cap >= 4) {
+            break;
+        }
+    }
+    new_tree->alloc_bytes = node_bytes;
+
+    new_tree->key_size = key_size;
+    new_tree->size = 0;
+    new_tree->root = bp_node_new(new_tree, true);
+
+    return new_tree;
+}
+
+static void bp_node_free(BPTree *tree, BPNode *node) {
+    if (!node->leaf) {
+        for (uint32_t i = 0; i <= node->n; i++) {
+            bp_node_free(tree, BP_CHILDREN(node)[i]);
+        }
+    }
+    free(node);
+}
+
+void bp_tree_free(BPTree *tree) {
+    if (tree) {
+        bp_node_free(tree, tree->root);
+        free(tree);
+    }
+}
+
+/* 第一个不小于 data 的 key 的位置; 置 *eq 表示该位置恰好相等 */
+static uint32_t bp_lower(BPTree *tree, BPNode *node, Data *data, CMP *cmp, bool *eq) {
+    uint32_t lo = 0, hi = node->n;
+    Data key = {NULL, tree->key_size};
+
+    *eq = false;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        key.buffer = BP_KEY(tree, node, mid);
+        int ret = cmp(data, &key);
+        if (ret > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+            if (ret == 0) *eq = true;
+        }
+    }
+    return lo;
+}
+
+/* 内部结点中应下降的孩子: 不大于 data 的分隔 key 的个数 */
+static uint32_t bp_child_index(BPTree *tree, BPNode *node, Data *data, CMP *cmp) {
+    bool eq;
+    uint32_t i = bp_lower(tree, node, data, cmp, &eq);
+    return eq ? i + 1 : i;
+}
+
+static BPNode *bp_find_leaf(BPTree *tree, Data *data, CMP *cmp) {
+    BPNode *node = tree->root;
+    while (!node->leaf) {
+        node = BP_CHILDREN(node)[bp_child_index(tree, node, data, cmp)];
+    }
+    return node;
+}
+
+static void bp_insert_key(BPTree *tree, BPNode *node, uint32_t i, const void *key) {
+    memmove(BP_KEY(tree, node, i + 1), BP_KEY(tree, node, i), (size_t)(node->n - i) * tree->key_size);
+    memcpy(BP_KEY(tree, node, i), key, tree->key_size);
+}
+
+static void bp_remove_key(BPTree *tree, BPNode *node, uint32_t i) {
+    memmove(BP_KEY(tree, node, i), BP_KEY(tree, node, i + 1), (size_t)(node->n - i - 1) * tree->key_size);
+}
+
+static void bp_insert_child(BPNode *node, uint32_t i, BPNode *child) {
+    memmove(&BP_CHILDREN(node)[i + 1], &BP_CHILDREN(node)[i], (node->n + 1 - i) * sizeof(BPNode *));
+    BP_CHILDREN(node)[i] = child;
+}
+
+static void bp_remove_child(BPNode *node, uint32_t i) {
+    memmove(&BP_CHILDREN(node)[i], &BP_CHILDREN(node)[i + 1], (node->n - i) * sizeof(BPNode *));
+}
+
+/* 超出容量时分裂出右半, 上推的分隔 key 写入 sep */
+static BPNode *bp_split(BPTree *tree, BPNode *node, unsigned char *sep) {
+    BPNode *right = bp_node_new(tree, node->leaf);
+    uint32_t mid = node->n / 2;
+
+    if (node->leaf) {
+        right->n = node->n - mid;
+        memcpy(BP_KEY(tree, right, 0), BP_KEY(tree, node, mid), (size_t)right->n * tree->key_size);
+        node->n = mid;
+        memcpy(sep, BP_KEY(tree, right, 0), tree->key_size);
+
+        right->next = node->next;
+        right->prev = node;
+        if (node->next) node->next->prev = right;
+        node->next = right;
+    } else {
+        /* keys[mid] 上推, 不留在任何一侧 */
+        right->n = node->n - mid - 1;
+        memcpy(sep, BP_KEY(tree, node, mid), tree->key_size);
+        memcpy(BP_KEY(tree, right, 0), BP_KEY(tree, node, mid + 1), (size_t)right->n * tree->key_size);
+        memcpy(BP_CHILDREN(right), &BP_CHILDREN(node)[mid + 1], (right->n + 1) * sizeof(BPNode *));
+        node->n = mid;
+    }
+    return right;
+}
+
+static BPNode *bp_insert(BPTree *tree, BPNode *node, Data *data, CMP *cmp, unsigned char *sep, bool *inserted) {
+    if (node->leaf) {
+        bool eq;
+        uint32_t i = bp_lower(tree, node, data, cmp, &eq);
+        if (eq) {
+            memcpy(BP_KEY(tree, node, i), data->buffer, tree->key_size);
+            *inserted = false;
+            return NULL;
+        }
+        bp_insert_key(tree, node, i, data->buffer);
+        node->n++;
+        *inserted = true;
+        return node->n > tree->leaf_cap ? bp_split(tree, node, sep) : NULL;
+    }
+
+    uint32_t ci = bp_child_index(tree, node, data, cmp);
+    BPNode *right = bp_insert(tree, BP_CHILDREN(node)[ci], data, cmp, sep, inserted);
+    if (!right) return NULL;
+
+    bp_insert_key(tree, node, ci, sep);
+    bp_insert_child(node, ci + 1, right);
+    node->n++;
+    return node->n > tree->inner_cap ? bp_split(tree, node, sep) : NULL;
+}
+
+bool bp_upsert(BPTree *tree, Data *data, CMP *cmp) {
+    if (data->buffer_type != tree->key_size) {
+        die("bp_upsert: key size %u, tree expects %u", data->buffer_type, tree->key_size);
+    }
+
+    unsigned char sep[tree->key_size];
+    bool inserted;
+    BPNode *right = bp_insert(tree, tree->root, data, cmp, sep, &inserted);
+
+    /* 根分裂, 树长高一层 */
+    if (right) {
+        BPNode *root = bp_node_new(tree, false);
+        root->n = 1;
+        memcpy(BP_KEY(tree, root, 0), sep, tree->key_size);
+        BP_CHILDREN(root)[0] = tree->root;
+        BP_CHILDREN(root)[1] = right;
+        tree->root = root;
+    }
+    if (inserted) tree->size++;
+
+    return inserted;
+}
+
+bool bp_search(BPTree *tree, Data *data, CMP *cmp, Data *out) {
+    BPNode *leaf = bp_find_leaf(tree, data, cmp);
+    bool eq;
+    uint32_t i = bp_lower(tree, leaf, data, cmp, &eq);
+
+    if (eq && out) {
+        out->buffer = BP_KEY(tree, leaf, i);
+        out->buffer_type = tree->key_size;
+    }
+    return eq;
+}
+
+/* 孩子 ci 不足半满: 先向左右兄弟借, 借不到再与兄弟合并 */
+static void bp_rebalance(BPTree *tree, BPNode *parent, uint32_t ci) {
+    BPNode *child = BP_CHILDREN(parent)[ci];
+    BPNode *left = ci > 0 ? BP_CHILDREN(parent)[ci - 1] : NULL;
+    BPNode *right = ci < parent->n ? BP_CHILDREN(parent)[ci + 1] : NULL;
+    uint32_t min = (child->leaf ? tree->leaf_cap : tree->inner_cap) / 2;
+
+    if (left && left->n > min) {
+        if (child->leaf) {
+            bp_insert_key(tree, child, 0, BP_KEY(tree, left, left->n - 1));
+            memcpy(BP_KEY(tree, parent, ci - 1), BP_KEY(tree, child, 0), tree->key_size);
+        } else {
+            bp_insert_key(tree, child, 0, BP_KEY(tree, parent, ci - 1));
+            bp_insert_child(child, 0, BP_CHILDREN(left)[left->n]);
+            memcpy(BP_KEY(tree, parent, ci - 1), BP_KEY(tree, left, left->n - 1), tree->key_size);
+        }
+        child->n++;
+        left->n--;
+        return;
+    }
+
+    if (right && right->n > min) {
+        if (child->leaf) {
+            memcpy(BP_KEY(tree, child, child->n), BP_KEY(tree, right, 0), tree->key_size);
+            bp_remove_key(tree, right, 0);
+            memcpy(BP_KEY(tree, parent, ci), BP_KEY(tree, right, 0), tree->key_size);
+        } else {
+            memcpy(BP_KEY(tree, child, child->n), BP_KEY(tree, parent, ci), tree->key_size);
+            BP_CHILDREN(child)[child->n + 1] = BP_CHILDREN(right)[0];
+            memcpy(BP_KEY(tree, parent, ci), BP_KEY(tree, right, 0), tree->key_size);
+            bp_remove_key(tree, right, 0);
+            bp_remove_child(right, 0);
+        }
+        child->n++;
+        right->n--;
+        return;
+    }
+
+    /* 合并 children[i] 与 children[i + 1], 右侧并入左侧 */
+    uint32_t i = left ? ci - 1 : ci;
+    left = BP_CHILDREN(parent)[i];
+    right = BP_CHILDREN(parent)[i + 1];
+
+    if (left->leaf) {
+        memcpy(BP_KEY(tree, left, left->n), BP_KEY(tree, right, 0), (size_t)right->n * tree->key_size);
+        left->n += right->n;
+        left->next = right->next;
+        if (right->next) right->next->prev = left;
+    } else {
+        memcpy(BP_KEY(tree, left, left->n), BP_KEY(tree, parent, i), tree->key_size);
+        memcpy(BP_KEY(tree, left, left->n + 1), BP_KEY(tree, right, 0), (size_t)right->n * tree->key_size);
+        memcpy(&BP_CHILDREN(left)[left->n + 1], BP_CHILDREN(right), (right->n + 1) * sizeof(BPNode *));
+        left->n += right->n + 1;
+    }
+    free(right);
+
+    bp_remove_key(tree, parent, i);
+    bp_remove_child(parent, i + 1);
+    parent->n--;
+}
+
+static bool bp_remove(BPTree *tree, BPNode *node, Data *data, CMP *cmp) {
+    if (node->leaf) {
+        bool eq;
+        uint32_t i = bp_lower(tree, node, data, cmp, &eq);
+        if (!eq) return false;
+
+        /* 父结点中的分隔 key 即使等于被删 key 也仍是合法的界, 不必更新 */
+        bp_remove_key(tree, node, i);
+        node->n--;
+        return true;
+    }
+
+    uint32_t ci = bp_child_index(tree, node, data, cmp);
+    BPNode *child = BP_CHILDREN(node)[ci];
+    if (!bp_remove(tree, child, data, cmp)) return false;
+
+    if (child->n < (child->leaf ? tree->leaf_cap : tree->inner_cap) / 2) {
+        bp_rebalance(tree, node, ci);
+    }
+    return true;
+}
+
+bool bp_delete(BPTree *tree, Data *data, CMP *cmp) {
+    if (!bp_remove(tree, tree->root, data, cmp)) return false;
+
+    /* 根只剩一个孩子时树变矮一层 */
+    BPNode *root = tree->root;
+    if (!root->leaf && root->n == 0) {
+        tree->root = BP_CHILDREN(root)[0];
+        free(root);
+    }
+    tree->size--;
+
+    return true;
+}
+
+void bp_first(BPTree *tree, BPCursor *cursor) {
+    BPNode *node = tree->root;
+    while (!node->leaf) node = BP_CHILDREN(node)[0];
+
+    cursor->leaf = node->n ? node : NULL;
+    cursor->i = 0;
+}
+
+void bp_lower_bound(BPTree *tree, Data *data, CMP *cmp, BPCursor *cursor) {
+    bool eq;
+    BPNode *leaf = bp_find_leaf(tree, data, cmp);
+    uint32_t i = bp_lower(tree, leaf, data, cmp, &eq);
+
+    /* 落在叶子末尾时答案是下一片叶子的第一个 key */
+    if (i == leaf->n) {
+        leaf = leaf->next;
+        i = 0;
+    }
+    cursor->leaf = leaf;
+    cursor->i = i;
+}
+
+bool bp_cursor_get(BPTree *tree, BPCursor *cursor, Data *out) {
+    if (!cursor->leaf) return false;
+
+    out->buffer = BP_KEY(tree, cursor->leaf, cursor->i);
+    out->buffer_type = tree->key_size;
+    return true;
+}
+
+void bp_cursor_next(BPCursor *cursor) {
+    if (!cursor->leaf) return;
+
+    if (++cursor->i >= cursor->leaf->n) {
+        cursor->leaf = cursor->leaf->next;
+        cursor->i = 0;
+    }
+}
+
+size_t bp_range_scan(BPTree *tree, Data *lo, Data *hi, CMP *cmp, DSCAN *scan, void *arg) {
+    BPCursor cursor;
+    Data key;
+    size_t count = 0;
+
+    if (lo) {
+        bp_lower_bound(tree, lo, cmp, &cursor);
+    } else {
+        bp_first(tree, &cursor);
+    }
+
+    for (; bp_cursor_get(tree, &cursor, &key); bp_cursor_next(&cursor)) {
+        if (hi && cmp(&key, hi) > 0) break;
+
+        count++;
+        if (scan(&key, arg)) break;
+    }
+    return count;
+}
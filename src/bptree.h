@@ -0,0 +1,54 @@
+#ifndef BPTREE_H
+#define BPTREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * B+ 树: 定长 key, 结点按 node_bytes(默认 256 字节, 64 字节对齐)切分容量,
+ * 结点内二分查找; 数据只在叶子中, 叶子双向链接, 范围扫描顺序访问相邻叶子.
+ * 内部结点 keys[i] 不大于 children[i + 1] 中的所有 key, 等于它的 key 走右侧.
+ * key 唯一, 重复插入时替换.
+ */
+#define BP_DEFAULT_NODE_BYTES 256
+#define BP_NODE_ALIGN 64
+
+typedef struct BPNode {
+    uint32_t leaf;
+    uint32_t n;             // key 个数
+    struct BPNode *prev;    // 仅叶子使用
+    struct BPNode *next;
+    unsigned char body[];   // 内部结点: children[inner_cap + 2], keys; 叶子: keys
+} BPNode;
+
+typedef struct BPTree {
+    BPNode *root;
+    uint32_t size;
+    uint32_t key_size;
+    uint32_t leaf_cap;   // 叶子最多 key 数
+    uint32_t inner_cap;  // 内部结点最多 key 数
+    uint32_t alloc_bytes;
+} BPTree;
+
+typedef struct BPCursor {
+    BPNode *leaf;  // 为空表示已越过末尾
+    uint32_t i;
+} BPCursor;
+
+BPTree *bp_tree_new(uint32_t key_size, uint32_t node_bytes);  // key_size 须为正; node_bytes 为 0 时取默认值
+void bp_tree_free(BPTree *tree);
+
+bool bp_upsert(BPTree *tree, Data *data, CMP *cmp);  // 返回是否新插入
+bool bp_search(BPTree *tree, Data *data, CMP *cmp, Data *out);  // out 指向叶子中的 key, 在下次修改前有效
+bool bp_delete(BPTree *tree, Data *data, CMP *cmp);
+
+void bp_first(BPTree *tree, BPCursor *cursor);
+void bp_lower_bound(BPTree *tree, Data *data, CMP *cmp, BPCursor *cursor);
+bool bp_cursor_get(BPTree *tree, BPCursor *cursor, Data *out);  // 越过末尾时返回 false
+void bp_cursor_next(BPCursor *cursor);
+size_t bp_range_scan(BPTree *tree, Data *lo, Data *hi, CMP *cmp, DSCAN *scan, void *arg);  // 闭区间, 为空表示不设界
+
+#endif
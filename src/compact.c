@@ -0,0 +1,308 @@
+#include "compact.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbtree_balance.h"
+#include "utils.h"
+
+/* ---------- 颜色压进 parent 指针 ---------- */
+
+/* 平衡代码用的存取宏, 参数都是简单变量, 重复求值无妨; 只有根的读写经过 tree */
+#define cp_left(tree, node) ((node)->left)
+#define cp_right(tree, node) ((node)->right)
+#define cp_parent(tree, node) rbt_compact_parent(node)
+#define cp_color(tree, node) ((node) ? rbt_compact_color(node) : BLACK)
+#define cp_set_left(tree, node, v) ((node)->left = (v))
+#define cp_set_right(tree, node, v) ((node)->right = (v))
+#define cp_set_parent(tree, node, v) ((node)->parent_color = (uintptr_t)(v) | ((node)->parent_color & 1))
+#define cp_set_color(tree, node, v) ((node)->parent_color = ((node)->parent_color & ~(uintptr_t)1) | (v))
+#define cp_root(tree) ((tree)->root)
+#define cp_set_root(tree, v) ((tree)->root = (v))
+
+RBT_BALANCE_DEFINE(cp, cp, RBCompactTree, RBCompactNode *, NULL)
+
+RBCompactTree *rbt_compact_new(uint32_t key_size, uint32_t node_hint) {
+    /* 结点大小和池的块大小都以 uint32_t 传给池, 溢出时直接报错而不是截断 */
+    uint64_t node_size = (uint64_t)sizeof(RBCompactNode) + key_size;
+    uint64_t block_size = node_size * (node_hint < 64 ? 64 : node_hint);
+    if (block_size > UINT32_MAX) {
+        die("rbt_compact_new: key size %u * node hint %u overflows pool block", key_size, node_hint);
+    }
+
+    RBCompactTree *new_tree = malloc(sizeof(RBCompactTree));
+    if (NULL == new_tree) {
+        die("malloc new_compact_tree");
+    }
+
+    new_tree->root = NULL;
+    new_tree->size = 0;
+    new_tree->key_size = key_size;
+    new_tree->pool = pool_new((uint32_t)block_size);
+
+    return new_tree;
+}
+
+static void cp_free_big(RBCompactTree *tree, RBCompactNode *node) {
+    while (node) {
+        cp_free_big(tree, node->left);
+        RBCompactNode *right = node->right;
+        pool_free(tree->pool, node, sizeof(RBCompactNode) + tree->key_size);
+        node = right;
+    }
+}
+
+void rbt_compact_free(RBCompactTree *tree) {
+    if (!tree) return;
+
+    /* 小结点随池整块释放, 只有超大结点需要逐个归还 */
+    if (sizeof(RBCompactNode) + tree->key_size > POOL_MAX_CHUNK) {
+        cp_free_big(tree, tree->root);
+    }
+    pool_destroy(tree->pool);
+    free(tree);
+}
+
+RBCompactNode *rbt_compact_upsert(RBCompactTree *tree, Data *data, CMP *cmp, bool *inserted) {
+    if (data->buffer_type != tree->key_size) {
+        die("rbt_compact_upsert: key size %u, tree expects %u", data->buffer_type, tree->key_size);
+    }
+
+    RBCompactNode *parent = NULL, *p = tree->root;
+    int ret = 0;
+    while (p) {
+        Data key = {p->key, tree->key_size};
+        ret = cmp(data, &key);
+        if (ret == 0) {
+            memcpy(p->key, data->buffer, tree->key_size);
+            if (inserted) *inserted = false;
+            return p;
+        }
+        parent = p;
+        p = ret < 0 ? p->left : p->right;
+    }
+
+    RBCompactNode *node = pool_alloc(tree->pool, sizeof(RBCompactNode) + tree->key_size);
+    node->parent_color = (uintptr_t)parent | RED;
+    node->left = node->right = NULL;
+    memcpy(node->key, data->buffer, tree->key_size);
+
+    if (!parent) {
+        tree->root = node;
+    } else if (ret < 0) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+    cp_fix_after_insert(tree, node);
+    tree->size++;
+
+    if (inserted) *inserted = true;
+    return node;
+}
+
+RBCompactNode *rbt_compact_search(RBCompactTree *tree, Data *data, CMP *cmp) {
+    RBCompactNode *p = tree->root;
+    while (p) {
+        Data key = {p->key, tree->key_size};
+        int ret = cmp(data, &key);
+        if (ret < 0) {
+            p = p->left;
+        } else if (ret > 0) {
+            p = p->right;
+        } else {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* 两个孩子时用后继顶替 node 的位置(连同颜色), 结点地址保持不变 */
+void rbt_compact_erase(RBCompactTree *tree, RBCompactNode *node) {
+    cp_unlink(tree, node);
+    pool_free(tree->pool, node, sizeof(RBCompactNode) + tree->key_size);
+    tree->size--;
+}
+
+bool rbt_compact_delete(RBCompactTree *tree, Data *data, CMP *cmp) {
+    RBCompactNode *node = rbt_compact_search(tree, data, cmp);
+    if (node) {
+        rbt_compact_erase(tree, node);
+    }
+    return node != NULL;
+}
+
+RBCompactNode *rbt_compact_first(RBCompactTree *tree) {
+    return cp_first(tree);
+}
+
+RBCompactNode *rbt_compact_next(RBCompactNode *node) {
+    return cp_next(NULL, node);  // 后继只沿结点链接走, 用不到树
+}
+
+Data rbt_compact_key(RBCompactTree *tree, RBCompactNode *node) {
+    Data key = {node->key, tree->key_size};
+    return key;
+}
+
+/* ---------- 数组 + 32 位下标 ---------- */
+
+#define IN(tree, i) ((RBIndexNode *)((tree)->nodes + (size_t)(i) * (tree)->stride))
+#define IP(tree, i) (IN(tree, i)->parent_color >> 1)
+
+#define ix_left(tree, i) (IN(tree, i)->left)
+#define ix_right(tree, i) (IN(tree, i)->right)
+#define ix_parent(tree, i) IP(tree, i)
+#define ix_color(tree, i) ((i) ? (Color)(IN(tree, i)->parent_color & 1) : BLACK)
+#define ix_set_left(tree, i, v) (IN(tree, i)->left = (v))
+#define ix_set_right(tree, i, v) (IN(tree, i)->right = (v))
+#define ix_set_parent(tree, i, v) (IN(tree, i)->parent_color = (v) << 1 | (IN(tree, i)->parent_color & 1))
+#define ix_set_color(tree, i, v) (IN(tree, i)->parent_color = (IN(tree, i)->parent_color & ~1u) | (v))
+#define ix_root(tree) ((tree)->root)
+#define ix_set_root(tree, v) ((tree)->root = (v))
+
+RBT_BALANCE_DEFINE(ix, ix, RBIndexTree, uint32_t, 0)
+
+static void ix_reserve(RBIndexTree *tree, uint32_t capacity) {
+    if (capacity <= tree->capacity) return;
+
+    unsigned char *nodes = realloc(tree->nodes, (size_t)capacity * tree->stride);
+    if (NULL == nodes) {
+        die("realloc index nodes");
+    }
+    tree->nodes = nodes;
+    tree->capacity = capacity;
+}
+
+RBIndexTree *rbt_index_new(uint32_t key_size, uint32_t node_hint) {
+    if ((uint64_t)sizeof(RBIndexNode) + key_size + 3 > UINT32_MAX) {
+        die("rbt_index_new: key size %u too large", key_size);
+    }
+
+    RBIndexTree *new_tree = malloc(sizeof(RBIndexTree));
+    if (NULL == new_tree) {
+        die("malloc new_index_tree");
+    }
+
+    new_tree->nodes = NULL;
+    new_tree->stride = (sizeof(RBIndexNode) + key_size + 3) & ~3u;
+    new_tree->key_size = key_size;
+    new_tree->root = 0;
+    new_tree->size = 0;
+    new_tree->used = 1;
+    new_tree->capacity = 0;
+    new_tree->free_head = 0;
+    if (node_hint > RBT_INDEX_MAX) node_hint = RBT_INDEX_MAX;
+    ix_reserve(new_tree, (node_hint < 15 ? 15 : node_hint) + 1);
+
+    return new_tree;
+}
+
+void rbt_index_free(RBIndexTree *tree) {
+    if (tree) {
+        free(tree->nodes);
+        free(tree);
+    }
+}
+
+static uint32_t ix_alloc(RBIndexTree *tree) {
+    uint32_t i = tree->free_head;
+    if (i) {
+        tree->free_head = IN(tree, i)->left;
+        return i;
+    }
+
+    if (tree->used >= RBT_INDEX_MAX) {
+        die("rbt_index: more than %u nodes", RBT_INDEX_MAX);
+    }
+    if (tree->used == tree->capacity) {
+        uint64_t capacity = (uint64_t)tree->capacity * 2;
+        ix_reserve(tree, capacity > RBT_INDEX_MAX + 1 ? RBT_INDEX_MAX + 1 : capacity);
+    }
+    return tree->used++;
+}
+
+uint32_t rbt_index_upsert(RBIndexTree *tree, Data *data, CMP *cmp, bool *inserted) {
+    if (data->buffer_type != tree->key_size) {
+        die("rbt_index_upsert: key size %u, tree expects %u", data->buffer_type, tree->key_size);
+    }
+
+    uint32_t parent = 0, p = tree->root;
+    int ret = 0;
+    while (p) {
+        Data key = {IN(tree, p)->key, tree->key_size};
+        ret = cmp(data, &key);
+        if (ret == 0) {
+            memcpy(IN(tree, p)->key, data->buffer, tree->key_size);
+            if (inserted) *inserted = false;
+            return p;
+        }
+        parent = p;
+        p = ret < 0 ? IN(tree, p)->left : IN(tree, p)->right;
+    }
+
+    /* 分配可能搬动数组, 之后才能取结点地址 */
+    uint32_t node = ix_alloc(tree);
+    RBIndexNode *n = IN(tree, node);
+    n->parent_color = parent << 1 | RED;
+    n->left = n->right = 0;
+    memcpy(n->key, data->buffer, tree->key_size);
+
+    if (!parent) {
+        tree->root = node;
+    } else if (ret < 0) {
+        IN(tree, parent)->left = node;
+    } else {
+        IN(tree, parent)->right = node;
+    }
+    ix_fix_after_insert(tree, node);
+    tree->size++;
+
+    if (inserted) *inserted = true;
+    return node;
+}
+
+uint32_t rbt_index_search(RBIndexTree *tree, Data *data, CMP *cmp) {
+    uint32_t p = tree->root;
+    while (p) {
+        Data key = {IN(tree, p)->key, tree->key_size};
+        int ret = cmp(data, &key);
+        if (ret < 0) {
+            p = IN(tree, p)->left;
+        } else if (ret > 0) {
+            p = IN(tree, p)->right;
+        } else {
+            return p;
+        }
+    }
+    return 0;
+}
+
+void rbt_index_erase(RBIndexTree *tree, uint32_t node) {
+    ix_unlink(tree, node);
+
+    IN(tree, node)->left = tree->free_head;
+    tree->free_head = node;
+    tree->size--;
+}
+
+bool rbt_index_delete(RBIndexTree *tree, Data *data, CMP *cmp) {
+    uint32_t node = rbt_index_search(tree, data, cmp);
+    if (node) {
+        rbt_index_erase(tree, node);
+    }
+    return node != 0;
+}
+
+uint32_t rbt_index_first(RBIndexTree *tree) {
+    return ix_first(tree);
+}
+
+uint32_t rbt_index_next(RBIndexTree *tree, uint32_t node) {
+    return ix_next(tree, node);
+}
+
+Data rbt_index_key(RBIndexTree *tree, uint32_t node) {
+    Data key = {IN(tree, node)->key, tree->key_size};
+    return key;
+}
@@ -0,0 +1,78 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "rbtree.h"
+
+/*
+ * 紧凑结点布局, 适合定长 key 的大树.
+ *
+ * RBCompactTree: 颜色放进 parent 指针的最低位(同 Linux rb_node), 结点 24 字节 + key,
+ * 从池中分配; RBNode 内联 key 时为 48 字节 + key.
+ *
+ * RBIndexTree: 结点放在一个数组里, 链接为 uint32_t 下标, 结点 12 字节 + key.
+ * 颜色占 parent 下标的最低位, 因此最多 2^31 - 1 个结点; 下标 0 表示空.
+ * 数组扩容时结点会搬家, 只能用下标引用结点, key 只保证 4 字节对齐.
+ */
+typedef struct RBCompactNode {
+    uintptr_t parent_color;  // parent 指针 | 颜色(0 红 1 黑)
+    struct RBCompactNode *left;
+    struct RBCompactNode *right;
+    unsigned char key[];
+} RBCompactNode;
+
+typedef struct RBCompactTree {
+    RBCompactNode *root;
+    uint32_t size;
+    uint32_t key_size;
+    Pool *pool;
+} RBCompactTree;
+
+#define rbt_compact_parent(node) ((RBCompactNode *)((node)->parent_color & ~(uintptr_t)1))
+#define rbt_compact_color(node) ((Color)((node)->parent_color & 1))
+
+RBCompactTree *rbt_compact_new(uint32_t key_size, uint32_t node_hint);
+void rbt_compact_free(RBCompactTree *tree);
+RBCompactNode *rbt_compact_upsert(RBCompactTree *tree, Data *data, CMP *cmp, bool *inserted);
+RBCompactNode *rbt_compact_search(RBCompactTree *tree, Data *data, CMP *cmp);
+void rbt_compact_erase(RBCompactTree *tree, RBCompactNode *node);
+bool rbt_compact_delete(RBCompactTree *tree, Data *data, CMP *cmp);
+RBCompactNode *rbt_compact_first(RBCompactTree *tree);
+RBCompactNode *rbt_compact_next(RBCompactNode *node);
+Data rbt_compact_key(RBCompactTree *tree, RBCompactNode *node);
+
+typedef struct RBIndexNode {
+    uint32_t parent_color;  // parent 下标 << 1 | 颜色
+    uint32_t left;
+    uint32_t right;
+    unsigned char key[];
+} RBIndexNode;
+
+typedef struct RBIndexTree {
+    unsigned char *nodes;  // 下标 i 的结点位于 nodes + i * stride, 0 号不用
+    uint32_t stride;
+    uint32_t key_size;
+    uint32_t root;
+    uint32_t size;
+    uint32_t used;       // 已切分过的下标上界
+    uint32_t capacity;
+    uint32_t free_head;  // 空闲结点经 left 串成链表
+} RBIndexTree;
+
+#define RBT_INDEX_MAX ((UINT32_MAX >> 1) - 1)
+
+RBIndexTree *rbt_index_new(uint32_t key_size, uint32_t node_hint);
+void rbt_index_free(RBIndexTree *tree);
+uint32_t rbt_index_upsert(RBIndexTree *tree, Data *data, CMP *cmp, bool *inserted);
+uint32_t rbt_index_search(RBIndexTree *tree, Data *data, CMP *cmp);  // 未找到返回 0
+void rbt_index_erase(RBIndexTree *tree, uint32_t index);
+bool rbt_index_delete(RBIndexTree *tree, Data *data, CMP *cmp);
+uint32_t rbt_index_first(RBIndexTree *tree);
+uint32_t rbt_index_next(RBIndexTree *tree, uint32_t index);
+Data rbt_index_key(RBIndexTree *tree, uint32_t index);  // 在下一次插入前有效
+
+#endif
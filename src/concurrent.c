@@ -0,0 +1,216 @@
+#include "concurrent.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+/* 与 rbtree.c 中 RBT_SET_LINK 的 release 写配对 */
+#define LOAD_LINK(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+
+RBConcTree *rbt_conc_new(RBTree *tree, CMP *cmp) {
+    RBConcTree *ct;
+    if (posix_memalign((void **)&ct, 64, sizeof(RBConcTree))) {
+        die("posix_memalign new_conc");
+    }
+
+    memset(ct, 0, sizeof(RBConcTree));
+    ct->tree = tree;
+    ct->cmp = cmp;
+    ct->epoch = 1;
+    ct->reclaim_at = RBT_CONC_RECLAIM_BATCH;
+    pthread_mutex_init(&ct->write_lock, NULL);
+
+    return ct;
+}
+
+void rbt_conc_free(RBConcTree *ct) {
+    if (!ct) return;
+
+    for (uint32_t i = 0; i < ct->nlimbo; i++) {
+        rbt_tree_node_free(ct->tree, ct->limbo[i].node);
+    }
+    free(ct->limbo);
+    pthread_mutex_destroy(&ct->write_lock);
+    rbt_delete_tree(ct->tree);
+    free(ct);
+}
+
+/* 占用第一个空闲槽位, 并把上界推到它之后, 使写者回收时能看到这个读者 */
+RBReader *rbt_conc_reader(RBConcTree *ct) {
+    for (uint32_t slot = 0; slot < RBT_MAX_READERS; slot++) {
+        uint32_t free_slot = 0;
+        if (!__atomic_compare_exchange_n(&ct->readers[slot].in_use, &free_slot, 1, false, __ATOMIC_ACQUIRE,
+                                         __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        uint32_t n = __atomic_load_n(&ct->nreaders, __ATOMIC_SEQ_CST);
+        while (n <= slot && !__atomic_compare_exchange_n(&ct->nreaders, &n, slot + 1, false, __ATOMIC_SEQ_CST,
+                                                         __ATOMIC_SEQ_CST)) {
+        }
+        return &ct->readers[slot];
+    }
+    die("rbt_conc_reader: more than %d readers", RBT_MAX_READERS);
+}
+
+void rbt_conc_reader_release(RBConcTree *ct, RBReader *reader) {
+    if (reader < ct->readers || reader >= ct->readers + RBT_MAX_READERS) {
+        die("rbt_conc_reader_release: reader does not belong to this tree");
+    }
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&reader->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void rbt_conc_enter(RBConcTree *ct, RBReader *reader) {
+    uint64_t epoch = __atomic_load_n(&ct->epoch, __ATOMIC_SEQ_CST);
+    for (;;) {
+        __atomic_store_n(&reader->epoch, epoch, __ATOMIC_SEQ_CST);
+        uint64_t now = __atomic_load_n(&ct->epoch, __ATOMIC_SEQ_CST);
+        if (now == epoch) break;
+        epoch = now;
+    }
+}
+
+static void rbt_conc_exit(RBReader *reader) {
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+bool rbt_conc_search(RBConcTree *ct, RBReader *reader, Data *data, Data *out) {
+    bool found;
+
+    rbt_conc_enter(ct, reader);
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&ct->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        found = false;
+        RBNode *p = LOAD_LINK(ct->tree->root);
+        for (uint32_t steps = 0; p && steps < RBT_CONC_MAX_DEPTH; steps++) {
+            int ret = ct->cmp(data, &p->data);
+            if (ret == 0) {
+                found = true;
+                if (out) {
+                    uint32_t size = p->data.buffer_type < out->buffer_type ? p->data.buffer_type : out->buffer_type;
+                    memcpy(out->buffer, p->data.buffer, size);
+                }
+                break;
+            }
+            p = ret < 0 ? LOAD_LINK(p->left) : LOAD_LINK(p->right);
+        }
+
+        /* 读取期间没有写入, 结果才有效 */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ct->seq, __ATOMIC_RELAXED) == seq) break;
+    }
+    rbt_conc_exit(reader);
+
+    return found;
+}
+
+static void rbt_conc_seq_begin(RBConcTree *ct) {
+    __atomic_store_n(&ct->seq, ct->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void rbt_conc_write_begin(RBConcTree *ct) {
+    pthread_mutex_lock(&ct->write_lock);
+    rbt_conc_seq_begin(ct);
+}
+
+static void rbt_conc_retire(RBConcTree *ct, RBNode *node) {
+    if (ct->nlimbo == ct->limbo_capacity) {
+        ct->limbo_capacity = ct->limbo_capacity ? ct->limbo_capacity * 2 : 64;
+        RBRetired *limbo = realloc(ct->limbo, ct->limbo_capacity * sizeof(RBRetired));
+        if (NULL == limbo) {
+            die("realloc conc limbo");
+        }
+        ct->limbo = limbo;
+    }
+    ct->limbo[ct->nlimbo].node = node;
+    ct->limbo[ct->nlimbo].epoch = ct->epoch;
+    ct->nlimbo++;
+}
+
+/*
+ * 推进 epoch, 释放所有活跃读者都不可能再看到的结点.
+ * 被读者拖住而留下的结点越多, 下次回收前要攒的也越多, 避免每次写入都白扫一遍.
+ */
+static void rbt_conc_reclaim(RBConcTree *ct) {
+    __atomic_fetch_add(&ct->epoch, 1, __ATOMIC_SEQ_CST);
+
+    uint64_t min_active = UINT64_MAX;
+    uint32_t nreaders = __atomic_load_n(&ct->nreaders, __ATOMIC_SEQ_CST);
+    for (uint32_t i = 0; i < nreaders; i++) {
+        uint64_t epoch = __atomic_load_n(&ct->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch && epoch < min_active) {
+            min_active = epoch;
+        }
+    }
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < ct->nlimbo; i++) {
+        if (ct->limbo[i].epoch < min_active) {
+            rbt_tree_node_free(ct->tree, ct->limbo[i].node);
+        } else {
+            ct->limbo[kept++] = ct->limbo[i];
+        }
+    }
+    ct->nlimbo = kept;
+    ct->reclaim_at = kept + (kept > RBT_CONC_RECLAIM_BATCH ? kept : RBT_CONC_RECLAIM_BATCH);
+}
+
+static void rbt_conc_write_end(RBConcTree *ct) {
+    __atomic_store_n(&ct->seq, ct->seq + 1, __ATOMIC_RELEASE);
+    if (ct->nlimbo >= ct->reclaim_at) {
+        rbt_conc_reclaim(ct);
+    }
+    pthread_mutex_unlock(&ct->write_lock);
+}
+
+void rbt_conc_insert(RBConcTree *ct, Data *data) {
+    /* 在 seq 变为奇数之前分配结点, 缩短读者的重试窗口 */
+    pthread_mutex_lock(&ct->write_lock);
+    RBNode *node = rbt_tree_node_new(ct->tree, data);
+
+    rbt_conc_seq_begin(ct);
+    rbt_insert_node(ct->tree, node, ct->cmp);
+    rbt_conc_write_end(ct);
+}
+
+bool rbt_conc_upsert(RBConcTree *ct, Data *data) {
+    /* 查找和分配都不改动树, 放在 seq 变为奇数之前 */
+    pthread_mutex_lock(&ct->write_lock);
+    RBNode *node = rbt_search_node(ct->tree, data, ct->cmp);
+    bool inserted = node == NULL;
+    RBNode *fresh = rbt_tree_node_new(ct->tree, data);
+
+    rbt_conc_seq_begin(ct);
+    if (node) {
+        /* 读者可能正在拷贝旧结点的数据, 不原地改写; 新结点顶替旧结点的位置, 无需调整 */
+        rbt_replace_node(ct->tree, node, fresh);
+        rbt_conc_retire(ct, node);
+    } else {
+        rbt_insert_node(ct->tree, fresh, ct->cmp);
+    }
+
+    rbt_conc_write_end(ct);
+    return inserted;
+}
+
+bool rbt_conc_delete(RBConcTree *ct, Data *data) {
+    rbt_conc_write_begin(ct);
+
+    RBNode *node = rbt_search_node(ct->tree, data, ct->cmp);
+    if (node) {
+        rbt_unlink_node(ct->tree, node);
+        rbt_conc_retire(ct, node);
+    }
+
+    rbt_conc_write_end(ct);
+    return node != NULL;
+}
@@ -0,0 +1,57 @@
+#ifndef CONCURRENT_H
+#define CONCURRENT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 单写多读并发树: 写者之间用互斥锁串行, 读者不取锁.
+ * 读者按 seqlock 方式乐观下降, 期间若有写入则重试; 开始时若写入正在进行(seq 为奇数)则 sched_yield 等待,
+ * 因此读者并非 lock-free: 写者在临界区内被挂起时, 读者随之停顿.
+ * 被删除的结点延迟到所有可能看到它的读者离开后才释放(epoch-based reclamation),
+ * 待释放的结点攒够一批才扫描读者槽位, 写者的回收开销按批摊薄.
+ * 已挂进树的结点内容不再改写, 更新时换一个新结点顶替; 左右孩子和根用原子读写.
+ */
+#define RBT_MAX_READERS 128
+#define RBT_CONC_MAX_DEPTH 128     // 超过该步数说明撞上了正在旋转的指针, 直接重试
+#define RBT_CONC_RECLAIM_BATCH 64  // 待释放结点至少攒这么多才回收一次
+
+typedef struct RBReader {
+    uint64_t epoch;   // 0 表示不在读临界区内
+    uint32_t in_use;  // 槽位已被某个读线程占用
+} __attribute__((aligned(64))) RBReader;
+
+typedef struct RBRetired {
+    RBNode *node;
+    uint64_t epoch;  // 摘除时的全局 epoch
+} RBRetired;
+
+typedef struct RBConcTree {
+    RBTree *tree;
+    CMP *cmp;
+    pthread_mutex_t write_lock;
+    uint32_t seq;    // 奇数表示正在写
+    uint64_t epoch;  // 全局 epoch, 从 1 开始
+    RBReader readers[RBT_MAX_READERS];
+    uint32_t nreaders;  // 用过的槽位上界, 回收时只扫描这么多
+    RBRetired *limbo;  // 等待释放的结点
+    uint32_t nlimbo;
+    uint32_t limbo_capacity;
+    uint32_t reclaim_at;  // nlimbo 达到该值时回收
+} RBConcTree;
+
+RBConcTree *rbt_conc_new(RBTree *tree, CMP *cmp);  // 接管 tree
+void rbt_conc_free(RBConcTree *ct);
+RBReader *rbt_conc_reader(RBConcTree *ct);                        // 每个读线程注册一次, 同时最多 RBT_MAX_READERS 个
+void rbt_conc_reader_release(RBConcTree *ct, RBReader *reader);  // 读线程退出前归还槽位
+
+bool rbt_conc_search(RBConcTree *ct, RBReader *reader, Data *data, Data *out);  // 找到时拷贝至多 out->buffer_type 字节
+
+void rbt_conc_insert(RBConcTree *ct, Data *data);
+bool rbt_conc_upsert(RBConcTree *ct, Data *data);  // 返回是否新插入
+bool rbt_conc_delete(RBConcTree *ct, Data *data);
+
+#endif
@@ -0,0 +1,135 @@
+#include "frozen.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define FROZEN_KEY(frozen, k) ((frozen)->keys + (size_t)(k) * (frozen)->key_size)
+
+/*
+ * 按中序访问隐式树, 依次填入红黑树的有序 key.
+ * n 可达 UINT32_MAX, 孩子下标 2k + 1 超出 uint32, 下标运算一律用 uint64.
+ */
+static RBNode *rbt_frozen_fill(RBFrozen *frozen, uint64_t k, RBNode *node) {
+    if (k > frozen->n) return node;
+
+    node = rbt_frozen_fill(frozen, 2 * k, node);
+    memcpy(FROZEN_KEY(frozen, k), node->data.buffer, frozen->key_size);
+    node = rbt_successor(node);
+    return rbt_frozen_fill(frozen, 2 * k + 1, node);
+}
+
+RBFrozen *rbt_freeze(RBTree *tree, CMP *cmp) {
+    uint32_t key_size = tree->key_size;
+    if (!key_size && tree->root) {
+        key_size = tree->root->data.buffer_type;
+        for (RBNode *node = rbt_min(tree); node; node = rbt_successor(node)) {
+            if (node->data.buffer_type != key_size) return NULL;
+        }
+    }
+
+    RBFrozen *frozen = malloc(sizeof(RBFrozen));
+    if (NULL == frozen) {
+        die("malloc new_frozen");
+    }
+    frozen->n = tree->size;
+    frozen->key_size = key_size;
+    frozen->cmp = cmp;
+    frozen->keys = malloc(((size_t)tree->size + 1) * (key_size ? key_size : 1));
+    if (NULL == frozen->keys) {
+        die("malloc frozen keys");
+    }
+
+    rbt_frozen_fill(frozen, 1, rbt_min(tree));
+    return frozen;
+}
+
+void rbt_frozen_free(RBFrozen *frozen) {
+    if (frozen) {
+        free(frozen->keys);
+        free(frozen);
+    }
+}
+
+uint32_t rbt_frozen_first(RBFrozen *frozen) {
+    if (!frozen->n) return 0;
+
+    uint64_t k = 1;
+    while (2 * k <= frozen->n) k *= 2;
+    return (uint32_t)k;
+}
+
+uint32_t rbt_frozen_next(RBFrozen *frozen, uint32_t pos) {
+    uint64_t k = pos;
+    if (2 * k + 1 <= frozen->n) {
+        k = 2 * k + 1;
+        while (2 * k <= frozen->n) k *= 2;
+        return (uint32_t)k;
+    }
+    /* 沿右孩子一路向上, 再上一层即为后继; 全为 1 时移出最高位, 结果为 0 */
+    return (uint32_t)(k >> __builtin_ffsll(~k));
+}
+
+Data rbt_frozen_key(RBFrozen *frozen, uint32_t k) {
+    Data key = {FROZEN_KEY(frozen, k), frozen->key_size};
+    return key;
+}
+
+uint32_t rbt_frozen_lower_bound(RBFrozen *frozen, Data *data) {
+    uint64_t k = 1;
+
+    /* 无分支下降: 小于 data 向右, 否则向左; 16 倍下标处是 4 层之后的后代 */
+    while (k <= frozen->n) {
+        if (k * 16 <= frozen->n) {
+            __builtin_prefetch(FROZEN_KEY(frozen, k * 16));
+        }
+        Data key = {FROZEN_KEY(frozen, k), frozen->key_size};
+        k = 2 * k + (frozen->cmp(&key, data) < 0);
+    }
+    /* 去掉末尾向右走的步数, 再退一层即为最后一次向左的结点 */
+    return (uint32_t)(k >> __builtin_ffsll(~k));
+}
+
+bool rbt_frozen_search(RBFrozen *frozen, Data *data, Data *out) {
+    uint32_t k = rbt_frozen_lower_bound(frozen, data);
+    if (!k) return false;
+
+    Data key = rbt_frozen_key(frozen, k);
+    if (frozen->cmp(&key, data) != 0) return false;
+
+    if (out) *out = key;
+    return true;
+}
+
+size_t rbt_frozen_scan(RBFrozen *frozen, Data *lo, Data *hi, DSCAN *scan, void *arg) {
+    size_t count = 0;
+    uint32_t k = lo ? rbt_frozen_lower_bound(frozen, lo) : rbt_frozen_first(frozen);
+
+    for (; k; k = rbt_frozen_next(frozen, k)) {
+        Data key = rbt_frozen_key(frozen, k);
+        if (hi && frozen->cmp(&key, hi) > 0) break;
+
+        count++;
+        if (scan(&key, arg)) break;
+    }
+    return count;
+}
+
+RBTree *rbt_thaw(RBFrozen *frozen) {
+    /* 冻结变长 key 的空树时 key_size 为 0, 建回普通树 */
+    RBTree *tree = frozen->key_size ? rbt_rbtree_new_fixed(frozen->key_size, frozen->n) : rbt_rbtree_new();
+
+    Data *items = malloc(sizeof(Data) * (frozen->n ? frozen->n : 1));
+    if (NULL == items) {
+        die("malloc thaw items");
+    }
+    size_t i = 0;
+    for (uint32_t k = rbt_frozen_first(frozen); k; k = rbt_frozen_next(frozen, k)) {
+        items[i++] = rbt_frozen_key(frozen, k);
+    }
+
+    rbt_build_sorted(tree, items, i, frozen->cmp);
+    free(items);
+    return tree;
+}
@@ -0,0 +1,34 @@
+#ifndef FROZEN_H
+#define FROZEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 冻结的只读布局: 定长 key 按 Eytzinger(层序)顺序连续存放, 下标从 1 开始,
+ * k 的孩子为 2k 和 2k+1. 查找时无分支下降并预取 4 层之后的 cache line,
+ * 相邻几层落在同一 cache line 中, 代替红黑树每层一次随机指针访问.
+ * 下标 0 表示不存在/越过末尾.
+ */
+typedef struct RBFrozen {
+    unsigned char *keys;  // 第 k 个 key 位于 keys + k * key_size
+    uint32_t n;
+    uint32_t key_size;
+    CMP *cmp;
+} RBFrozen;
+
+RBFrozen *rbt_freeze(RBTree *tree, CMP *cmp);  // key 长度不一致时返回 NULL
+RBTree *rbt_thaw(RBFrozen *frozen);            // O(n) 建回定长 key 的池化树, key_size 为 0 时为普通树
+void rbt_frozen_free(RBFrozen *frozen);
+
+uint32_t rbt_frozen_lower_bound(RBFrozen *frozen, Data *data);  // 第一个不小于 data 的位置
+uint32_t rbt_frozen_first(RBFrozen *frozen);
+uint32_t rbt_frozen_next(RBFrozen *frozen, uint32_t k);  // 按 key 顺序的下一个位置
+Data rbt_frozen_key(RBFrozen *frozen, uint32_t k);
+bool rbt_frozen_search(RBFrozen *frozen, Data *data, Data *out);  // out 指向冻结数组中的 key
+size_t rbt_frozen_scan(RBFrozen *frozen, Data *lo, Data *hi, DSCAN *scan, void *arg);  // 闭区间, 为空表示不设界
+
+#endif
@@ -0,0 +1,82 @@
+#include "interval.h"
+
+#include "utils.h"
+
+RBTree *rbt_interval_tree_new(uint32_t key_size, uint32_t node_hint) {
+    if (key_size < sizeof(RBInterval)) {
+        die("rbt_interval_tree_new: key_size %u smaller than RBInterval", key_size);
+    }
+
+    RBTree *new_tree = rbt_rbtree_new_fixed(key_size, node_hint);
+    rbt_set_augment(new_tree, rbt_augment_interval);
+
+    return new_tree;
+}
+
+int rbt_interval_cmp(Data *src, Data *dest) {
+    RBInterval *x = src->buffer;
+    RBInterval *y = dest->buffer;
+
+    if (x->start != y->start) {
+        return x->start < y->start ? -1 : 1;
+    }
+    if (x->end != y->end) {
+        return x->end < y->end ? -1 : 1;
+    }
+    return 0;
+}
+
+void rbt_augment_interval(RBNode *node) {
+    RBInterval *iv = rbt_interval_of(node);
+
+    int64_t max = iv->end;
+    if (node->left && rbt_interval_of(node->left)->max > max) {
+        max = rbt_interval_of(node->left)->max;
+    }
+    if (node->right && rbt_interval_of(node->right)->max > max) {
+        max = rbt_interval_of(node->right)->max;
+    }
+    iv->max = max;
+}
+
+/* 返回非 0 表示回调要求停止 */
+static int rbt_interval_visit(RBNode *node, int64_t start, int64_t end, SCAN *scan, void *arg, size_t *count) {
+    /* 整棵子树的区间都在 start 之前结束 */
+    if (!node || rbt_interval_of(node)->max < start) return 0;
+
+    if (rbt_interval_visit(node->left, start, end, scan, arg, count)) return 1;
+
+    RBInterval *iv = rbt_interval_of(node);
+    /* 右子树的 start 只会更大 */
+    if (iv->start > end) return 0;
+
+    if (iv->end >= start) {
+        (*count)++;
+        if (scan(node, arg)) return 1;
+    }
+
+    return rbt_interval_visit(node->right, start, end, scan, arg, count);
+}
+
+size_t rbt_interval_overlaps(RBTree *tree, int64_t start, int64_t end, SCAN *scan, void *arg) {
+    size_t count = 0;
+    rbt_interval_visit(tree->root, start, end, scan, arg, &count);
+    return count;
+}
+
+RBNode *rbt_interval_any_overlap(RBTree *tree, int64_t start, int64_t end) {
+    RBNode *p = tree->root;
+    while (p) {
+        RBInterval *iv = rbt_interval_of(p);
+        if (iv->start <= end && iv->end >= start) {
+            return p;
+        }
+        /* 左子树的 max 够大时, 若左边没有重叠则右边也不会有 */
+        if (p->left && rbt_interval_of(p->left)->max >= start) {
+            p = p->left;
+        } else {
+            p = p->right;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 区间树: key 以 RBInterval 开头, 之后可跟任意负载.
+ * 按 start(相同时按 end) 排序, max 为子树中最大的 end, 由树在旋转和增删时维护.
+ * 插入/删除使用 rbt_insert_data / rbt_delete_data 并传入 rbt_interval_cmp.
+ */
+typedef struct RBInterval {
+    int64_t start;
+    int64_t end;  // 闭区间 [start, end]
+    int64_t max;  // 调用者无需填写
+} RBInterval;
+
+#define rbt_interval_of(node) ((RBInterval *)(node)->data.buffer)
+
+RBTree *rbt_interval_tree_new(uint32_t key_size, uint32_t node_hint);  // key_size 含 RBInterval 头
+int rbt_interval_cmp(Data *src, Data *dest);
+void rbt_augment_interval(RBNode *node);
+
+size_t rbt_interval_overlaps(RBTree *tree, int64_t start, int64_t end, SCAN *scan, void *arg);  // 按 start 升序访问所有重叠区间
+RBNode *rbt_interval_any_overlap(RBTree *tree, int64_t start, int64_t end);                    // 任一重叠区间, O(log n)
+
+#endif
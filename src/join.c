@@ -0,0 +1,344 @@
+#include "join.h"
+
+#include <stddef.h>
+
+#include "stats.h"
+#include "utils.h"
+
+typedef struct JoinCtx {
+    RBTree *owner;  // 按其配置释放结点
+    CMP *cmp;
+    uint32_t freed;
+} JoinCtx;
+
+static void rbt_require_compatible(RBTree *a, RBTree *b, const char *who) {
+    if (a->key_size != b->key_size || a->pool != b->pool || a->augment != b->augment) {
+        die("%s: trees were not created with the same configuration", who);
+    }
+}
+
+/* 黑高: node 到空叶子路径上的黑色结点数(含 node); 只在入口处算一次, 递归中由父结点的黑高推出 */
+static uint32_t rbt_black_height(RBNode *node) {
+    uint32_t height = 0;
+    for (; node; node = node->left) {
+        if (node->color == BLACK) height++;
+    }
+    return height;
+}
+
+/* 黑高为 h 的结点其孩子的黑高 */
+static inline uint32_t rbt_child_height(RBNode *node, uint32_t h) {
+    return h - (node->color == BLACK);
+}
+
+/*
+ * 以 k 连接两棵子树, 返回新根; l 中的 key 均不大于 k, r 中的均不小于 k.
+ * hl/hr 为两侧的黑高, *h 返回结果的黑高, 整个过程 O(|hl - hr| + 1).
+ */
+static RBNode *rbt_join_roots(AUGMENT *augment, RBNode *l, uint32_t hl, RBNode *k, RBNode *r, uint32_t hr,
+                              uint32_t *h) {
+    RBTree tmp = {.augment = augment};
+
+    /* 根染黑总是合法的(红根染黑后黑高加 1), 之后只需比较黑高 */
+    if (l) {
+        if (l->color == RED) hl++;
+        l->parent = NULL;
+        l->color = BLACK;
+    }
+    if (r) {
+        if (r->color == RED) hr++;
+        r->parent = NULL;
+        r->color = BLACK;
+    }
+
+    if (hl == hr) {
+        k->parent = NULL;
+        k->left = l;
+        k->right = r;
+        k->color = BLACK;
+        if (l) l->parent = k;
+        if (r) r->parent = k;
+        if (augment) augment(k);
+        *h = hl + 1;
+        return k;
+    }
+
+    /* 沿较高一侧的脊下降, 找到黑高与另一侧相同的黑结点 */
+    RBNode *parent = NULL;
+    RBNode *p;
+    uint32_t height;
+    if (hl > hr) {
+        tmp.root = p = l;
+        height = hl;
+        while (p && !(p->color == BLACK && height == hr)) {
+            if (p->color == BLACK) height--;
+            parent = p;
+            p = p->right;
+        }
+        k->left = p;
+        k->right = r;
+        parent->right = k;
+    } else {
+        tmp.root = p = r;
+        height = hr;
+        while (p && !(p->color == BLACK && height == hl)) {
+            if (p->color == BLACK) height--;
+            parent = p;
+            p = p->left;
+        }
+        k->left = l;
+        k->right = p;
+        parent->left = k;
+    }
+
+    k->parent = parent;
+    k->color = RED;
+    if (k->left) k->left->parent = k;
+    if (k->right) k->right->parent = k;
+
+    if (augment) {
+        for (RBNode *x = k; x; x = x->parent) {
+            augment(x);
+        }
+    }
+    /* 调整前根为黑; 根被染红再染黑时黑高加 1 */
+    *h = (hl > hr ? hl : hr) + fix_after_insert(&tmp, k);
+
+    return tmp.root;
+}
+
+/* 摘出最大结点, 其余部分经 join 重新连接; 返回最大结点, *rest 为剩余的树 */
+static RBNode *rbt_split_last(AUGMENT *augment, RBNode *t, uint32_t ht, RBNode **rest, uint32_t *hrest) {
+    RBNode *l = t->left;
+    RBNode *r = t->right;
+    uint32_t hc = rbt_child_height(t, ht);
+
+    if (!r) {
+        if (l) l->parent = NULL;
+        t->left = t->parent = NULL;
+        *rest = l;
+        *hrest = hc;
+        return t;
+    }
+
+    RBNode *rr;
+    uint32_t hrr;
+    RBNode *max = rbt_split_last(augment, r, hc, &rr, &hrr);
+    *rest = rbt_join_roots(augment, l, hc, t, rr, hrr, hrest);
+    return max;
+}
+
+/* 不带中间结点的连接: 取出 l 的最大结点作为 k */
+static RBNode *rbt_join2_roots(AUGMENT *augment, RBNode *l, uint32_t hl, RBNode *r, uint32_t hr, uint32_t *h) {
+    if (!l) {
+        *h = hr;
+        return r;
+    }
+    if (!r) {
+        *h = hl;
+        return l;
+    }
+
+    RBNode *rest;
+    uint32_t hrest;
+    RBNode *max = rbt_split_last(augment, l, hl, &rest, &hrest);
+    return rbt_join_roots(augment, rest, hrest, max, r, hr, h);
+}
+
+/*
+ * 按 key 拆分: *lo 小于 key, *hi 不小于 key; ht 为 t 的黑高, *hlo, *hhi 返回两部分的黑高.
+ * eq 非空时遇到相等的结点就把它单独取出, 此时 *hi 中的 key 大于等于 key.
+ */
+static void rbt_split_roots(AUGMENT *augment, CMP *cmp, RBNode *t, uint32_t ht, Data *key, RBNode **lo,
+                            uint32_t *hlo, RBNode **eq, RBNode **hi, uint32_t *hhi) {
+    if (!t) {
+        *lo = *hi = NULL;
+        *hlo = *hhi = 0;
+        return;
+    }
+
+    RBNode *l = t->left;
+    RBNode *r = t->right;
+    uint32_t hc = rbt_child_height(t, ht);
+    RBNode *mid;
+    uint32_t hmid;
+    int ret = rbt_cmp(cmp, key, &t->data);
+
+    if (ret == 0 && eq) {
+        if (l) l->parent = NULL;
+        if (r) r->parent = NULL;
+        t->left = t->right = t->parent = NULL;
+        *eq = t;
+        *lo = l;
+        *hi = r;
+        *hlo = *hhi = hc;
+    } else if (ret <= 0) {
+        rbt_split_roots(augment, cmp, l, hc, key, lo, hlo, eq, &mid, &hmid);
+        *hi = rbt_join_roots(augment, mid, hmid, t, r, hc, hhi);
+    } else {
+        rbt_split_roots(augment, cmp, r, hc, key, &mid, &hmid, eq, hi, hhi);
+        *lo = rbt_join_roots(augment, l, hc, t, mid, hmid, hlo);
+    }
+}
+
+static void rbt_free_nodes(JoinCtx *ctx, RBNode *node) {
+    if (!node) return;
+
+    rbt_free_nodes(ctx, node->left);
+    rbt_free_nodes(ctx, node->right);
+    rbt_tree_node_free(ctx->owner, node);
+    ctx->freed++;
+}
+
+static RBNode *rbt_union_roots(JoinCtx *ctx, RBNode *t1, uint32_t h1, RBNode *t2, uint32_t h2, uint32_t *h) {
+    if (!t1) {
+        *h = h2;
+        return t2;
+    }
+    if (!t2) {
+        *h = h1;
+        return t1;
+    }
+
+    RBNode *l1 = t1->left;
+    RBNode *r1 = t1->right;
+    uint32_t hc1 = rbt_child_height(t1, h1);
+    RBNode *l2, *r2, *m = NULL;
+    uint32_t hl2, hr2, hl, hr;
+    rbt_split_roots(ctx->owner->augment, ctx->cmp, t2, h2, &t1->data, &l2, &hl2, &m, &r2, &hr2);
+    if (m) {
+        rbt_free_nodes(ctx, m);
+    }
+
+    RBNode *l = rbt_union_roots(ctx, l1, hc1, l2, hl2, &hl);
+    RBNode *r = rbt_union_roots(ctx, r1, hc1, r2, hr2, &hr);
+    return rbt_join_roots(ctx->owner->augment, l, hl, t1, r, hr, h);
+}
+
+static RBNode *rbt_intersection_roots(JoinCtx *ctx, RBNode *t1, uint32_t h1, RBNode *t2, uint32_t h2, uint32_t *h) {
+    if (!t1 || !t2) {
+        rbt_free_nodes(ctx, t1);
+        rbt_free_nodes(ctx, t2);
+        *h = 0;
+        return NULL;
+    }
+
+    RBNode *l1 = t1->left;
+    RBNode *r1 = t1->right;
+    uint32_t hc1 = rbt_child_height(t1, h1);
+    RBNode *l2, *r2, *m = NULL;
+    uint32_t hl2, hr2, hl, hr;
+    rbt_split_roots(ctx->owner->augment, ctx->cmp, t2, h2, &t1->data, &l2, &hl2, &m, &r2, &hr2);
+
+    RBNode *l = rbt_intersection_roots(ctx, l1, hc1, l2, hl2, &hl);
+    RBNode *r = rbt_intersection_roots(ctx, r1, hc1, r2, hr2, &hr);
+    if (m) {
+        rbt_free_nodes(ctx, m);
+        return rbt_join_roots(ctx->owner->augment, l, hl, t1, r, hr, h);
+    }
+
+    t1->left = t1->right = NULL;
+    rbt_free_nodes(ctx, t1);
+    return rbt_join2_roots(ctx->owner->augment, l, hl, r, hr, h);
+}
+
+static RBNode *rbt_difference_roots(JoinCtx *ctx, RBNode *t1, uint32_t h1, RBNode *t2, uint32_t h2, uint32_t *h) {
+    if (!t1) {
+        rbt_free_nodes(ctx, t2);
+        *h = 0;
+        return NULL;
+    }
+    if (!t2) {
+        *h = h1;
+        return t1;
+    }
+
+    RBNode *l2 = t2->left;
+    RBNode *r2 = t2->right;
+    uint32_t hc2 = rbt_child_height(t2, h2);
+    RBNode *l1, *r1, *m = NULL;
+    uint32_t hl1, hr1, hl, hr;
+    rbt_split_roots(ctx->owner->augment, ctx->cmp, t1, h1, &t2->data, &l1, &hl1, &m, &r1, &hr1);
+
+    RBNode *l = rbt_difference_roots(ctx, l1, hl1, l2, hc2, &hl);
+    RBNode *r = rbt_difference_roots(ctx, r1, hr1, r2, hc2, &hr);
+    if (m) {
+        rbt_free_nodes(ctx, m);
+    }
+    t2->left = t2->right = NULL;
+    rbt_free_nodes(ctx, t2);
+
+    return rbt_join2_roots(ctx->owner->augment, l, hl, r, hr, h);
+}
+
+static uint32_t rbt_subtree_size(RBNode *node) {
+    uint32_t size = 0;
+    while (node) {
+        size += 1 + rbt_subtree_size(node->left);
+        node = node->right;
+    }
+    return size;
+}
+
+void rbt_join(RBTree *left, RBNode *pivot, RBTree *right) {
+    rbt_require_compatible(left, right, "rbt_join");
+
+    uint32_t h;
+    RBNode *root = rbt_join_roots(left->augment, left->root, rbt_black_height(left->root), pivot, right->root,
+                                  rbt_black_height(right->root), &h);
+    rbt_adopt_root(left, root, left->size + right->size + 1);
+    rbt_adopt_root(right, NULL, 0);
+}
+
+void rbt_split(RBTree *tree, Data *key, CMP *cmp, RBTree **lo, RBTree **hi) {
+    RBNode *l, *r;
+    uint32_t hl, hr;
+    rbt_split_roots(tree->augment, cmp, tree->root, rbt_black_height(tree->root), key, &l, &hl, NULL, &r, &hr);
+
+    *lo = rbt_rbtree_new_like(tree);
+    *hi = rbt_rbtree_new_like(tree);
+
+    /* 有子树计数时直接读取, 否则只能遍历 lo 一侧计数 */
+    uint32_t lo_size;
+    if (tree->augment == rbt_augment_count) {
+        lo_size = l ? l->count : 0;
+    } else {
+        lo_size = rbt_subtree_size(l);
+    }
+    rbt_adopt_root(*lo, l, lo_size);
+    rbt_adopt_root(*hi, r, tree->size - lo_size);
+    rbt_adopt_root(tree, NULL, 0);
+}
+
+void rbt_union(RBTree *a, RBTree *b, CMP *cmp) {
+    rbt_require_compatible(a, b, "rbt_union");
+
+    JoinCtx ctx = {a, cmp, 0};
+    uint32_t total = a->size + b->size;
+    uint32_t h;
+    RBNode *root = rbt_union_roots(&ctx, a->root, rbt_black_height(a->root), b->root, rbt_black_height(b->root), &h);
+    rbt_adopt_root(a, root, total - ctx.freed);
+    rbt_adopt_root(b, NULL, 0);
+}
+
+void rbt_intersection(RBTree *a, RBTree *b, CMP *cmp) {
+    rbt_require_compatible(a, b, "rbt_intersection");
+
+    JoinCtx ctx = {a, cmp, 0};
+    uint32_t total = a->size + b->size;
+    uint32_t h;
+    RBNode *root = rbt_intersection_roots(&ctx, a->root, rbt_black_height(a->root), b->root, rbt_black_height(b->root), &h);
+    rbt_adopt_root(a, root, total - ctx.freed);
+    rbt_adopt_root(b, NULL, 0);
+}
+
+void rbt_difference(RBTree *a, RBTree *b, CMP *cmp) {
+    rbt_require_compatible(a, b, "rbt_difference");
+
+    JoinCtx ctx = {a, cmp, 0};
+    uint32_t total = a->size + b->size;
+    uint32_t h;
+    RBNode *root = rbt_difference_roots(&ctx, a->root, rbt_black_height(a->root), b->root, rbt_black_height(b->root), &h);
+    rbt_adopt_root(a, root, total - ctx.freed);
+    rbt_adopt_root(b, NULL, 0);
+}
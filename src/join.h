@@ -0,0 +1,18 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include "rbtree.h"
+
+/*
+ * 基于 join 的拆分/合并与集合运算(Blelloch et al., Just Join for Parallel Ordered Sets).
+ * 参与运算的树需由同一配置创建(rbt_rbtree_new_like), 结点在树之间移动而不复制.
+ * 集合运算把结果留在 a 中, b 被清空但仍需调用者 rbt_delete_tree.
+ */
+void rbt_join(RBTree *left, RBNode *pivot, RBTree *right);                     // 要求 left < pivot <= right, O(log n)
+void rbt_split(RBTree *tree, Data *key, CMP *cmp, RBTree **lo, RBTree **hi);  // lo 小于 key, hi 不小于 key, tree 被清空; O(log n), 未维护子树计数时统计大小另需 O(n)
+
+void rbt_union(RBTree *a, RBTree *b, CMP *cmp);         // 重复的 key 保留 a 中的结点
+void rbt_intersection(RBTree *a, RBTree *b, CMP *cmp);
+void rbt_difference(RBTree *a, RBTree *b, CMP *cmp);    // a 中去掉 b 里出现的 key
+
+#endif
@@ -0,0 +1,88 @@
+#include "map.h"
+
+#include <stdlib.h>
+
+#include "utils.h"
+
+RBMap *rbt_map_new(RBEngine engine, uint32_t key_size, uint32_t node_hint, CMP *cmp) {
+    RBMap *map = malloc(sizeof(RBMap));
+    if (NULL == map) {
+        die("malloc new_map");
+    }
+
+    map->engine = engine;
+    map->cmp = cmp;
+    if (engine == RBT_ENGINE_BPLUS) {
+        map->bp = bp_tree_new(key_size, 0);
+    } else {
+        map->rb = rbt_rbtree_new_fixed(key_size, node_hint);
+    }
+
+    return map;
+}
+
+void rbt_map_free(RBMap *map) {
+    if (!map) return;
+
+    if (map->engine == RBT_ENGINE_BPLUS) {
+        bp_tree_free(map->bp);
+    } else {
+        rbt_delete_tree(map->rb);
+    }
+    free(map);
+}
+
+bool rbt_map_upsert(RBMap *map, Data *data) {
+    if (map->engine == RBT_ENGINE_BPLUS) {
+        return bp_upsert(map->bp, data, map->cmp);
+    }
+
+    bool inserted;
+    rbt_upsert(map->rb, data, map->cmp, &inserted);
+    return inserted;
+}
+
+bool rbt_map_search(RBMap *map, Data *data, Data *out) {
+    if (map->engine == RBT_ENGINE_BPLUS) {
+        return bp_search(map->bp, data, map->cmp, out);
+    }
+
+    RBNode *node = rbt_search_node(map->rb, data, map->cmp);
+    if (node && out) *out = node->data;
+    return node != NULL;
+}
+
+bool rbt_map_delete(RBMap *map, Data *data) {
+    if (map->engine == RBT_ENGINE_BPLUS) {
+        return bp_delete(map->bp, data, map->cmp);
+    }
+
+    RBNode *node = rbt_search_node(map->rb, data, map->cmp);
+    if (node) {
+        rbt_erase_node(map->rb, node);
+    }
+    return node != NULL;
+}
+
+typedef struct RBMapScan {
+    DSCAN *scan;
+    void *arg;
+} RBMapScan;
+
+static int rbt_map_scan_node(RBNode *node, void *arg) {
+    RBMapScan *ms = arg;
+    return ms->scan(&node->data, ms->arg);
+}
+
+size_t rbt_map_scan(RBMap *map, Data *lo, Data *hi, DSCAN *scan, void *arg) {
+    if (map->engine == RBT_ENGINE_BPLUS) {
+        return bp_range_scan(map->bp, lo, hi, map->cmp, scan, arg);
+    }
+
+    RBMapScan ms = {scan, arg};
+    return rbt_range_scan(map->rb, lo, hi, map->cmp, rbt_map_scan_node, &ms);
+}
+
+uint32_t rbt_map_size(RBMap *map) {
+    return map->engine == RBT_ENGINE_BPLUS ? map->bp->size : map->rb->size;
+}
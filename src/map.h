@@ -0,0 +1,38 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bptree.h"
+#include "rbtree.h"
+
+/*
+ * 有序映射: 创建时选择红黑树或 B+ 树引擎, 之后用同一组接口操作.
+ * key 定长且唯一, 重复插入时替换.
+ */
+typedef enum RBEngine {
+    RBT_ENGINE_RB,
+    RBT_ENGINE_BPLUS
+} RBEngine;
+
+typedef struct RBMap {
+    RBEngine engine;
+    CMP *cmp;
+    union {
+        RBTree *rb;
+        BPTree *bp;
+    };
+} RBMap;
+
+RBMap *rbt_map_new(RBEngine engine, uint32_t key_size, uint32_t node_hint, CMP *cmp);  // node_hint 仅红黑树使用
+void rbt_map_free(RBMap *map);
+
+bool rbt_map_upsert(RBMap *map, Data *data);  // 返回是否新插入
+bool rbt_map_search(RBMap *map, Data *data, Data *out);  // out 指向引擎内部的 key, 下次修改前有效
+bool rbt_map_delete(RBMap *map, Data *data);
+size_t rbt_map_scan(RBMap *map, Data *lo, Data *hi, DSCAN *scan, void *arg);  // 闭区间, 为空表示不设界, 即中序遍历
+uint32_t rbt_map_size(RBMap *map);
+
+#endif
@@ -0,0 +1,289 @@
+#include "mapped.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define RBT_FILE_MAX_DEPTH 128  // 红黑树高度不超过 2log2(n+1), 超过说明文件已损坏
+
+static uint64_t rbt_fnv1a(uint64_t hash, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#define RBT_FILE_KEY_ALIGN(len) (((uint64_t)(len) + 7) & ~(uint64_t)7)
+
+static uint64_t rbt_key_bytes(RBNode *node) {
+    uint64_t total = 0;
+    while (node) {
+        total += rbt_key_bytes(node->left) + RBT_FILE_KEY_ALIGN(node->data.buffer_type);
+        node = node->right;
+    }
+    return total;
+}
+
+static int rbt_write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int rbt_save(RBTree *tree, const char *path) {
+    return rbt_save_at(tree, path, 0);
+}
+
+/* fsync path 所在的目录, 使其中的 rename 落盘 */
+static int rbt_sync_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *dir;
+    if (!slash) {
+        dir = strdup(".");
+    } else {
+        size_t len = slash == path ? 1 : (size_t)(slash - path);
+        dir = strndup(path, len);
+    }
+    if (NULL == dir) {
+        die("malloc rbt_save dir");
+    }
+
+    int ret = -1;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ret = fsync(fd);
+        close(fd);
+    }
+    free(dir);
+    return ret;
+}
+
+int rbt_save_at(RBTree *tree, const char *path, uint64_t lsn) {
+    uint32_t count = tree->size;
+    uint32_t stride = sizeof(RBFileNode);
+    uint64_t nodes_size = (uint64_t)count * stride;
+    uint64_t key_bytes = rbt_key_bytes(tree->root);
+
+    /* 层序编号: order[i] 为下标 i 的结点, 孩子在入队时取得下标 */
+    RBNode **order = malloc(sizeof(RBNode *) * (count ? count : 1));
+    unsigned char *body = calloc(1, nodes_size + key_bytes + 1);
+    if (NULL == order || NULL == body) {
+        die("malloc rbt_save");
+    }
+    unsigned char *keys = body + nodes_size;
+
+    uint32_t tail = 0;
+    uint64_t key_off = 0;
+    if (tree->root) order[tail++] = tree->root;
+    for (uint32_t i = 0; i < tail; i++) {
+        RBNode *node = order[i];
+        RBFileNode *out = (RBFileNode *)(body + (size_t)i * stride);
+
+        out->left = out->right = RBT_FILE_NIL;
+        if (node->left) {
+            out->left = tail;
+            order[tail++] = node->left;
+        }
+        if (node->right) {
+            out->right = tail;
+            order[tail++] = node->right;
+        }
+        out->key_len = node->data.buffer_type;
+        out->key_off = key_off;
+        memcpy(keys + key_off, node->data.buffer, node->data.buffer_type);
+        key_off += RBT_FILE_KEY_ALIGN(node->data.buffer_type);
+    }
+
+    RBFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RBT_FILE_MAGIC, sizeof(RBT_FILE_MAGIC));
+    header.version = RBT_FILE_VERSION;
+    header.endian = RBT_FILE_ENDIAN;
+    header.count = tail;
+    header.root = tail ? 0 : RBT_FILE_NIL;
+    header.stride = stride;
+    header.key_size = tree->key_size;
+    header.body_size = nodes_size + key_bytes;
+    header.checksum = rbt_fnv1a(0xcbf29ce484222325ULL, body, header.body_size);
+    header.lsn = lsn;
+    header.key_bytes = key_bytes;
+    free(order);
+
+    size_t len = strlen(path);
+    char *tmp = malloc(len + 5);
+    if (NULL == tmp) {
+        die("malloc rbt_save path");
+    }
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    int ret = -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (rbt_write_all(fd, &header, sizeof(header)) == 0 &&
+            rbt_write_all(fd, body, header.body_size) == 0 &&
+            fsync(fd) == 0) {
+            ret = 0;
+        }
+        if (close(fd) != 0) ret = -1;
+        if (ret == 0) ret = rename(tmp, path);
+        if (ret == 0) {
+            ret = rbt_sync_dir(path);
+        } else {
+            int saved = errno;
+            unlink(tmp);
+            errno = saved;
+        }
+    }
+
+    free(tmp);
+    free(body);
+    return ret;
+}
+
+RBMapped *rbt_open_mapped(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RBFileHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    const RBFileHeader *header = base;
+    if (memcmp(header->magic, RBT_FILE_MAGIC, sizeof(RBT_FILE_MAGIC)) != 0 ||
+        header->version != RBT_FILE_VERSION ||
+        header->endian != RBT_FILE_ENDIAN ||
+        header->stride != sizeof(RBFileNode) ||
+        header->body_size != (uint64_t)header->count * header->stride + header->key_bytes ||
+        header->body_size != (uint64_t)st.st_size - sizeof(RBFileHeader) ||
+        (header->root != RBT_FILE_NIL && header->root >= header->count)) {
+        munmap(base, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    RBMapped *mapped = malloc(sizeof(RBMapped));
+    if (NULL == mapped) {
+        die("malloc new_mapped");
+    }
+    mapped->base = base;
+    mapped->length = st.st_size;
+    mapped->header = header;
+    mapped->nodes = (const unsigned char *)base + sizeof(RBFileHeader);
+    mapped->keys = mapped->nodes + (size_t)header->count * header->stride;
+
+    return mapped;
+}
+
+bool rbt_mapped_verify(RBMapped *mapped) {
+    const RBFileHeader *header = mapped->header;
+    return rbt_fnv1a(0xcbf29ce484222325ULL, mapped->nodes, header->body_size) == header->checksum;
+}
+
+void rbt_mapped_close(RBMapped *mapped) {
+    if (mapped) {
+        munmap(mapped->base, mapped->length);
+        free(mapped);
+    }
+}
+
+uint32_t rbt_mapped_size(RBMapped *mapped) {
+    return mapped->header->count;
+}
+
+/* 越界下标和超出 key 区的 key 都按空结点处理, 损坏的文件不会导致越界访问 */
+static const RBFileNode *rbt_mapped_node(RBMapped *mapped, uint32_t index, Data *data) {
+    const RBFileHeader *header = mapped->header;
+    if (index >= header->count) return NULL;
+
+    const RBFileNode *node = (const RBFileNode *)(mapped->nodes + (size_t)index * header->stride);
+    if (node->key_off > header->key_bytes || node->key_len > header->key_bytes - node->key_off) return NULL;
+
+    data->buffer = (void *)(mapped->keys + node->key_off);
+    data->buffer_type = node->key_len;
+    return node;
+}
+
+bool rbt_mapped_search(RBMapped *mapped, Data *data, CMP *cmp, Data *out) {
+    Data key;
+    uint32_t index = mapped->header->root;
+    const RBFileNode *node;
+
+    for (int depth = 0; depth < RBT_FILE_MAX_DEPTH && (node = rbt_mapped_node(mapped, index, &key)); depth++) {
+        int ret = cmp(data, &key);
+        if (ret < 0) {
+            index = node->left;
+        } else if (ret > 0) {
+            index = node->right;
+        } else {
+            if (out) *out = key;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t rbt_mapped_scan(RBMapped *mapped, Data *lo, Data *hi, CMP *cmp, DSCAN *scan, void *arg) {
+    uint32_t stack[RBT_FILE_MAX_DEPTH];
+    int top = 0;
+    size_t count = 0, steps = 0;
+    uint32_t index = mapped->header->root;
+    Data key;
+    const RBFileNode *node;
+
+    /* 显式栈中序遍历, 小于 lo 的左子树和大于 hi 的右子树不入栈; 每个结点至多进入一次, 可借此识别成环的文件 */
+    while (1) {
+        while ((node = rbt_mapped_node(mapped, index, &key)) && top < RBT_FILE_MAX_DEPTH &&
+               ++steps <= mapped->header->count) {
+            if (lo && cmp(&key, lo) < 0) {
+                index = node->right;
+                continue;
+            }
+            stack[top++] = index;
+            index = node->left;
+        }
+        if (top == 0) break;
+
+        node = rbt_mapped_node(mapped, stack[--top], &key);
+        if (hi && cmp(&key, hi) > 0) break;
+
+        count++;
+        if (scan(&key, arg)) break;
+        index = node->right;
+    }
+
+    return count;
+}
+
+static int rbt_mapped_print(Data *data, void *arg) {
+    ((PRI *)arg)(data);
+    return 0;
+}
+
+void rbt_mapped_inorder(RBMapped *mapped, PRI *pri) {
+    rbt_mapped_scan(mapped, NULL, NULL, NULL, rbt_mapped_print, (void *)pri);
+}
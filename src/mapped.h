@@ -0,0 +1,63 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 可直接 mmap 的快照文件:
+ *   [RBFileHeader][结点数组][key 区]
+ * 结点按层序排列(上层集中在前几页), 每个结点定长 RBFileNode, 只存孩子下标和 key 在 key 区中的位置;
+ * key 依次紧排在 key 区, 各自按 8 对齐, 长短不一的 key 不会把每条记录都撑到最长.
+ * 孩子以下标表示, RBT_FILE_NIL 为空. 数据按本机字节序写入, 打开时校验.
+ */
+#define RBT_FILE_MAGIC "RBTSNAP"
+#define RBT_FILE_VERSION 2
+#define RBT_FILE_ENDIAN 0x01020304u
+#define RBT_FILE_NIL UINT32_MAX
+
+typedef struct RBFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t count;     // 结点数
+    uint32_t root;      // 根结点下标
+    uint32_t stride;    // 每个结点占用的字节数, 即 sizeof(RBFileNode)
+    uint32_t key_size;  // 原树的 key_size, 0 表示变长
+    uint64_t body_size; // 结点数组加 key 区
+    uint64_t checksum;  // 结点数组和 key 区的 FNV-1a 64
+    uint64_t lsn;       // 快照包含的最后一条日志记录, 不配合日志使用时为 0
+    uint64_t key_bytes; // key 区的字节数
+} RBFileHeader;
+
+typedef struct RBFileNode {
+    uint32_t left;
+    uint32_t right;
+    uint32_t key_len;
+    uint32_t reserved;
+    uint64_t key_off;  // 在 key 区中的偏移
+} RBFileNode;
+
+typedef struct RBMapped {
+    void *base;
+    size_t length;
+    const RBFileHeader *header;
+    const unsigned char *nodes;
+    const unsigned char *keys;
+} RBMapped;
+
+int rbt_save(RBTree *tree, const char *path);  // 先写临时文件再 rename 并 fsync 目录, 失败返回 -1 并保留 errno
+int rbt_save_at(RBTree *tree, const char *path, uint64_t lsn);
+RBMapped *rbt_open_mapped(const char *path);   // 只校验头部和长度, 失败返回 NULL
+bool rbt_mapped_verify(RBMapped *mapped);      // 校验整个结点数组, 会读入所有页
+void rbt_mapped_close(RBMapped *mapped);
+
+uint32_t rbt_mapped_size(RBMapped *mapped);
+bool rbt_mapped_search(RBMapped *mapped, Data *data, CMP *cmp, Data *out);  // out 指向映射中的 key
+size_t rbt_mapped_scan(RBMapped *mapped, Data *lo, Data *hi, CMP *cmp, DSCAN *scan, void *arg);  // 闭区间, 为空表示不设界
+void rbt_mapped_inorder(RBMapped *mapped, PRI *pri);
+
+#endif
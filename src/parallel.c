@@ -0,0 +1,213 @@
+#include "parallel.h"
+
+#include <stdlib.h>
+
+typedef struct ParCtx {
+    ThreadPool *pool;
+    RBTree *tree;
+    uint32_t spawn_depth;  // 超过该深度的子树串行处理
+    Data *items;
+    uint32_t red_depth;
+    MAP *map;
+    COMBINE *combine;
+    int64_t identity;
+    void *arg;
+    PRI_NODE *pri_node;
+} ParCtx;
+
+typedef struct ParJob {
+    ParCtx *ctx;
+    RBNode *node;
+    size_t lo;
+    size_t hi;
+    uint32_t depth;
+    int64_t result;
+    RBNode *built;
+} ParJob;
+
+/* 平衡树第 depth 层的子树约有 size >> depth 个结点 */
+static uint32_t rbt_par_spawn_depth(uint32_t size) {
+    uint32_t depth = 0;
+    while ((size >> depth) >= 2 * RBT_PAR_CUTOFF) depth++;
+    return depth;
+}
+
+static void rbt_par_fork(ParCtx *ctx, TPTask *task, void (*fn)(void *), ParJob *job) {
+    task->fn = fn;
+    task->arg = job;
+    tpool_spawn(ctx->pool, task);
+}
+
+static void rbt_par_build_job(void *arg) {
+    ParJob *job = arg;
+    ParCtx *ctx = job->ctx;
+
+    if (job->hi - job->lo < RBT_PAR_CUTOFF) {
+        job->built = rbt_build_range(ctx->tree, ctx->items, NULL, job->lo, job->hi, job->depth, ctx->red_depth);
+        return;
+    }
+
+    size_t mid = job->lo + (job->hi - job->lo) / 2;
+    ParJob left = {ctx, NULL, job->lo, mid, job->depth + 1, 0, NULL};
+    ParJob right = {ctx, NULL, mid + 1, job->hi, job->depth + 1, 0, NULL};
+    TPTask task;
+
+    rbt_par_fork(ctx, &task, rbt_par_build_job, &left);
+    rbt_par_build_job(&right);
+    RBNode *node = rbt_tree_node_new(ctx->tree, &ctx->items[mid]);
+    tpool_wait(ctx->pool, &task);
+
+    node->color = job->depth == ctx->red_depth ? RED : BLACK;
+    node->left = left.built;
+    node->right = right.built;
+    node->left->parent = node;
+    node->right->parent = node;
+    if (ctx->tree->augment) ctx->tree->augment(node);
+    job->built = node;
+}
+
+void rbt_par_build_sorted(ThreadPool *pool, RBTree *tree, Data *items, size_t n, CMP *cmp) {
+    /* 池分配器不是线程安全的; 非空树需要逐个插入 */
+    if (tree->pool || tree->root || n < RBT_PAR_CUTOFF) {
+        rbt_build_sorted(tree, items, n, cmp);
+        return;
+    }
+
+    ParCtx ctx = {.pool = pool, .tree = tree, .items = items, .red_depth = rbt_build_red_depth(n)};
+    ParJob job = {&ctx, NULL, 0, n, 0, 0, NULL};
+    tpool_run(pool, rbt_par_build_job, &job);
+
+    rbt_adopt_root(tree, job.built, n);
+}
+
+static int64_t rbt_seq_reduce(ParCtx *ctx, RBNode *node) {
+    if (!node) return ctx->identity;
+
+    int64_t left = rbt_seq_reduce(ctx, node->left);
+    int64_t mid = ctx->map(node, ctx->arg);
+    int64_t right = rbt_seq_reduce(ctx, node->right);
+    return ctx->combine(ctx->combine(left, mid), right);
+}
+
+static void rbt_par_reduce_job(void *arg) {
+    ParJob *job = arg;
+    ParCtx *ctx = job->ctx;
+    RBNode *node = job->node;
+
+    if (!node || job->depth >= ctx->spawn_depth) {
+        job->result = rbt_seq_reduce(ctx, node);
+        return;
+    }
+
+    ParJob left = {.ctx = ctx, .node = node->left, .depth = job->depth + 1};
+    ParJob right = {.ctx = ctx, .node = node->right, .depth = job->depth + 1};
+    TPTask task;
+
+    rbt_par_fork(ctx, &task, rbt_par_reduce_job, &left);
+    rbt_par_reduce_job(&right);
+    int64_t mid = ctx->map(node, ctx->arg);
+    tpool_wait(ctx->pool, &task);
+
+    job->result = ctx->combine(ctx->combine(left.result, mid), right.result);
+}
+
+int64_t rbt_par_reduce(ThreadPool *pool, RBTree *tree, MAP *map, COMBINE *combine, int64_t identity, void *arg) {
+    ParCtx ctx = {.pool = pool, .tree = tree, .spawn_depth = rbt_par_spawn_depth(tree->size),
+                  .map = map, .combine = combine, .identity = identity, .arg = arg};
+    ParJob job = {.ctx = &ctx, .node = tree->root};
+    tpool_run(pool, rbt_par_reduce_job, &job);
+
+    return job.result;
+}
+
+static void rbt_par_for_each_job(void *arg) {
+    ParJob *job = arg;
+    ParCtx *ctx = job->ctx;
+    RBNode *node = job->node;
+
+    if (!node || job->depth >= ctx->spawn_depth) {
+        rbt_inorder_traversal(node, ctx->pri_node);
+        return;
+    }
+
+    ParJob left = {.ctx = ctx, .node = node->left, .depth = job->depth + 1};
+    ParJob right = {.ctx = ctx, .node = node->right, .depth = job->depth + 1};
+    TPTask task;
+
+    rbt_par_fork(ctx, &task, rbt_par_for_each_job, &left);
+    ctx->pri_node(node);
+    rbt_par_for_each_job(&right);
+    tpool_wait(ctx->pool, &task);
+}
+
+void rbt_par_for_each(ThreadPool *pool, RBTree *tree, PRI_NODE *pri_node) {
+    ParCtx ctx = {.pool = pool, .tree = tree, .spawn_depth = rbt_par_spawn_depth(tree->size), .pri_node = pri_node};
+    ParJob job = {.ctx = &ctx, .node = tree->root};
+    tpool_run(pool, rbt_par_for_each_job, &job);
+}
+
+static void rbt_par_depth_job(void *arg) {
+    ParJob *job = arg;
+    ParCtx *ctx = job->ctx;
+    RBNode *node = job->node;
+
+    if (!node || job->depth >= ctx->spawn_depth) {
+        job->result = rbt_depth(node);
+        return;
+    }
+
+    ParJob left = {.ctx = ctx, .node = node->left, .depth = job->depth + 1};
+    ParJob right = {.ctx = ctx, .node = node->right, .depth = job->depth + 1};
+    TPTask task;
+
+    rbt_par_fork(ctx, &task, rbt_par_depth_job, &left);
+    rbt_par_depth_job(&right);
+    tpool_wait(ctx->pool, &task);
+
+    job->result = (left.result > right.result ? left.result : right.result) + 1;
+}
+
+uint32_t rbt_par_depth(ThreadPool *pool, RBTree *tree) {
+    ParCtx ctx = {.pool = pool, .tree = tree, .spawn_depth = rbt_par_spawn_depth(tree->size)};
+    ParJob job = {.ctx = &ctx, .node = tree->root};
+    tpool_run(pool, rbt_par_depth_job, &job);
+
+    return (uint32_t)job.result;
+}
+
+static void rbt_par_destroy_job(void *arg) {
+    ParJob *job = arg;
+    ParCtx *ctx = job->ctx;
+    RBNode *node = job->node;
+
+    if (!node || job->depth >= ctx->spawn_depth) {
+        rbt_delete_node(node);
+        return;
+    }
+
+    ParJob left = {.ctx = ctx, .node = node->left, .depth = job->depth + 1};
+    ParJob right = {.ctx = ctx, .node = node->right, .depth = job->depth + 1};
+    TPTask task;
+
+    rbt_par_fork(ctx, &task, rbt_par_destroy_job, &left);
+    rbt_par_destroy_job(&right);
+    tpool_wait(ctx->pool, &task);
+    rbt_free_rbnode(node);
+}
+
+void rbt_par_destroy(ThreadPool *pool, RBTree *tree) {
+    if (!tree) return;
+
+    /* 池化树本身就是整块释放 */
+    if (tree->pool) {
+        rbt_delete_tree(tree);
+        return;
+    }
+
+    ParCtx ctx = {.pool = pool, .tree = tree, .spawn_depth = rbt_par_spawn_depth(tree->size)};
+    ParJob job = {.ctx = &ctx, .node = tree->root};
+    tpool_run(pool, rbt_par_destroy_job, &job);
+
+    tree->root = NULL;
+    rbt_delete_tree(tree);
+}
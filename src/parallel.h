@@ -0,0 +1,22 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+#include "thpool.h"
+
+#define RBT_PAR_CUTOFF 4096  // 子问题规模小于该值时串行执行
+
+typedef int64_t(MAP)(RBNode *node, void *arg);
+typedef int64_t(COMBINE)(int64_t x, int64_t y);  // 需满足结合律, 按中序 左 -> 结点 -> 右 合并
+
+/* 左右子树作为独立任务并行处理; 回调需线程安全 */
+void rbt_par_build_sorted(ThreadPool *pool, RBTree *tree, Data *items, size_t n, CMP *cmp);  // 池化树退化为串行
+int64_t rbt_par_reduce(ThreadPool *pool, RBTree *tree, MAP *map, COMBINE *combine, int64_t identity, void *arg);
+void rbt_par_for_each(ThreadPool *pool, RBTree *tree, PRI_NODE *pri_node);  // 访问顺序不确定
+uint32_t rbt_par_depth(ThreadPool *pool, RBTree *tree);
+void rbt_par_destroy(ThreadPool *pool, RBTree *tree);
+
+#endif
@@ -0,0 +1,280 @@
+#include "persist.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+/* 约定: 参数中的结点都是借用的, 返回的结点由调用者持有一个引用 */
+
+static PNode *pn_ref(PNode *node) {
+    if (node) {
+        __atomic_add_fetch(&node->refs, 1, __ATOMIC_RELAXED);
+    }
+    return node;
+}
+
+static void pn_release(PNode *node) {
+    while (node && __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        PNode *right = node->right;
+        pn_release(node->left);
+        free(node);
+        node = right;
+    }
+}
+
+static Color pn_color(PNode *node) {
+    return node ? node->color : BLACK;
+}
+
+static uint32_t pn_bh(PNode *node) {
+    return node ? node->bh : 0;
+}
+
+static PNode *pn_new(PNode *left, Data *data, PNode *right, Color color) {
+    PNode *node = malloc(sizeof(PNode) + data->buffer_type);
+    if (NULL == node) {
+        die("malloc new_pnode");
+    }
+
+    node->left = pn_ref(left);
+    node->right = pn_ref(right);
+    node->refs = 1;
+    node->color = color;
+    node->bh = pn_bh(left) + (color == BLACK);
+    node->data.buffer = node->key;
+    node->data.buffer_type = data->buffer_type;
+    memcpy(node->key, data->buffer, data->buffer_type);
+
+    return node;
+}
+
+/* 红根换成黑色副本; 共享的结点不能原地改色 */
+static PNode *pn_blacken(PNode *node) {
+    if (pn_color(node) == RED) {
+        return pn_new(node->left, &node->data, node->right, BLACK);
+    }
+    return pn_ref(node);
+}
+
+/* bh(tl) > bh(tr), tr 的根为黑: 沿 tl 的右脊下降, 在黑高相同处挂上 k */
+static PNode *pn_join_right(PNode *tl, Data *k, PNode *tr) {
+    if (pn_color(tl) == BLACK && pn_bh(tl) == pn_bh(tr)) {
+        return pn_new(tl, k, tr, RED);
+    }
+
+    PNode *r = pn_join_right(tl->right, k, tr);
+    PNode *t = pn_new(tl->left, &tl->data, r, tl->color);
+    pn_release(r);
+
+    /* 连续两个红结点: 把下面的染黑并左旋 */
+    if (tl->color == BLACK && pn_color(r) == RED && pn_color(r->right) == RED) {
+        PNode *rr = pn_new(r->right->left, &r->right->data, r->right->right, BLACK);
+        PNode *left = pn_new(t->left, &t->data, r->left, t->color);
+        PNode *res = pn_new(left, &r->data, rr, r->color);
+        pn_release(left);
+        pn_release(rr);
+        pn_release(t);
+        return res;
+    }
+    return t;
+}
+
+static PNode *pn_join_left(PNode *tl, Data *k, PNode *tr) {
+    if (pn_color(tr) == BLACK && pn_bh(tr) == pn_bh(tl)) {
+        return pn_new(tl, k, tr, RED);
+    }
+
+    PNode *l = pn_join_left(tl, k, tr->left);
+    PNode *t = pn_new(l, &tr->data, tr->right, tr->color);
+    pn_release(l);
+
+    if (tr->color == BLACK && pn_color(l) == RED && pn_color(l->left) == RED) {
+        PNode *ll = pn_new(l->left->left, &l->left->data, l->left->right, BLACK);
+        PNode *right = pn_new(l->right, &t->data, t->right, t->color);
+        PNode *res = pn_new(ll, &l->data, right, l->color);
+        pn_release(right);
+        pn_release(ll);
+        pn_release(t);
+        return res;
+    }
+    return t;
+}
+
+static PNode *pn_join(PNode *tl, Data *k, PNode *tr) {
+    PNode *l = pn_blacken(tl);
+    PNode *r = pn_blacken(tr);
+    PNode *t;
+
+    if (pn_bh(l) > pn_bh(r)) {
+        t = pn_join_right(l, k, r);
+        if (t->color == RED && pn_color(t->right) == RED) {
+            PNode *black = pn_new(t->left, &t->data, t->right, BLACK);
+            pn_release(t);
+            t = black;
+        }
+    } else if (pn_bh(l) < pn_bh(r)) {
+        t = pn_join_left(l, k, r);
+        if (t->color == RED && pn_color(t->left) == RED) {
+            PNode *black = pn_new(t->left, &t->data, t->right, BLACK);
+            pn_release(t);
+            t = black;
+        }
+    } else {
+        t = pn_new(l, k, r, RED);
+    }
+
+    pn_release(l);
+    pn_release(r);
+    return t;
+}
+
+/* *lo 小于 key, *hi 大于 key, 相等的结点通过 *eq 返回 */
+static void pn_split(CMP *cmp, PNode *t, Data *key, PNode **lo, PNode **eq, PNode **hi) {
+    if (!t) {
+        *lo = *hi = NULL;
+        return;
+    }
+
+    int ret = cmp(key, &t->data);
+    PNode *mid;
+    if (ret == 0) {
+        *lo = pn_ref(t->left);
+        *hi = pn_ref(t->right);
+        *eq = pn_ref(t);
+    } else if (ret < 0) {
+        pn_split(cmp, t->left, key, lo, eq, &mid);
+        *hi = pn_join(mid, &t->data, t->right);
+        pn_release(mid);
+    } else {
+        pn_split(cmp, t->right, key, &mid, eq, hi);
+        *lo = pn_join(t->left, &t->data, mid);
+        pn_release(mid);
+    }
+}
+
+static PNode *pn_split_last(PNode *t, PNode **last) {
+    if (!t->right) {
+        *last = pn_ref(t);
+        return pn_ref(t->left);
+    }
+
+    PNode *rest = pn_split_last(t->right, last);
+    PNode *res = pn_join(t->left, &t->data, rest);
+    pn_release(rest);
+    return res;
+}
+
+static PNode *pn_join2(PNode *l, PNode *r) {
+    if (!l) return pn_ref(r);
+    if (!r) return pn_ref(l);
+
+    PNode *last;
+    PNode *rest = pn_split_last(l, &last);
+    PNode *res = pn_join(rest, &last->data, r);
+    pn_release(rest);
+    pn_release(last);
+    return res;
+}
+
+/* 换上新根并释放旧根, 只被旧版本引用的结点随之释放 */
+static void rbt_persist_set_root(RBPTree *tree, PNode *root) {
+    PNode *old = tree->root;
+    tree->root = pn_blacken(root);
+    pn_release(root);
+    pn_release(old);
+}
+
+RBPTree *rbt_persist_new(CMP *cmp) {
+    RBPTree *new_tree = malloc(sizeof(RBPTree));
+    if (NULL == new_tree) {
+        die("malloc new_ptree");
+    }
+
+    new_tree->root = NULL;
+    new_tree->size = 0;
+    new_tree->cmp = cmp;
+
+    return new_tree;
+}
+
+void rbt_persist_insert(RBPTree *tree, Data *data) {
+    PNode *lo, *hi, *eq = NULL;
+    pn_split(tree->cmp, tree->root, data, &lo, &eq, &hi);
+
+    rbt_persist_set_root(tree, pn_join(lo, data, hi));
+    if (eq) {
+        pn_release(eq);
+    } else {
+        tree->size++;
+    }
+    pn_release(lo);
+    pn_release(hi);
+}
+
+bool rbt_persist_delete(RBPTree *tree, Data *data) {
+    PNode *lo, *hi, *eq = NULL;
+    pn_split(tree->cmp, tree->root, data, &lo, &eq, &hi);
+
+    if (eq) {
+        rbt_persist_set_root(tree, pn_join2(lo, hi));
+        pn_release(eq);
+        tree->size--;
+    }
+    pn_release(lo);
+    pn_release(hi);
+
+    return eq != NULL;
+}
+
+Data *rbt_persist_search(RBPTree *tree, Data *data) {
+    PNode *p = tree->root;
+    while (p) {
+        int ret = tree->cmp(data, &p->data);
+        if (ret < 0) {
+            p = p->left;
+        } else if (ret > 0) {
+            p = p->right;
+        } else {
+            return &p->data;
+        }
+    }
+    return NULL;
+}
+
+static int pn_scan(RBPTree *tree, PNode *node, Data *lo, Data *hi, DSCAN *scan, void *arg, size_t *count) {
+    while (node) {
+        int above_lo = !lo || tree->cmp(&node->data, lo) >= 0;
+        int below_hi = !hi || tree->cmp(&node->data, hi) <= 0;
+
+        if (above_lo && pn_scan(tree, node->left, lo, hi, scan, arg, count)) return 1;
+        if (above_lo && below_hi) {
+            (*count)++;
+            if (scan(&node->data, arg)) return 1;
+        }
+        if (!below_hi) return 0;
+        node = node->right;
+    }
+    return 0;
+}
+
+size_t rbt_persist_scan(RBPTree *tree, Data *lo, Data *hi, DSCAN *scan, void *arg) {
+    size_t count = 0;
+    pn_scan(tree, tree->root, lo, hi, scan, arg, &count);
+    return count;
+}
+
+RBPTree *rbt_snapshot(RBPTree *tree) {
+    RBPTree *snap = rbt_persist_new(tree->cmp);
+    snap->root = pn_ref(tree->root);
+    snap->size = tree->size;
+
+    return snap;
+}
+
+void rbt_snapshot_release(RBPTree *snap) {
+    if (snap) {
+        pn_release(snap->root);
+        free(snap);
+    }
+}
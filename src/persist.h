@@ -0,0 +1,41 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 持久化(路径复制)红黑树: 结点一经创建便不再修改, 由引用计数共享.
+ * 插入/删除基于 split + join, 只复制根路径上 O(log n) 个结点;
+ * 快照只是多持有一次根结点的引用, O(1) 获取, 释放前始终看到获取时的内容.
+ * 同一棵树的写入需由调用者串行, 快照可在任意线程读取和释放.
+ */
+typedef struct PNode {
+    struct PNode *left;
+    struct PNode *right;
+    uint32_t refs;
+    Color color;
+    uint32_t bh;  // 黑高(含自身), 结点不可变所以可以缓存
+    Data data;
+    unsigned char key[];
+} PNode;
+
+typedef struct RBPTree {
+    PNode *root;
+    uint32_t size;
+    CMP *cmp;
+} RBPTree;
+
+RBPTree *rbt_persist_new(CMP *cmp);
+void rbt_persist_insert(RBPTree *tree, Data *data);  // 已存在相等的 key 时替换
+bool rbt_persist_delete(RBPTree *tree, Data *data);
+Data *rbt_persist_search(RBPTree *tree, Data *data);  // 返回的数据在该树/快照下次修改或释放前有效
+size_t rbt_persist_scan(RBPTree *tree, Data *lo, Data *hi, DSCAN *scan, void *arg);
+
+RBPTree *rbt_snapshot(RBPTree *tree);     // O(1)
+void rbt_snapshot_release(RBPTree *snap);  // 也用于释放树本身
+
+#endif
@@ -0,0 +1,113 @@
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "utils.h"
+
+#define POOL_CLASS(size) (((size) - 1) / POOL_ALIGN)
+
+Pool *pool_new(uint32_t block_size) {
+    Pool *new_pool = malloc(sizeof(Pool));
+    if (NULL == new_pool) {
+        die("malloc new_pool");
+    }
+
+    memset(new_pool, 0, sizeof(Pool));
+    new_pool->block_size = block_size < POOL_MIN_BLOCK ? POOL_MIN_BLOCK : block_size;
+    new_pool->refs = 1;
+
+    return new_pool;
+}
+
+/* 申请新块, 块头之后的区域按 POOL_ALIGN 对齐 */
+static void pool_grow(Pool *pool) {
+    PoolBlock *block = malloc(pool->block_size);
+    if (NULL == block) {
+        die("malloc pool block");
+    }
+    pool->sys_allocs++;
+    RBT_STAT_INC(mallocs);
+
+    block->next = pool->blocks;
+    pool->blocks = block;
+    pool->cursor = (char *)block + POOL_ALIGN;
+    pool->limit = (char *)block + pool->block_size;
+}
+
+void *pool_alloc(Pool *pool, uint32_t size) {
+    if (size == 0) size = 1;
+    pool->allocs++;
+
+    if (size > POOL_MAX_CHUNK) {
+        void *ptr = malloc(size);
+        if (NULL == ptr) {
+            die("malloc pool big chunk");
+        }
+        pool->sys_allocs++;
+        pool->big_live++;
+        RBT_STAT_INC(mallocs);
+        return ptr;
+    }
+
+    uint32_t cls = POOL_CLASS(size);
+    void *ptr = pool->free_list[cls];
+    if (ptr) {
+        pool->free_list[cls] = *(void **)ptr;
+        return ptr;
+    }
+
+    uint32_t chunk = (cls + 1) * POOL_ALIGN;
+    if (!pool->cursor || pool->cursor + chunk > pool->limit) {
+        pool_grow(pool);
+    }
+    ptr = pool->cursor;
+    pool->cursor += chunk;
+
+    return ptr;
+}
+
+void pool_free(Pool *pool, void *ptr, uint32_t size) {
+    if (!pool || !ptr) return;
+    if (size == 0) size = 1;
+    pool->frees++;
+
+    if (size > POOL_MAX_CHUNK) {
+        free(ptr);
+        pool->sys_frees++;
+        pool->big_live--;
+        RBT_STAT_INC(frees);
+        return;
+    }
+
+    uint32_t cls = POOL_CLASS(size);
+    *(void **)ptr = pool->free_list[cls];
+    pool->free_list[cls] = ptr;
+}
+
+void pool_stats(Pool *pool, PoolStats *out) {
+    memset(out, 0, sizeof(PoolStats));
+    if (!pool) return;
+
+    out->allocs = pool->allocs;
+    out->frees = pool->frees;
+    out->sys_allocs = pool->sys_allocs;
+    out->sys_frees = pool->sys_frees;
+    out->big_live = pool->big_live;
+    out->live = pool->allocs - pool->frees;
+}
+
+/* 整块释放, 不逐个归还 chunk; 超大对象需由调用者先行释放 */
+void pool_destroy(Pool *pool) {
+    if (pool) {
+        PoolBlock *block = pool->blocks;
+        while (block) {
+            PoolBlock *next = block->next;
+            free(block);
+            RBT_STAT_INC(frees);
+            block = next;
+        }
+        free(pool);
+    }
+}
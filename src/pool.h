@@ -0,0 +1,45 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+#define POOL_ALIGN 16
+#define POOL_CLASSES 16                             // 16, 32, ..., 256 字节
+#define POOL_MAX_CHUNK (POOL_ALIGN * POOL_CLASSES)  // 超过该大小直接 malloc
+#define POOL_MIN_BLOCK 4096
+
+typedef struct PoolBlock {
+    struct PoolBlock *next;
+} PoolBlock;
+
+typedef struct Pool {
+    PoolBlock *blocks;
+    char *cursor;  // 当前块中尚未切分的区域
+    char *limit;
+    uint32_t block_size;
+    uint32_t refs;  // 共享该池的树的个数
+    void *free_list[POOL_CLASSES];
+
+    uint64_t allocs;      // pool_alloc 调用次数
+    uint64_t frees;       // pool_free 调用次数
+    uint64_t sys_allocs;  // 实际 malloc 次数(整块 + 超大对象)
+    uint64_t sys_frees;   // 实际 free 次数
+    uint64_t big_live;    // 仍存活的超大对象个数
+} Pool;
+
+typedef struct PoolStats {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t sys_allocs;
+    uint64_t sys_frees;
+    uint64_t big_live;
+    uint64_t live;  // 尚未归还的 chunk, 即 allocs - frees
+} PoolStats;
+
+Pool *pool_new(uint32_t block_size);
+void *pool_alloc(Pool *pool, uint32_t size);
+void pool_free(Pool *pool, void *ptr, uint32_t size);
+void pool_destroy(Pool *pool);
+void pool_stats(Pool *pool, PoolStats *out);  // pool 为空时各项为 0
+
+#endif
@@ -7,8 +7,16 @@
 #include <string.h>
 
 #include "queue.h"
+#include "stats.h"
 #include "utils.h"
 
+/*
+ * 改写左右孩子和根: rbt_conc_search 的读者不加锁沿这些链接下降(acquire 读取),
+ * 因此用 release 原子写, 读者看到新链接时也能看到结点的完整内容; x86 上即普通写.
+ * parent 和颜色读者不看, 仍为普通写.
+ */
+#define RBT_SET_LINK(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+
 Data *rbt_data_new(void *buffer, int buffer_type) {
     Data *new_data = malloc(sizeof(Data));
     if (NULL == new_data) {
@@ -37,10 +45,12 @@ RBNode *rbt_rbnode_new(Data *data) {
         free(new_node);
         die("malloc new_node data");
     }
+    RBT_STAT_ADD(mallocs, 2);
     new_node->data.buffer_type = data->buffer_type;
     memcpy(new_node->data.buffer, data->buffer, data->buffer_type);
     new_node->left = new_node->right = new_node->parent = NULL;
     new_node->color = RED;
+    new_node->count = 1;
 
     return new_node;
 }
@@ -52,17 +62,154 @@ RBTree *rbt_rbtree_new() {
     }
 
     new_tree->root = NULL;
+    new_tree->leftmost = NULL;
+    new_tree->rightmost = NULL;
     new_tree->size = 0;
+    new_tree->key_size = 0;
+    new_tree->pool = NULL;
+    new_tree->augment = NULL;
+
+    return new_tree;
+}
+
+static Pool *rbt_pool_for(uint32_t node_hint, uint32_t chunk_size) {
+    uint64_t block_size = (uint64_t)node_hint * chunk_size + POOL_ALIGN;
+    if (block_size > UINT32_MAX) {
+        block_size = UINT32_MAX;
+    }
+    return pool_new((uint32_t)block_size);
+}
+
+RBTree *rbt_rbtree_new_pooled(uint32_t node_hint) {
+    RBTree *new_tree = rbt_rbtree_new();
+
+    /* 每个结点按 RBNode + 一个最小 key chunk 估算 */
+    new_tree->pool = rbt_pool_for(node_hint, sizeof(RBNode) + POOL_ALIGN);
+
+    return new_tree;
+}
+
+RBTree *rbt_rbtree_new_fixed(uint32_t key_size, uint32_t node_hint) {
+    if (key_size == 0) {
+        die("rbt_rbtree_new_fixed: key_size must be positive");
+    }
+
+    RBTree *new_tree = rbt_rbtree_new();
+    new_tree->key_size = key_size;
+    if (node_hint) {
+        new_tree->pool = rbt_pool_for(node_hint, sizeof(RBNode) + key_size);
+    }
+
+    return new_tree;
+}
+
+RBTree *rbt_rbtree_new_like(RBTree *tree) {
+    RBTree *new_tree = rbt_rbtree_new();
+    new_tree->key_size = tree->key_size;
+    new_tree->augment = tree->augment;
+    new_tree->pool = tree->pool;
+    if (new_tree->pool) {
+        new_tree->pool->refs++;
+    }
 
     return new_tree;
 }
 
+static int rbt_is_inline(RBNode *node) {
+    return node->data.buffer == (void *)node->key;
+}
+
+/*
+ * 池化树中结点本身占用的字节数, 内联 key 计入其中.
+ * 池中相邻的两个 chunk 可能恰好使 data.buffer == node->key, 因此按 key_size 而不是地址判断是否内联.
+ */
+static uint32_t rbt_node_bytes(RBTree *tree) {
+    return sizeof(RBNode) + tree->key_size;
+}
+
+RBNode *rbt_tree_node_new(RBTree *tree, Data *data) {
+    RBNode *new_node;
+
+    if (tree->key_size) {
+        if (data->buffer_type != tree->key_size) {
+            die("rbt_tree_node_new: key size %u, tree expects %u", data->buffer_type, tree->key_size);
+        }
+
+        uint32_t bytes = sizeof(RBNode) + tree->key_size;
+        if (tree->pool) {
+            new_node = pool_alloc(tree->pool, bytes);
+        } else {
+            new_node = malloc(bytes);
+            if (NULL == new_node) {
+                die("malloc new_node");
+            }
+            RBT_STAT_INC(mallocs);
+        }
+        new_node->data.buffer = new_node->key;
+    } else if (tree->pool) {
+        new_node = pool_alloc(tree->pool, sizeof(RBNode));
+        new_node->data.buffer = pool_alloc(tree->pool, data->buffer_type);
+    } else {
+        return rbt_rbnode_new(data);
+    }
+
+    new_node->data.buffer_type = data->buffer_type;
+    memcpy(new_node->data.buffer, data->buffer, data->buffer_type);
+    new_node->left = new_node->right = new_node->parent = NULL;
+    new_node->color = RED;
+    new_node->count = 1;
+
+    return new_node;
+}
+
+void rbt_tree_node_free(RBTree *tree, RBNode *node) {
+    if (!node) return;
+
+    if (!tree->pool) {
+        rbt_free_rbnode(node);
+        return;
+    }
+
+    if (!tree->key_size) {
+        pool_free(tree->pool, node->data.buffer, node->data.buffer_type);
+    }
+    pool_free(tree->pool, node, rbt_node_bytes(tree));
+}
+
+/* 自 node 起向上重新计算附加信息直到根 */
+static void rbt_augment_path(RBTree *tree, RBNode *node) {
+    while (node) {
+        tree->augment(node);
+        node = node->parent;
+    }
+}
+
+static void rbt_augment_all(AUGMENT *augment, RBNode *node) {
+    if (!node) return;
+
+    rbt_augment_all(augment, node->left);
+    rbt_augment_all(augment, node->right);
+    augment(node);
+}
+
+void rbt_set_augment(RBTree *tree, AUGMENT *augment) {
+    tree->augment = augment;
+    if (augment) {
+        rbt_augment_all(augment, tree->root);
+    }
+}
+
+void rbt_augment_count(RBNode *node) {
+    node->count = 1 + (node->left ? node->left->count : 0) + (node->right ? node->right->count : 0);
+}
+
 void rbt_left_rotate(RBTree *tree, RBNode *node) {
     if (node) {
+        RBT_STAT_INC(rotations);
         RBNode *pp = node->parent;
         RBNode *pr = node->right;
 
-        node->right = pr->left;
+        RBT_SET_LINK(node->right, pr->left);
         if (pr->left) {
             pr->left->parent = node;
         }
@@ -70,25 +217,31 @@ void rbt_left_rotate(RBTree *tree, RBNode *node) {
         pr->parent = pp;
         if (pp) {
             if (node == pp->left) {
-                pp->left = pr;
+                RBT_SET_LINK(pp->left, pr);
             } else {
-                pp->right = pr;
+                RBT_SET_LINK(pp->right, pr);
             }
         } else {
-            tree->root = pr;
+            RBT_SET_LINK(tree->root, pr);
         }
         node->parent = pr;
-        pr->left = node;
+        RBT_SET_LINK(pr->left, node);
+
+        if (tree->augment) {
+            tree->augment(node);
+            tree->augment(pr);
+        }
     }
 }
 
 void rbt_right_rotate(RBTree *tree, RBNode *node) {
     if (node) {
+        RBT_STAT_INC(rotations);
         RBNode *pp = node->parent;
         RBNode *pl = node->left;
 
         /* 第一处指针 */
-        node->left = pl->right;
+        RBT_SET_LINK(node->left, pl->right);
         if (pl->right) {
             pl->right->parent = node;
         }
@@ -97,17 +250,22 @@ void rbt_right_rotate(RBTree *tree, RBNode *node) {
         pl->parent = pp;
         if (pp) {
             if (node == pp->left) {
-                pp->left = pl;
+                RBT_SET_LINK(pp->left, pl);
             } else {
-                pp->right = pl;
+                RBT_SET_LINK(pp->right, pl);
             }
         } else {
-            tree->root = pl;
+            RBT_SET_LINK(tree->root, pl);
         }
 
         /* 第三处指针 */
         node->parent = pl;
-        pl->right = node;
+        RBT_SET_LINK(pl->right, node);
+
+        if (tree->augment) {
+            tree->augment(node);
+            tree->augment(pl);
+        }
     }
 }
 
@@ -150,67 +308,359 @@ RBNode *rbt_successor(RBNode *node) {
 
 RBNode *rbt_search_node(RBTree *tree, Data *data, CMP *cmp) {
     RBNode *p = tree->root;
+    RBT_STAT_ONLY(uint32_t len = 0;)
+    RBT_STAT_INC(searches);
     while (p) {
-        int ret = cmp(data, &p->data);
+        RBT_STAT_ONLY(len++;)
+        int ret = rbt_cmp(cmp, data, &p->data);
         if (ret < 0) {
             p = p->left;
         } else if (ret > 0) {
             p = p->right;
         } else {
+            RBT_STAT_PATH(len);
             return p;
         }
     }
+    RBT_STAT_PATH(len);
     return NULL;
 }
 
+/*
+ * 批量查找: 同时推进 RBT_BATCH_WIDTH 个查找, 每个只走一层就换下一个,
+ * 走到的孩子先预取, 轮到它时大多已在 cache 中. 完成的查找立即补上新 key.
+ * 内联 key 与结点同行, 一次预取即可覆盖; 非内联 key 的缓冲区仍是一次独立访问.
+ */
+void rbt_search_batch(RBTree *tree, Data **keys, size_t n, RBNode **out, CMP *cmp) {
+    RBNode *cur[RBT_BATCH_WIDTH];
+    size_t slot[RBT_BATCH_WIDTH];
+    size_t next = 0;
+    int active = 0;
+
+    while (active < RBT_BATCH_WIDTH && next < n) {
+        cur[active] = tree->root;
+        slot[active++] = next++;
+    }
+
+    while (active > 0) {
+        for (int i = 0; i < active;) {
+            RBNode *p = cur[i];
+            int ret = p ? rbt_cmp(cmp, keys[slot[i]], &p->data) : 0;
+
+            if (ret == 0) {
+                out[slot[i]] = p;
+                if (next < n) {
+                    cur[i] = tree->root;
+                    slot[i++] = next++;
+                } else {
+                    /* 用最后一个在途查找填补空位, i 不前进 */
+                    active--;
+                    cur[i] = cur[active];
+                    slot[i] = slot[active];
+                }
+                continue;
+            }
+
+            p = ret < 0 ? p->left : p->right;
+            if (p) {
+                __builtin_prefetch(p);
+            }
+            cur[i++] = p;
+        }
+    }
+}
+
+/* 把 node 挂到 parent 的左/右空位上并调整, parent 为空表示空树 */
+static void rbt_link_node(RBTree *tree, RBNode *parent, RBNode *node, int left) {
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->color = RED;
+    node->count = 1;
+
+    if (!parent) {
+        RBT_SET_LINK(tree->root, node);
+        tree->leftmost = node;
+        tree->rightmost = node;
+    } else if (left) {
+        RBT_SET_LINK(parent->left, node);
+        if (parent == tree->leftmost) {
+            tree->leftmost = node;
+        }
+    } else {
+        RBT_SET_LINK(parent->right, node);
+        if (parent == tree->rightmost) {
+            tree->rightmost = node;
+        }
+    }
+    tree->size++;
+
+    if (tree->augment) {
+        rbt_augment_path(tree, node);
+    }
+    fix_after_insert(tree, node);
+}
+
 void rbt_insert_node(RBTree *tree, RBNode *node, CMP *cmp) {
     if (!tree || !node) return;
 
     /* 第一个结点 */
     if (!tree->root) {
-        tree->root = node;
+        rbt_link_node(tree, NULL, node, 0);
+        return;
+    }
+
+    /* 追加快速路径: 不小于当前最大值时直接挂在最右结点上 */
+    if (rbt_cmp(cmp, &node->data, &tree->rightmost->data) >= 0) {
+        rbt_link_node(tree, tree->rightmost, node, 0);
+        return;
     }
+
     /* 中序为升序插入 */
-    else {
-        RBNode *p = tree->root;
-        RBNode *pp = p;
-        int ret;
-        while (p) {
-            ret = cmp(&node->data, &p->data);
-            pp = p;
-            if (ret < 0) {
-                p = p->left;
+    RBNode *p = tree->root;
+    RBNode *pp = p;
+    int ret = 0;
+    while (p) {
+        ret = rbt_cmp(cmp, &node->data, &p->data);
+        pp = p;
+        if (ret < 0) {
+            p = p->left;
+        } else {
+            p = p->right;
+        }
+    }
+
+    rbt_link_node(tree, pp, node, ret < 0);
+}
+
+void rbt_insert_hint(RBTree *tree, RBNode *hint, RBNode *node, CMP *cmp) {
+    if (!tree || !node) return;
+
+    /* 无提示时按追加处理, 由 rbt_insert_node 先检查最右结点 */
+    if (!tree->root || !hint) {
+        rbt_insert_node(tree, node, cmp);
+        return;
+    }
+
+    if (rbt_cmp(cmp, &node->data, &hint->data) <= 0) {
+        /* 落在 (前驱, hint] 之间 */
+        RBNode *prev = rbt_precursor(hint);
+        if (!prev || rbt_cmp(cmp, &node->data, &prev->data) >= 0) {
+            if (!hint->left) {
+                rbt_link_node(tree, hint, node, 1);
+            } else {
+                rbt_link_node(tree, prev, node, 0);
+            }
+            return;
+        }
+    } else {
+        /* 落在 (hint, 后继] 之间 */
+        RBNode *next = rbt_successor(hint);
+        if (!next || rbt_cmp(cmp, &node->data, &next->data) <= 0) {
+            if (!hint->right) {
+                rbt_link_node(tree, hint, node, 0);
             } else {
-                p = p->right;
+                rbt_link_node(tree, next, node, 1);
             }
+            return;
         }
+    }
 
-        if (ret < 0) {
-            pp->left = node;
+    /* 提示错误, 退化为从根查找 */
+    rbt_insert_node(tree, node, cmp);
+}
+
+/*
+ * 一次下降找到与 data 相等的结点; 找不到时返回 NULL,
+ * 并通过 parent/left 给出插入位置
+ */
+static RBNode *rbt_find_slot(RBTree *tree, Data *data, CMP *cmp, RBNode **parent, int *left) {
+    *parent = NULL;
+    *left = 0;
+    if (!tree->root) return NULL;
+
+    int ret = rbt_cmp(cmp, data, &tree->rightmost->data);
+    if (ret == 0) return tree->rightmost;
+    if (ret > 0) {
+        *parent = tree->rightmost;
+        return NULL;
+    }
+
+    RBNode *p = tree->root;
+    while (p) {
+        ret = rbt_cmp(cmp, data, &p->data);
+        if (ret == 0) return p;
+        *parent = p;
+        *left = ret < 0;
+        p = ret < 0 ? p->left : p->right;
+    }
+    return NULL;
+}
+
+/* 原地替换结点的数据, 定长树要求大小一致 */
+static void rbt_node_set_data(RBTree *tree, RBNode *node, Data *data) {
+    if (tree->key_size) {
+        if (data->buffer_type != tree->key_size) {
+            die("rbt_upsert: key size %u, tree expects %u", data->buffer_type, tree->key_size);
+        }
+    } else if (data->buffer_type != node->data.buffer_type) {
+        if (tree->pool) {
+            pool_free(tree->pool, node->data.buffer, node->data.buffer_type);
+            node->data.buffer = pool_alloc(tree->pool, data->buffer_type);
         } else {
-            pp->right = node;
+            void *buffer = realloc(node->data.buffer, data->buffer_type);
+            if (NULL == buffer) {
+                die("realloc node data");
+            }
+            node->data.buffer = buffer;
         }
-        node->parent = pp;
+        node->data.buffer_type = data->buffer_type;
     }
-    tree->size++;
+    memcpy(node->data.buffer, data->buffer, data->buffer_type);
 
-    fix_after_insert(tree, node);
+    if (tree->augment) {
+        rbt_augment_path(tree, node);
+    }
+}
+
+RBNode *rbt_insert_unique(RBTree *tree, RBNode *node, CMP *cmp, bool *inserted) {
+    RBNode *parent;
+    int left;
+    RBNode *found = rbt_find_slot(tree, &node->data, cmp, &parent, &left);
+
+    if (inserted) *inserted = !found;
+    if (found) return found;
+
+    rbt_link_node(tree, parent, node, left);
+    return node;
+}
+
+RBNode *rbt_find_or_insert(RBTree *tree, Data *data, CMP *cmp, bool *inserted) {
+    RBNode *parent;
+    int left;
+    RBNode *found = rbt_find_slot(tree, data, cmp, &parent, &left);
+
+    if (inserted) *inserted = !found;
+    if (found) return found;
+
+    RBNode *node = rbt_tree_node_new(tree, data);
+    rbt_link_node(tree, parent, node, left);
+    return node;
+}
+
+RBNode *rbt_upsert(RBTree *tree, Data *data, CMP *cmp, bool *inserted) {
+    RBNode *parent;
+    int left;
+    RBNode *found = rbt_find_slot(tree, data, cmp, &parent, &left);
+
+    if (inserted) *inserted = !found;
+    if (found) {
+        rbt_node_set_data(tree, found, data);
+        return found;
+    }
+
+    RBNode *node = rbt_tree_node_new(tree, data);
+    rbt_link_node(tree, parent, node, left);
+    return node;
 }
 
 void rbt_insert_data(RBTree *tree, Data *data, CMP *cmp) {
-    RBNode *node = rbt_rbnode_new(data);
+    RBNode *node = rbt_tree_node_new(tree, data);
     if (!node) {
         die("rbt_insert_data: new node");
     }
     rbt_insert_node(tree, node, cmp);
 }
 
-void fix_after_insert(RBTree *tree, RBNode *node) {
-    if (!tree || !node) {
+/* 填满的层数, 第 red_depth 层(从 0 开始)即不满的最底层 */
+uint32_t rbt_build_red_depth(size_t n) {
+    uint32_t red_depth = 0;
+    while (((size_t)2 << red_depth) - 1 <= n) red_depth++;
+    return red_depth;
+}
+
+/* 按中序创建 [lo, hi) 区间的结点, 取中点为根; 不满的最底层染红 */
+RBNode *rbt_build_range(RBTree *tree, Data *items, Data **refs, size_t lo, size_t hi, uint32_t depth, uint32_t red_depth) {
+    if (lo >= hi) return NULL;
+
+    size_t mid = lo + (hi - lo) / 2;
+    RBNode *left = rbt_build_range(tree, items, refs, lo, mid, depth + 1, red_depth);
+    RBNode *node = rbt_tree_node_new(tree, refs ? refs[mid] : &items[mid]);
+    RBNode *right = rbt_build_range(tree, items, refs, mid + 1, hi, depth + 1, red_depth);
+
+    node->color = depth == red_depth ? RED : BLACK;
+    node->left = left;
+    node->right = right;
+    if (left) left->parent = node;
+    if (right) right->parent = node;
+    if (tree->augment) tree->augment(node);
+
+    return node;
+}
+
+static void rbt_build(RBTree *tree, Data *items, Data **refs, size_t n, CMP *cmp) {
+    if (!tree || n == 0) return;
+
+    /* 非空树退化为逐个插入 */
+    if (tree->root) {
+        for (size_t i = 0; i < n; i++) {
+            rbt_insert_data(tree, refs ? refs[i] : &items[i], cmp);
+        }
         return;
     }
+
+    RBNode *root = rbt_build_range(tree, items, refs, 0, n, 0, rbt_build_red_depth(n));
+    rbt_adopt_root(tree, root, n);
+}
+
+void rbt_build_sorted(RBTree *tree, Data *items, size_t n, CMP *cmp) {
+    rbt_build(tree, items, NULL, n, cmp);
+}
+
+/* 稳定的归并排序, 相等元素保持输入顺序 */
+static void rbt_sort_refs(Data **refs, Data **tmp, size_t n, CMP *cmp) {
+    if (n < 2) return;
+
+    size_t half = n / 2;
+    rbt_sort_refs(refs, tmp, half, cmp);
+    rbt_sort_refs(refs + half, tmp, n - half, cmp);
+    if (rbt_cmp(cmp, refs[half - 1], refs[half]) <= 0) return;
+
+    memcpy(tmp, refs, half * sizeof(Data *));
+    size_t i = 0, j = half, k = 0;
+    while (i < half && j < n) {
+        refs[k++] = rbt_cmp(cmp, refs[j], tmp[i]) < 0 ? refs[j++] : tmp[i++];
+    }
+    while (i < half) {
+        refs[k++] = tmp[i++];
+    }
+}
+
+void rbt_build_unsorted(RBTree *tree, Data *items, size_t n, CMP *cmp) {
+    if (!tree || n == 0) return;
+
+    Data **refs = malloc(n * sizeof(Data *));
+    Data **tmp = malloc((n / 2 + 1) * sizeof(Data *));
+    if (NULL == refs || NULL == tmp) {
+        die("malloc rbt_build_unsorted refs");
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        refs[i] = &items[i];
+    }
+    rbt_sort_refs(refs, tmp, n, cmp);
+    rbt_build(tree, items, refs, n, cmp);
+
+    free(tmp);
+    free(refs);
+}
+
+bool fix_after_insert(RBTree *tree, RBNode *node) {
+    if (!tree || !node) {
+        return false;
+    }
     /* 插入结点的 parent 节点的颜色是红色才需要调整 */
     while (color_of(node->parent) == RED && node != tree->root && node) {
+        RBT_STAT_INC(insert_fixups);
         /* node 结点的 parent 结点是 grandparent 的 left 结点 */
         if (node->parent == node->parent->parent->left) {
             if (color_of(node->parent->parent->right) == RED) {
@@ -247,67 +697,177 @@ void fix_after_insert(RBTree *tree, RBNode *node) {
         }
     }
 
+    /* 红根染黑: 整棵树的黑高加 1 */
+    bool grew = tree->root->color == RED;
     rbt_set_color(tree->root, BLACK);
+    return grew;
 }
 
-void rbt_delete_data(RBTree *tree, Data *data, CMP *cmp) {
-    RBNode *node = rbt_search_node(tree, data, cmp);
-    if (!node || !tree) return;
+/* 用 child 替换 node 在父结点(或根)中的位置 */
+static void rbt_replace_child(RBTree *tree, RBNode *node, RBNode *child) {
+    if (!node->parent) {
+        RBT_SET_LINK(tree->root, child);
+    } else if (node == node->parent->left) {
+        RBT_SET_LINK(node->parent->left, child);
+    } else {
+        RBT_SET_LINK(node->parent->right, child);
+    }
+}
+
+/* 交换 node 与其前驱 pre 在树中的位置和颜色, 只改指针不动数据 */
+static void rbt_swap_with_precursor(RBTree *tree, RBNode *node, RBNode *pre) {
+    RBNode *pre_left = pre->left;
+    RBNode *pre_parent = pre->parent;
 
-    /* 转换成删除前驱结点或后继结点的形式 */
+    rbt_replace_child(tree, node, pre);
+    pre->parent = node->parent;
+    RBT_SET_LINK(pre->right, node->right);
+    pre->right->parent = pre;
+
+    if (pre == node->left) {
+        /* 前驱就是左孩子 */
+        RBT_SET_LINK(pre->left, node);
+        node->parent = pre;
+    } else {
+        RBT_SET_LINK(pre->left, node->left);
+        pre->left->parent = pre;
+        RBT_SET_LINK(pre_parent->right, node);
+        node->parent = pre_parent;
+    }
+
+    RBT_SET_LINK(node->left, pre_left);
+    if (pre_left) {
+        pre_left->parent = node;
+    }
+    RBT_SET_LINK(node->right, NULL);
+
+    Color color = node->color;
+    node->color = pre->color;
+    pre->color = color;
+}
+
+void rbt_unlink_node(RBTree *tree, RBNode *node) {
+    if (!tree || !node) return;
+
+    /* 最左/最右结点缺一侧孩子, 其后继/前驱即为新的缓存结点 */
+    if (node == tree->leftmost) {
+        tree->leftmost = rbt_successor(node);
+    }
+    if (node == tree->rightmost) {
+        tree->rightmost = rbt_precursor(node);
+    }
+
+    /* 转换成删除前驱结点的形式: 把 node 挪到前驱的位置 */
     if (node->left && node->right) {
-        RBNode *xnode = rbt_precursor(node);  // 获得前驱结点
-        xchg_data(xnode, node);
-        node = xnode;
+        rbt_swap_with_precursor(tree, node, rbt_precursor(node));
+        if (tree->augment) {
+            rbt_augment_path(tree, node);
+        }
     }
 
-    /* 获取实际删除结点的 child 结点的情况 */
+    /* 此时 node 至多只有一个 child */
     RBNode *m_node = node->left ? node->left : node->right;
 
-    /* 前驱或者后继节点有 child 节点 */
     if (m_node) {
         m_node->parent = node->parent;
-        if (node == tree->root) {
-            tree->root = m_node;
-        } else {
-            if (node == node->parent->left) {
-                node->parent->left = m_node;
-            } else {
-                node->parent->right = m_node;
-            }
+        rbt_replace_child(tree, node, m_node);
+        if (tree->augment) {
+            rbt_augment_path(tree, m_node->parent);
         }
-
-        rbt_free_rbnode(node);
         fix_after_delete(tree, m_node);
-    }
-    /* 前驱或者后继节点没有 child 节点 */
-    else {
-        /* 根节点 */
-        if (node == tree->root) {
-            tree->root = NULL;
-        }
-        /* 叶子节点 */
-        else {
-            fix_after_delete(tree, node);
-        }
-
-        if (node->parent != NULL) {
-            if (node == node->parent->left) {
-                node->parent->left = NULL;
-            } else if (node == node->parent->right) {
-                node->parent->right = NULL;
-            }
+    } else if (node == tree->root) {
+        RBT_SET_LINK(tree->root, NULL);
+    } else {
+        /* 叶子结点先调整再摘除 */
+        fix_after_delete(tree, node);
+        rbt_replace_child(tree, node, NULL);
+        if (tree->augment) {
+            rbt_augment_path(tree, node->parent);
         }
-        rbt_free_rbnode(node);
     }
 
+    RBT_SET_LINK(node->left, NULL);
+    RBT_SET_LINK(node->right, NULL);
+    node->parent = NULL;
     tree->size--;
 }
 
+void rbt_erase_node(RBTree *tree, RBNode *node) {
+    if (!tree || !node) return;
+
+    rbt_unlink_node(tree, node);
+    rbt_tree_node_free(tree, node);
+}
+
+/* node 先接好 victim 的链接, 最后一步才挂进树; 正停在 victim 上的无锁读者仍可沿其旧链接下降 */
+void rbt_replace_node(RBTree *tree, RBNode *victim, RBNode *node) {
+    node->parent = victim->parent;
+    node->left = victim->left;
+    node->right = victim->right;
+    node->color = victim->color;
+    node->count = victim->count;
+    if (victim->left) {
+        victim->left->parent = node;
+    }
+    if (victim->right) {
+        victim->right->parent = node;
+    }
+
+    if (tree->leftmost == victim) {
+        tree->leftmost = node;
+    }
+    if (tree->rightmost == victim) {
+        tree->rightmost = node;
+    }
+    rbt_replace_child(tree, victim, node);
+    if (tree->augment) {
+        rbt_augment_path(tree, node);
+    }
+}
+
+void rbt_adopt_root(RBTree *tree, RBNode *root, uint32_t size) {
+    tree->root = root;
+    tree->size = size;
+    tree->leftmost = tree->rightmost = root;
+    if (!root) return;
+
+    root->parent = NULL;
+    root->color = BLACK;
+    while (tree->leftmost->left) tree->leftmost = tree->leftmost->left;
+    while (tree->rightmost->right) tree->rightmost = tree->rightmost->right;
+}
+
+RBNode *rbt_min(RBTree *tree) {
+    return tree->leftmost;
+}
+
+RBNode *rbt_max(RBTree *tree) {
+    return tree->rightmost;
+}
+
+RBNode *rbt_pop_min(RBTree *tree) {
+    RBNode *node = tree->leftmost;
+    rbt_unlink_node(tree, node);
+    return node;
+}
+
+RBNode *rbt_pop_max(RBTree *tree) {
+    RBNode *node = tree->rightmost;
+    rbt_unlink_node(tree, node);
+    return node;
+}
+
+void rbt_delete_data(RBTree *tree, Data *data, CMP *cmp) {
+    if (!tree) return;
+
+    rbt_erase_node(tree, rbt_search_node(tree, data, cmp));
+}
+
 void fix_after_delete(RBTree *tree, RBNode *node) {
     if (!tree || !node) return;
 
     while (node != tree->root && color_of(node) == BLACK) {
+        RBT_STAT_INC(delete_fixups);
         if (node == node->parent->left) {
             /* 获取 sibling 结点 */
             RBNode *sib_node = node->parent->right;
@@ -342,7 +902,7 @@ void fix_after_delete(RBTree *tree, RBNode *node) {
             if (color_of(sib_node) == RED) {
                 rbt_set_color(sib_node, BLACK);
                 rbt_set_color(node->parent, RED);
-                rbt_left_rotate(tree, node->parent);
+                rbt_right_rotate(tree, node->parent);
                 sib_node = node->parent->left;
             }
 
@@ -353,14 +913,14 @@ void fix_after_delete(RBTree *tree, RBNode *node) {
                 if (color_of(sib_node->left) == BLACK) {
                     rbt_set_color(sib_node->right, BLACK);
                     rbt_set_color(sib_node, RED);
-                    rbt_right_rotate(tree, sib_node);
+                    rbt_left_rotate(tree, sib_node);
                     sib_node = node->parent->left;
                 }
 
                 rbt_set_color(sib_node, color_of(sib_node->parent));
                 rbt_set_color(node->parent, BLACK);
                 rbt_set_color(sib_node->left, BLACK);
-                rbt_left_rotate(tree, node->parent);
+                rbt_right_rotate(tree, node->parent);
                 node = tree->root;
             }
         }
@@ -369,6 +929,149 @@ void fix_after_delete(RBTree *tree, RBNode *node) {
     rbt_set_color(node, BLACK);
 }
 
+/* 第一个不小于 data 的结点 */
+static RBNode *rbt_lower_node(RBTree *tree, Data *data, CMP *cmp) {
+    RBNode *p = tree->root;
+    RBNode *found = NULL;
+    while (p) {
+        if (rbt_cmp(cmp, data, &p->data) <= 0) {
+            found = p;
+            p = p->left;
+        } else {
+            p = p->right;
+        }
+    }
+    return found;
+}
+
+/* 第一个大于 data 的结点 */
+static RBNode *rbt_upper_node(RBTree *tree, Data *data, CMP *cmp) {
+    RBNode *p = tree->root;
+    RBNode *found = NULL;
+    while (p) {
+        if (rbt_cmp(cmp, data, &p->data) < 0) {
+            found = p;
+            p = p->left;
+        } else {
+            p = p->right;
+        }
+    }
+    return found;
+}
+
+void rbt_cursor_init(RBCursor *cursor, RBTree *tree) {
+    cursor->tree = tree;
+    cursor->node = tree->leftmost;
+}
+
+void rbt_cursor_last(RBCursor *cursor, RBTree *tree) {
+    cursor->tree = tree;
+    cursor->node = tree->rightmost;
+}
+
+bool rbt_lower_bound(RBCursor *cursor, Data *data, CMP *cmp) {
+    cursor->node = rbt_lower_node(cursor->tree, data, cmp);
+    return cursor->node != NULL;
+}
+
+bool rbt_upper_bound(RBCursor *cursor, Data *data, CMP *cmp) {
+    cursor->node = rbt_upper_node(cursor->tree, data, cmp);
+    return cursor->node != NULL;
+}
+
+bool rbt_cursor_next(RBCursor *cursor) {
+    if (cursor->node) {
+        cursor->node = rbt_successor(cursor->node);
+    }
+    return cursor->node != NULL;
+}
+
+bool rbt_cursor_prev(RBCursor *cursor) {
+    /* 越过末尾后回退到最大结点 */
+    cursor->node = cursor->node ? rbt_precursor(cursor->node) : cursor->tree->rightmost;
+    return cursor->node != NULL;
+}
+
+bool rbt_cursor_erase(RBCursor *cursor) {
+    RBNode *node = cursor->node;
+    if (!node) return false;
+
+    /* 删除只改写指针, 后继结点地址不变 */
+    cursor->node = rbt_successor(node);
+    rbt_erase_node(cursor->tree, node);
+    return cursor->node != NULL;
+}
+
+size_t rbt_range_scan(RBTree *tree, Data *lo, Data *hi, CMP *cmp, SCAN *scan, void *arg) {
+    RBCursor cursor;
+    size_t count = 0;
+
+    rbt_cursor_init(&cursor, tree);
+    if (lo) {
+        rbt_lower_bound(&cursor, lo, cmp);
+    }
+
+    for (RBNode *p = cursor.node; p; p = rbt_successor(p)) {
+        if (hi && rbt_cmp(cmp, &p->data, hi) > 0) break;
+        count++;
+        if (scan(p, arg)) break;
+    }
+    return count;
+}
+
+static void rbt_require_count(RBTree *tree, const char *who) {
+    if (tree->augment != rbt_augment_count) {
+        die("%s: tree is not augmented with rbt_augment_count", who);
+    }
+}
+
+RBNode *rbt_select(RBTree *tree, uint32_t k) {
+    rbt_require_count(tree, "rbt_select");
+
+    RBNode *p = tree->root;
+    while (p) {
+        uint32_t left = p->left ? p->left->count : 0;
+        if (k < left) {
+            p = p->left;
+        } else if (k > left) {
+            k -= left + 1;
+            p = p->right;
+        } else {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* 小于 data(strict) 或不大于 data 的结点个数 */
+static uint32_t rbt_count_below(RBTree *tree, Data *data, CMP *cmp, int strict) {
+    RBNode *p = tree->root;
+    uint32_t below = 0;
+    while (p) {
+        int ret = rbt_cmp(cmp, data, &p->data);
+        if (ret < 0 || (strict && ret == 0)) {
+            p = p->left;
+        } else {
+            below += 1 + (p->left ? p->left->count : 0);
+            p = p->right;
+        }
+    }
+    return below;
+}
+
+uint32_t rbt_rank(RBTree *tree, Data *data, CMP *cmp) {
+    rbt_require_count(tree, "rbt_rank");
+    return rbt_count_below(tree, data, cmp, 1);
+}
+
+uint32_t rbt_count_range(RBTree *tree, Data *lo, Data *hi, CMP *cmp) {
+    rbt_require_count(tree, "rbt_count_range");
+
+    uint32_t upper = rbt_count_below(tree, hi, cmp, 0);
+    uint32_t lower = rbt_count_below(tree, lo, cmp, 1);
+    return upper > lower ? upper - lower : 0;
+}
+
 void rbt_preorder_traversal(RBNode *root, PRI_NODE *pri_node) {
     if (root) {
         pri_node(root);
@@ -431,10 +1134,12 @@ void rbt_free_data(Data *data) {
 void rbt_free_rbnode(RBNode *node) {
     if (node) {
         node->left = node->right = node->parent = NULL;
-        if (node->data.buffer) {
+        if (node->data.buffer && !rbt_is_inline(node)) {
             free(node->data.buffer);
+            RBT_STAT_INC(frees);
         }
         free(node);
+        RBT_STAT_INC(frees);
     }
 }
 
@@ -446,9 +1151,42 @@ void rbt_delete_node(RBNode *node) {
     rbt_free_rbnode(node);
 }
 
+/* 只释放超过池 chunk 上限、单独 malloc 的结点或 key */
+static void rbt_delete_big_chunks(RBTree *tree, RBNode *node) {
+    if (!node) return;
+
+    rbt_delete_big_chunks(tree, node->left);
+    rbt_delete_big_chunks(tree, node->right);
+    if (tree->key_size) {
+        if (rbt_node_bytes(tree) > POOL_MAX_CHUNK) {
+            pool_free(tree->pool, node, rbt_node_bytes(tree));
+        }
+    } else if (node->data.buffer_type > POOL_MAX_CHUNK) {
+        pool_free(tree->pool, node->data.buffer, node->data.buffer_type);
+    }
+}
+
+static void rbt_delete_pooled_nodes(RBTree *tree, RBNode *node) {
+    if (!node) return;
+
+    rbt_delete_pooled_nodes(tree, node->left);
+    rbt_delete_pooled_nodes(tree, node->right);
+    rbt_tree_node_free(tree, node);
+}
+
 void rbt_delete_tree(RBTree *tree) {
     if (tree) {
-        if (tree->root) {
+        if (tree->pool && tree->pool->refs > 1) {
+            /* 池仍被其他树共享, 只能逐个归还结点 */
+            rbt_delete_pooled_nodes(tree, tree->root);
+            tree->pool->refs--;
+        } else if (tree->pool) {
+            /* 池化树整块释放, 无需遍历结点 */
+            if (tree->pool->big_live) {
+                rbt_delete_big_chunks(tree, tree->root);
+            }
+            pool_destroy(tree->pool);
+        } else if (tree->root) {
             rbt_delete_node(tree->root);
         }
         free(tree);
@@ -457,6 +1195,7 @@ void rbt_delete_tree(RBTree *tree) {
 
 void rbt_set_color(RBNode *node, Color color) {
     if (node) {
+        RBT_STAT_ADD(recolors, node->color != color);
         node->color = color;
     }
 }
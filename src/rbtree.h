@@ -1,8 +1,14 @@
 #ifndef RBTREE_H
 #define RBTREE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "pool.h"
+
+#define RBT_BATCH_WIDTH 16  // rbt_search_batch 同时在途的查找个数
+
 typedef enum Color {
     RED,
     BLACK
@@ -14,25 +20,52 @@ typedef struct Data {
 } Data;
 
 typedef struct RBNode {
-    Data data;
-    Color color;
     struct RBNode *parent;
     struct RBNode *left;
     struct RBNode *right;
+    Color color;
+    uint32_t count;  // 子树结点数, 仅在 augment 为 rbt_augment_count 时维护(占用原有填充, 不增大结点)
+    Data data;
+    unsigned char key[];  // 定长 key 树中 data.buffer 指向这里, 与链接同处一次分配
 } RBNode;
 
+typedef void(AUGMENT)(RBNode *node);  // 由左右孩子重新计算结点的附加信息
+
 typedef struct RBTree {
     RBNode *root;
+    RBNode *leftmost;   // 缓存的最小结点
+    RBNode *rightmost;  // 缓存的最大结点, 供追加快速路径使用
     uint32_t size;
+    uint32_t key_size;  // 非 0 时 key 定长并内联在结点中
+    Pool *pool;         // 非空时结点及 key 从池中分配
+    AUGMENT *augment;   // 非空时在旋转和增删路径上维护附加信息
 } RBTree;
 
+/* 游标, node 为空表示已越过末尾 */
+typedef struct RBCursor {
+    RBTree *tree;
+    RBNode *node;
+} RBCursor;
+
 typedef int(CMP)(Data *src, Data *dest);
+typedef int(SCAN)(RBNode *node, void *arg);  // 返回非 0 时提前结束扫描
+typedef int(DSCAN)(Data *data, void *arg);   // 同 SCAN, 用于没有 RBNode 的结构(持久化树/映射文件)
 typedef void(PRI)(Data *buf);
 typedef void(PRI_NODE)(RBNode *node);
 
 Data *rbt_data_new(void *buffer, int buffer_type);
 RBNode *rbt_rbnode_new(Data *data);
 RBTree *rbt_rbtree_new();
+RBTree *rbt_rbtree_new_pooled(uint32_t node_hint);  // 池化树, node_hint 为预计结点数
+RBTree *rbt_rbtree_new_fixed(uint32_t key_size, uint32_t node_hint);  // 定长内联 key, node_hint 非 0 时启用池
+RBTree *rbt_rbtree_new_like(RBTree *tree);  // 与 tree 配置相同的空树, 共享同一个池
+
+/* 按树的分配方式创建/释放结点, 池化树中的结点必须经由这两个函数 */
+RBNode *rbt_tree_node_new(RBTree *tree, Data *data);
+void rbt_tree_node_free(RBTree *tree, RBNode *node);
+
+void rbt_set_augment(RBTree *tree, AUGMENT *augment);  // 设置后会重算已有结点
+void rbt_augment_count(RBNode *node);                   // 顺序统计: 维护子树结点数
 
 void rbt_left_rotate(RBTree *tree, RBNode *node);   // 左旋
 void rbt_right_rotate(RBTree *tree, RBNode *node);  // 右旋
@@ -40,13 +73,53 @@ void rbt_right_rotate(RBTree *tree, RBNode *node);  // 右旋
 RBNode *rbt_precursor(RBNode *node);  // 前驱结点(小于当前结点的最大值)
 RBNode *rbt_successor(RBNode *node);  // 后继绩点(大于当前节点的最小值)
 RBNode *rbt_search_node(RBTree *tree, Data *data, CMP *cmp);
+void rbt_search_batch(RBTree *tree, Data **keys, size_t n, RBNode **out, CMP *cmp);  // out[i] 为 keys[i] 的查找结果
 
 void rbt_insert_node(RBTree *tree, RBNode *node, CMP *cmp);
+void rbt_insert_hint(RBTree *tree, RBNode *hint, RBNode *node, CMP *cmp);  // 提示位置正确时只需 O(1) 次比较
 void rbt_insert_data(RBTree *tree, Data *data, CMP *cmp);
-void fix_after_insert(RBTree *tree, RBNode *node);
+bool fix_after_insert(RBTree *tree, RBNode *node);  // 返回树的黑高是否因此加 1
+
+/* 唯一键插入, 只下降一次; 返回已有结点或新结点, inserted 表示是否新插入 */
+RBNode *rbt_insert_unique(RBTree *tree, RBNode *node, CMP *cmp, bool *inserted);  // 已存在时 node 仍归调用者
+RBNode *rbt_find_or_insert(RBTree *tree, Data *data, CMP *cmp, bool *inserted);   // 不存在时才分配结点
+RBNode *rbt_upsert(RBTree *tree, Data *data, CMP *cmp, bool *inserted);           // 已存在时原地替换数据
+
+void rbt_build_sorted(RBTree *tree, Data *items, size_t n, CMP *cmp);    // 已排序输入, 空树上 O(n) 建树
+void rbt_build_unsorted(RBTree *tree, Data *items, size_t n, CMP *cmp);  // 先排序再建树
+
+/* 建树的内部步骤, 供并行建树复用 */
+uint32_t rbt_build_red_depth(size_t n);
+RBNode *rbt_build_range(RBTree *tree, Data *items, Data **refs, size_t lo, size_t hi, uint32_t depth, uint32_t red_depth);
+
+void rbt_unlink_node(RBTree *tree, RBNode *node);  // 摘除结点但不释放, 只改写指针
+void rbt_erase_node(RBTree *tree, RBNode *node);   // 摘除并释放结点, 无需再次查找
+void rbt_replace_node(RBTree *tree, RBNode *victim, RBNode *node);  // node 顶替等值的 victim, O(1) 不调整; victim 不释放且链接不变
 void rbt_delete_data(RBTree *tree, Data *data, CMP *cmp);
 void fix_after_delete(RBTree *tree, RBNode *node);
 
+void rbt_adopt_root(RBTree *tree, RBNode *root, uint32_t size);  // 以 root 为根接管结点并重算最值缓存
+
+/* O(1) 取最值; pop 直接摘除缓存的最值结点, 返回的结点由调用者用 rbt_tree_node_free 释放 */
+RBNode *rbt_min(RBTree *tree);
+RBNode *rbt_max(RBTree *tree);
+RBNode *rbt_pop_min(RBTree *tree);
+RBNode *rbt_pop_max(RBTree *tree);
+
+void rbt_cursor_init(RBCursor *cursor, RBTree *tree);  // 定位到最小结点
+void rbt_cursor_last(RBCursor *cursor, RBTree *tree);  // 定位到最大结点
+bool rbt_lower_bound(RBCursor *cursor, Data *data, CMP *cmp);  // 第一个不小于 data 的结点
+bool rbt_upper_bound(RBCursor *cursor, Data *data, CMP *cmp);  // 第一个大于 data 的结点
+bool rbt_cursor_next(RBCursor *cursor);
+bool rbt_cursor_prev(RBCursor *cursor);
+bool rbt_cursor_erase(RBCursor *cursor);  // 删除当前结点并前进到后继
+size_t rbt_range_scan(RBTree *tree, Data *lo, Data *hi, CMP *cmp, SCAN *scan, void *arg);  // 闭区间 [lo, hi], 为空表示不设界
+
+/* 顺序统计, 需先 rbt_set_augment(tree, rbt_augment_count), 均为 O(log n) */
+RBNode *rbt_select(RBTree *tree, uint32_t k);                           // 第 k 小的结点, k 从 0 开始
+uint32_t rbt_rank(RBTree *tree, Data *data, CMP *cmp);                  // 小于 data 的结点数
+uint32_t rbt_count_range(RBTree *tree, Data *lo, Data *hi, CMP *cmp);  // 落在 [lo, hi] 内的结点数
+
 void rbt_preorder_traversal(RBNode *root, PRI_NODE *pri_node);    // 前序遍历
 void rbt_inorder_traversal(RBNode *root, PRI_NODE *pri_node);     // 中序遍历
 void rbt_postorder_traversal(RBNode *root, PRI_NODE *pri_node);   // 后序遍历
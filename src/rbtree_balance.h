@@ -0,0 +1,228 @@
+#ifndef RBTREE_BALANCE_H
+#define RBTREE_BALANCE_H
+
+/*
+ * 红黑树的旋转, 插入/删除调整和结点摘除, 按结点的存取方式生成一份.
+ * 指针结点, 颜色压进指针低位的结点, 数组下标和共享内存偏移共用同一套平衡代码.
+ *
+ * 使用前以前缀 acc 定义以下存取宏或函数, t 为树, 结点以 ref_type 引用, nil 表示空:
+ *
+ *     ref_type acc##_left(tree_type *t, ref_type x);     acc##_set_left(t, x, v)
+ *     ref_type acc##_right(tree_type *t, ref_type x);    acc##_set_right(t, x, v)
+ *     ref_type acc##_parent(tree_type *t, ref_type x);   acc##_set_parent(t, x, v)
+ *     Color acc##_color(tree_type *t, ref_type x);       acc##_set_color(t, x, v)
+ *     ref_type acc##_root(tree_type *t);                 acc##_set_root(t, v)
+ *
+ * acc##_color 对 nil 须返回 BLACK, 其余存取不会以 nil 为 x 调用.
+ * 生成 name##_replace_child, _left_rotate, _right_rotate, _fix_after_insert,
+ * _fix_after_delete, _unlink, _first, _next.
+ */
+
+#include "rbtree.h"
+
+#define RBT_BALANCE_DEFINE(name, acc, tree_type, ref_type, nil)                                              \
+static inline void name##_replace_child(tree_type *t, ref_type parent, ref_type old, ref_type child) {       \
+    if (parent == nil) {                                                                                     \
+        acc##_set_root(t, child);                                                                            \
+    } else if (acc##_left(t, parent) == old) {                                                               \
+        acc##_set_left(t, parent, child);                                                                    \
+    } else {                                                                                                 \
+        acc##_set_right(t, parent, child);                                                                   \
+    }                                                                                                        \
+}                                                                                                            \
+                                                                                                             \
+static inline void name##_left_rotate(tree_type *t, ref_type node) {                                         \
+    ref_type pp = acc##_parent(t, node);                                                                     \
+    ref_type pr = acc##_right(t, node);                                                                      \
+    ref_type prl = acc##_left(t, pr);                                                                        \
+                                                                                                             \
+    acc##_set_right(t, node, prl);                                                                           \
+    if (prl != nil) acc##_set_parent(t, prl, node);                                                          \
+    acc##_set_parent(t, pr, pp);                                                                             \
+    name##_replace_child(t, pp, node, pr);                                                                   \
+    acc##_set_left(t, pr, node);                                                                             \
+    acc##_set_parent(t, node, pr);                                                                           \
+}                                                                                                            \
+                                                                                                             \
+static inline void name##_right_rotate(tree_type *t, ref_type node) {                                        \
+    ref_type pp = acc##_parent(t, node);                                                                     \
+    ref_type pl = acc##_left(t, node);                                                                       \
+    ref_type plr = acc##_right(t, pl);                                                                       \
+                                                                                                             \
+    acc##_set_left(t, node, plr);                                                                            \
+    if (plr != nil) acc##_set_parent(t, plr, node);                                                          \
+    acc##_set_parent(t, pl, pp);                                                                             \
+    name##_replace_child(t, pp, node, pl);                                                                   \
+    acc##_set_right(t, pl, node);                                                                            \
+    acc##_set_parent(t, node, pl);                                                                           \
+}                                                                                                            \
+                                                                                                             \
+static inline void name##_fix_after_insert(tree_type *t, ref_type node) {                                    \
+    ref_type parent;                                                                                         \
+    ref_type gparent;                                                                                        \
+    ref_type uncle;                                                                                          \
+                                                                                                             \
+    while ((parent = acc##_parent(t, node)) != nil && acc##_color(t, parent) == RED) {                       \
+        gparent = acc##_parent(t, parent);                                                                   \
+        if (parent == acc##_left(t, gparent)) {                                                              \
+            uncle = acc##_right(t, gparent);                                                                 \
+            if (acc##_color(t, uncle) == RED) {                                                              \
+                acc##_set_color(t, parent, BLACK);                                                           \
+                acc##_set_color(t, uncle, BLACK);                                                            \
+                acc##_set_color(t, gparent, RED);                                                            \
+                node = gparent;                                                                              \
+                continue;                                                                                    \
+            }                                                                                                \
+            if (node == acc##_right(t, parent)) {                                                            \
+                name##_left_rotate(t, parent);                                                               \
+                node = parent;                                                                               \
+                parent = acc##_parent(t, node);                                                              \
+            }                                                                                                \
+            acc##_set_color(t, parent, BLACK);                                                               \
+            acc##_set_color(t, gparent, RED);                                                                \
+            name##_right_rotate(t, gparent);                                                                 \
+        } else {                                                                                             \
+            uncle = acc##_left(t, gparent);                                                                  \
+            if (acc##_color(t, uncle) == RED) {                                                              \
+                acc##_set_color(t, parent, BLACK);                                                           \
+                acc##_set_color(t, uncle, BLACK);                                                            \
+                acc##_set_color(t, gparent, RED);                                                            \
+                node = gparent;                                                                              \
+                continue;                                                                                    \
+            }                                                                                                \
+            if (node == acc##_left(t, parent)) {                                                             \
+                name##_right_rotate(t, parent);                                                              \
+                node = parent;                                                                               \
+                parent = acc##_parent(t, node);                                                              \
+            }                                                                                                \
+            acc##_set_color(t, parent, BLACK);                                                               \
+            acc##_set_color(t, gparent, RED);                                                                \
+            name##_left_rotate(t, gparent);                                                                  \
+        }                                                                                                    \
+    }                                                                                                        \
+                                                                                                             \
+    acc##_set_color(t, acc##_root(t), BLACK);                                                                \
+}                                                                                                            \
+                                                                                                             \
+/* node 为实际摘除位置的 child(可能为 nil), 因此单独传入其父结点 parent */                                                        \
+static inline void name##_fix_after_delete(tree_type *t, ref_type node, ref_type parent) {                   \
+    ref_type sib;                                                                                            \
+                                                                                                             \
+    while (node != acc##_root(t) && acc##_color(t, node) == BLACK) {                                         \
+        if (node == acc##_left(t, parent)) {                                                                 \
+            sib = acc##_right(t, parent);                                                                    \
+            if (acc##_color(t, sib) == RED) {                                                                \
+                acc##_set_color(t, sib, BLACK);                                                              \
+                acc##_set_color(t, parent, RED);                                                             \
+                name##_left_rotate(t, parent);                                                               \
+                sib = acc##_right(t, parent);                                                                \
+            }                                                                                                \
+            if (acc##_color(t, acc##_left(t, sib)) == BLACK && acc##_color(t, acc##_right(t, sib)) == BLACK) { \
+                acc##_set_color(t, sib, RED);                                                                \
+                node = parent;                                                                               \
+                parent = acc##_parent(t, node);                                                              \
+            } else {                                                                                         \
+                if (acc##_color(t, acc##_right(t, sib)) == BLACK) {                                          \
+                    acc##_set_color(t, acc##_left(t, sib), BLACK);                                           \
+                    acc##_set_color(t, sib, RED);                                                            \
+                    name##_right_rotate(t, sib);                                                             \
+                    sib = acc##_right(t, parent);                                                            \
+                }                                                                                            \
+                acc##_set_color(t, sib, acc##_color(t, parent));                                             \
+                acc##_set_color(t, parent, BLACK);                                                           \
+                acc##_set_color(t, acc##_right(t, sib), BLACK);                                              \
+                name##_left_rotate(t, parent);                                                               \
+                node = acc##_root(t);                                                                        \
+            }                                                                                                \
+        } else {                                                                                             \
+            sib = acc##_left(t, parent);                                                                     \
+            if (acc##_color(t, sib) == RED) {                                                                \
+                acc##_set_color(t, sib, BLACK);                                                              \
+                acc##_set_color(t, parent, RED);                                                             \
+                name##_right_rotate(t, parent);                                                              \
+                sib = acc##_left(t, parent);                                                                 \
+            }                                                                                                \
+            if (acc##_color(t, acc##_left(t, sib)) == BLACK && acc##_color(t, acc##_right(t, sib)) == BLACK) { \
+                acc##_set_color(t, sib, RED);                                                                \
+                node = parent;                                                                               \
+                parent = acc##_parent(t, node);                                                              \
+            } else {                                                                                         \
+                if (acc##_color(t, acc##_left(t, sib)) == BLACK) {                                           \
+                    acc##_set_color(t, acc##_right(t, sib), BLACK);                                          \
+                    acc##_set_color(t, sib, RED);                                                            \
+                    name##_left_rotate(t, sib);                                                              \
+                    sib = acc##_left(t, parent);                                                             \
+                }                                                                                            \
+                acc##_set_color(t, sib, acc##_color(t, parent));                                             \
+                acc##_set_color(t, parent, BLACK);                                                           \
+                acc##_set_color(t, acc##_left(t, sib), BLACK);                                               \
+                name##_right_rotate(t, parent);                                                              \
+                node = acc##_root(t);                                                                        \
+            }                                                                                                \
+        }                                                                                                    \
+    }                                                                                                        \
+                                                                                                             \
+    if (node != nil) acc##_set_color(t, node, BLACK);                                                        \
+}                                                                                                            \
+                                                                                                             \
+/* 从树中摘下 node 并调整, 不释放; 两个孩子时用后继顶替 node 的位置(连同颜色), 其他结点不搬动 */                                                \
+static inline void name##_unlink(tree_type *t, ref_type node) {                                              \
+    ref_type left = acc##_left(t, node);                                                                     \
+    ref_type right = acc##_right(t, node);                                                                   \
+    ref_type child;                                                                                          \
+    ref_type parent;                                                                                         \
+    Color removed;                                                                                           \
+                                                                                                             \
+    if (left == nil || right == nil) {                                                                       \
+        child = left != nil ? left : right;                                                                  \
+        parent = acc##_parent(t, node);                                                                      \
+        removed = acc##_color(t, node);                                                                      \
+        name##_replace_child(t, parent, node, child);                                                        \
+        if (child != nil) acc##_set_parent(t, child, parent);                                                \
+    } else {                                                                                                 \
+        ref_type succ = right;                                                                               \
+        while (acc##_left(t, succ) != nil) succ = acc##_left(t, succ);                                       \
+                                                                                                             \
+        child = acc##_right(t, succ);                                                                        \
+        removed = acc##_color(t, succ);                                                                      \
+        if (acc##_parent(t, succ) == node) {                                                                 \
+            parent = succ;                                                                                   \
+        } else {                                                                                             \
+            parent = acc##_parent(t, succ);                                                                  \
+            acc##_set_left(t, parent, child);                                                                \
+            if (child != nil) acc##_set_parent(t, child, parent);                                            \
+            acc##_set_right(t, succ, right);                                                                 \
+            acc##_set_parent(t, right, succ);                                                                \
+        }                                                                                                    \
+                                                                                                             \
+        name##_replace_child(t, acc##_parent(t, node), node, succ);                                          \
+        acc##_set_parent(t, succ, acc##_parent(t, node));                                                    \
+        acc##_set_color(t, succ, acc##_color(t, node));                                                      \
+        acc##_set_left(t, succ, left);                                                                       \
+        acc##_set_parent(t, left, succ);                                                                     \
+    }                                                                                                        \
+                                                                                                             \
+    if (removed == BLACK) {                                                                                  \
+        name##_fix_after_delete(t, child, parent);                                                           \
+    }                                                                                                        \
+}                                                                                                            \
+                                                                                                             \
+static inline ref_type name##_first(tree_type *t) {                                                          \
+    ref_type p = acc##_root(t);                                                                              \
+    if (p == nil) return nil;                                                                                \
+    while (acc##_left(t, p) != nil) p = acc##_left(t, p);                                                    \
+    return p;                                                                                                \
+}                                                                                                            \
+                                                                                                             \
+static inline ref_type name##_next(tree_type *t, ref_type node) {                                            \
+    (void)t;  /* 存取宏可能不用 t */                                                                                \
+    ref_type p = acc##_right(t, node);                                                                       \
+    if (p != nil) {                                                                                          \
+        while (acc##_left(t, p) != nil) p = acc##_left(t, p);                                                \
+        return p;                                                                                            \
+    }                                                                                                        \
+    while ((p = acc##_parent(t, node)) != nil && node == acc##_right(t, p)) node = p;                        \
+    return p;                                                                                                \
+}
+
+#endif  // !RBTREE_BALANCE_H
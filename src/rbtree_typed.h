@@ -0,0 +1,142 @@
+#ifndef RBTREE_TYPED_H
+#define RBTREE_TYPED_H
+
+/*
+ * 按类型特化的红黑树生成器, 思路同 BSD sys/tree.h 的 RB_GENERATE.
+ * key 内联在结点中, 比较表达式直接展开, 不经过 CMP 函数指针.
+ *
+ *     RBT_DEFINE(itree, int, RBT_CMP_NUM(a, b))
+ *
+ *     itree tree;
+ *     itree_init(&tree);
+ *     itree_insert(&tree, 42);
+ *     itree_node *node = itree_search(&tree, 42);
+ *     itree_delete(&tree, 42);
+ *     itree_clear(&tree);
+ *
+ * cmp_expr 中用 a, b 表示两个 key, 返回值约定与 CMP 相同.
+ * 通用的 RBTree 接口保持不变, 作为变长 key 的通用实现.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rbtree.h"
+#include "rbtree_balance.h"
+#include "utils.h"
+
+#define RBT_CMP_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+
+/* 各生成类型的结点字段同名, 平衡代码共用一组存取宏 */
+#define rbt_typed_left(t, x) ((x)->left)
+#define rbt_typed_right(t, x) ((x)->right)
+#define rbt_typed_parent(t, x) ((x)->parent)
+#define rbt_typed_color(t, x) ((x) ? (x)->color : BLACK)
+#define rbt_typed_set_left(t, x, v) ((x)->left = (v))
+#define rbt_typed_set_right(t, x, v) ((x)->right = (v))
+#define rbt_typed_set_parent(t, x, v) ((x)->parent = (v))
+#define rbt_typed_set_color(t, x, v) ((x)->color = (v))
+#define rbt_typed_root(t) ((t)->root)
+#define rbt_typed_set_root(t, v) ((t)->root = (v))
+
+#define RBT_DEFINE(name, key_type, cmp_expr)                                                                 \
+typedef struct name##_node {                                                                                 \
+    struct name##_node *parent;                                                                              \
+    struct name##_node *left;                                                                                \
+    struct name##_node *right;                                                                               \
+    Color color;                                                                                             \
+    key_type key;                                                                                            \
+} name##_node;                                                                                               \
+                                                                                                             \
+typedef struct name {                                                                                        \
+    name##_node *root;                                                                                       \
+    uint32_t size;                                                                                           \
+} name;                                                                                                      \
+                                                                                                             \
+RBT_BALANCE_DEFINE(name##_rb, rbt_typed, name, name##_node *, NULL)                                          \
+                                                                                                             \
+static inline int name##_cmp(key_type a, key_type b) {                                                       \
+    return (cmp_expr);                                                                                       \
+}                                                                                                            \
+                                                                                                             \
+static inline void name##_init(name *tree) {                                                                 \
+    tree->root = NULL;                                                                                       \
+    tree->size = 0;                                                                                          \
+}                                                                                                            \
+                                                                                                             \
+static inline name##_node *name##_search(name *tree, key_type key) {                                         \
+    name##_node *p = tree->root;                                                                             \
+    while (p) {                                                                                              \
+        int ret = name##_cmp(key, p->key);                                                                   \
+        if (ret < 0) {                                                                                       \
+            p = p->left;                                                                                     \
+        } else if (ret > 0) {                                                                                \
+            p = p->right;                                                                                    \
+        } else {                                                                                             \
+            return p;                                                                                        \
+        }                                                                                                    \
+    }                                                                                                        \
+    return NULL;                                                                                             \
+}                                                                                                            \
+                                                                                                             \
+static inline name##_node *name##_first(name *tree) {                                                        \
+    return name##_rb_first(tree);                                                                            \
+}                                                                                                            \
+                                                                                                             \
+static inline name##_node *name##_next(name##_node *node) {                                                  \
+    return name##_rb_next(NULL, node);                                                                       \
+}                                                                                                            \
+                                                                                                             \
+static inline name##_node *name##_insert(name *tree, key_type key) {                                         \
+    name##_node *node = malloc(sizeof(name##_node));                                                         \
+    if (NULL == node) {                                                                                      \
+        die("malloc " #name " node");                                                                        \
+    }                                                                                                        \
+    node->key = key;                                                                                         \
+    node->left = node->right = NULL;                                                                         \
+    node->color = RED;                                                                                       \
+                                                                                                             \
+    name##_node *pp = NULL;                                                                                  \
+    name##_node **link = &tree->root;                                                                        \
+    while (*link) {                                                                                          \
+        pp = *link;                                                                                          \
+        link = name##_cmp(key, pp->key) < 0 ? &pp->left : &pp->right;                                        \
+    }                                                                                                        \
+    node->parent = pp;                                                                                       \
+    *link = node;                                                                                            \
+    tree->size++;                                                                                            \
+                                                                                                             \
+    name##_rb_fix_after_insert(tree, node);                                                                  \
+    return node;                                                                                             \
+}                                                                                                            \
+                                                                                                             \
+/* 两个孩子时后继结点接替 node 的位置, 只改指针 */                                                                             \
+static inline void name##_erase(name *tree, name##_node *node) {                                             \
+    name##_rb_unlink(tree, node);                                                                            \
+    tree->size--;                                                                                            \
+    free(node);                                                                                              \
+}                                                                                                            \
+                                                                                                             \
+static inline int name##_delete(name *tree, key_type key) {                                                  \
+    name##_node *node = name##_search(tree, key);                                                            \
+    if (!node) return 0;                                                                                     \
+                                                                                                             \
+    name##_erase(tree, node);                                                                                \
+    return 1;                                                                                                \
+}                                                                                                            \
+                                                                                                             \
+static inline void name##_free_node(name##_node *node) {                                                     \
+    while (node) {                                                                                           \
+        name##_free_node(node->left);                                                                        \
+        name##_node *right = node->right;                                                                    \
+        free(node);                                                                                          \
+        node = right;                                                                                        \
+    }                                                                                                        \
+}                                                                                                            \
+                                                                                                             \
+static inline void name##_clear(name *tree) {                                                                \
+    name##_free_node(tree->root);                                                                            \
+    name##_init(tree);                                                                                       \
+}
+
+#endif  // !RBTREE_TYPED_H
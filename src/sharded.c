@@ -0,0 +1,278 @@
+#include "sharded.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static RBTree *rbt_shard_tree_new(uint32_t key_size, uint32_t node_hint) {
+    if (key_size) {
+        return rbt_rbtree_new_fixed(key_size, node_hint);
+    }
+    return node_hint ? rbt_rbtree_new_pooled(node_hint) : rbt_rbtree_new();
+}
+
+static RBShardedTree *rbt_sharded_new(uint32_t nshards, CMP *cmp, uint32_t key_size, uint32_t node_hint) {
+    if (nshards == 0) {
+        die("rbt_sharded_new: nshards must be positive");
+    }
+
+    RBShardedTree *st = malloc(sizeof(RBShardedTree));
+    if (NULL == st) {
+        die("malloc new_sharded");
+    }
+    if (posix_memalign((void **)&st->shards, 64, nshards * sizeof(RBShard))) {
+        die("posix_memalign shards");
+    }
+
+    st->nshards = nshards;
+    st->bounds = NULL;
+    st->cmp = cmp;
+    st->hash = NULL;
+    st->hash_len = 0;
+    for (uint32_t i = 0; i < nshards; i++) {
+        pthread_rwlock_init(&st->shards[i].lock, NULL);
+        st->shards[i].tree = rbt_shard_tree_new(key_size, node_hint ? node_hint / nshards + 1 : 0);
+    }
+
+    return st;
+}
+
+RBShardedTree *rbt_sharded_new_range(Data *bounds, uint32_t nshards, CMP *cmp, uint32_t key_size, uint32_t node_hint) {
+    RBShardedTree *st = rbt_sharded_new(nshards, cmp, key_size, node_hint);
+
+    if (nshards > 1) {
+        st->bounds = malloc((nshards - 1) * sizeof(Data));
+        if (NULL == st->bounds) {
+            die("malloc shard bounds");
+        }
+        for (uint32_t i = 0; i + 1 < nshards; i++) {
+            st->bounds[i].buffer = malloc(bounds[i].buffer_type);
+            if (NULL == st->bounds[i].buffer) {
+                die("malloc shard bound");
+            }
+            memcpy(st->bounds[i].buffer, bounds[i].buffer, bounds[i].buffer_type);
+            st->bounds[i].buffer_type = bounds[i].buffer_type;
+        }
+    }
+
+    return st;
+}
+
+RBShardedTree *rbt_sharded_new_hash(uint32_t nshards, HASH *hash, uint32_t hash_len, CMP *cmp, uint32_t key_size,
+                                    uint32_t node_hint) {
+    /* 默认哈希看多少字节由调用方给出, 不猜测 cmp 的比较范围 */
+    if (!hash && hash_len == 0) {
+        die("rbt_sharded_new_hash: default hash needs a positive hash_len");
+    }
+    if (!hash && key_size && hash_len > key_size) {
+        die("rbt_sharded_new_hash: hash_len %u exceeds key size %u", hash_len, key_size);
+    }
+
+    RBShardedTree *st = rbt_sharded_new(nshards, cmp, key_size, node_hint);
+    st->hash = hash;
+    st->hash_len = hash ? 0 : hash_len;
+
+    return st;
+}
+
+void rbt_sharded_free(RBShardedTree *st) {
+    if (!st) return;
+
+    for (uint32_t i = 0; i < st->nshards; i++) {
+        pthread_rwlock_destroy(&st->shards[i].lock);
+        rbt_delete_tree(st->shards[i].tree);
+    }
+    if (st->bounds) {
+        for (uint32_t i = 0; i + 1 < st->nshards; i++) {
+            free(st->bounds[i].buffer);
+        }
+        free(st->bounds);
+    }
+    free(st->shards);
+    free(st);
+}
+
+uint32_t rbt_hash_bytes(Data *data) {
+    const unsigned char *p = data->buffer;
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < data->buffer_type; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static bool rbt_sharded_by_hash(RBShardedTree *st) {
+    return st->hash || st->hash_len;
+}
+
+/* 哈希分片取哈希值取模; 范围分片: 第一个满足 data < bounds[i] 的 i */
+static uint32_t rbt_shard_of(RBShardedTree *st, Data *data) {
+    if (st->hash) {
+        return st->hash(data) % st->nshards;
+    }
+    if (st->hash_len) {
+        Data prefix = {data->buffer, data->buffer_type < st->hash_len ? data->buffer_type : st->hash_len};
+        return rbt_hash_bytes(&prefix) % st->nshards;
+    }
+
+    uint32_t lo = 0, hi = st->nshards - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (st->cmp(data, &st->bounds[mid]) < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+void rbt_sharded_insert(RBShardedTree *st, Data *data) {
+    RBShard *shard = &st->shards[rbt_shard_of(st, data)];
+
+    pthread_rwlock_wrlock(&shard->lock);
+    rbt_insert_data(shard->tree, data, st->cmp);
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+bool rbt_sharded_upsert(RBShardedTree *st, Data *data) {
+    RBShard *shard = &st->shards[rbt_shard_of(st, data)];
+    bool inserted;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    rbt_upsert(shard->tree, data, st->cmp, &inserted);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return inserted;
+}
+
+bool rbt_sharded_search(RBShardedTree *st, Data *data, Data *out) {
+    RBShard *shard = &st->shards[rbt_shard_of(st, data)];
+
+    pthread_rwlock_rdlock(&shard->lock);
+    RBNode *node = rbt_search_node(shard->tree, data, st->cmp);
+    if (node && out) {
+        uint32_t size = node->data.buffer_type < out->buffer_type ? node->data.buffer_type : out->buffer_type;
+        memcpy(out->buffer, node->data.buffer, size);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    return node != NULL;
+}
+
+bool rbt_sharded_delete(RBShardedTree *st, Data *data) {
+    RBShard *shard = &st->shards[rbt_shard_of(st, data)];
+
+    pthread_rwlock_wrlock(&shard->lock);
+    RBNode *node = rbt_search_node(shard->tree, data, st->cmp);
+    rbt_erase_node(shard->tree, node);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return node != NULL;
+}
+
+size_t rbt_sharded_size(RBShardedTree *st) {
+    size_t size = 0;
+    for (uint32_t i = 0; i < st->nshards; i++) {
+        pthread_rwlock_rdlock(&st->shards[i].lock);
+        size += st->shards[i].tree->size;
+        pthread_rwlock_unlock(&st->shards[i].lock);
+    }
+    return size;
+}
+
+/* 扫描单个分片中 [lo, hi] 的结点, 返回非 0 表示回调要求停止 */
+static int rbt_shard_scan(RBShardedTree *st, RBShard *shard, Data *lo, Data *hi, SCAN *scan, void *arg, size_t *count) {
+    RBCursor cursor;
+    int stop = 0;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    rbt_cursor_init(&cursor, shard->tree);
+    if (lo) {
+        rbt_lower_bound(&cursor, lo, st->cmp);
+    }
+    for (; cursor.node; rbt_cursor_next(&cursor)) {
+        if (hi && st->cmp(&cursor.node->data, hi) > 0) break;
+        (*count)++;
+        if ((stop = scan(cursor.node, arg))) break;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    return stop;
+}
+
+/* 以各分片游标当前结点为 key 的小根堆 */
+static void rbt_heap_down(RBShardedTree *st, RBCursor *cursors, uint32_t *heap, uint32_t n, uint32_t i) {
+    for (;;) {
+        uint32_t min = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && st->cmp(&cursors[heap[l]].node->data, &cursors[heap[min]].node->data) < 0) min = l;
+        if (r < n && st->cmp(&cursors[heap[r]].node->data, &cursors[heap[min]].node->data) < 0) min = r;
+        if (min == i) return;
+
+        uint32_t t = heap[i];
+        heap[i] = heap[min];
+        heap[min] = t;
+        i = min;
+    }
+}
+
+/* 哈希分片的 key 交错分布, 需持有全部读锁做 k 路归并 */
+static size_t rbt_sharded_merge_scan(RBShardedTree *st, Data *lo, Data *hi, SCAN *scan, void *arg) {
+    RBCursor *cursors = malloc(st->nshards * sizeof(RBCursor));
+    uint32_t *heap = malloc(st->nshards * sizeof(uint32_t));
+    if (NULL == cursors || NULL == heap) {
+        die("malloc sharded scan");
+    }
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < st->nshards; i++) {
+        pthread_rwlock_rdlock(&st->shards[i].lock);
+        rbt_cursor_init(&cursors[i], st->shards[i].tree);
+        if (lo) {
+            rbt_lower_bound(&cursors[i], lo, st->cmp);
+        }
+        if (cursors[i].node) {
+            heap[n++] = i;
+        }
+    }
+    for (uint32_t i = n / 2; i-- > 0;) {
+        rbt_heap_down(st, cursors, heap, n, i);
+    }
+
+    size_t count = 0;
+    while (n) {
+        RBCursor *top = &cursors[heap[0]];
+        if (hi && st->cmp(&top->node->data, hi) > 0) break;
+        count++;
+        if (scan(top->node, arg)) break;
+
+        if (!rbt_cursor_next(top)) {
+            heap[0] = heap[--n];
+        }
+        rbt_heap_down(st, cursors, heap, n, 0);
+    }
+
+    for (uint32_t i = st->nshards; i-- > 0;) {
+        pthread_rwlock_unlock(&st->shards[i].lock);
+    }
+    free(heap);
+    free(cursors);
+
+    return count;
+}
+
+size_t rbt_sharded_scan(RBShardedTree *st, Data *lo, Data *hi, SCAN *scan, void *arg) {
+    if (rbt_sharded_by_hash(st)) {
+        return rbt_sharded_merge_scan(st, lo, hi, scan, arg);
+    }
+
+    /* 范围分片本身有序, 依次扫描相关分片即可, 每次只持有一个锁 */
+    size_t count = 0;
+    uint32_t first = lo ? rbt_shard_of(st, lo) : 0;
+    uint32_t last = hi ? rbt_shard_of(st, hi) : st->nshards - 1;
+    for (uint32_t i = first; i <= last; i++) {
+        if (rbt_shard_scan(st, &st->shards[i], lo, hi, scan, arg, &count)) break;
+    }
+    return count;
+}
@@ -0,0 +1,53 @@
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 必须与 CMP 一致: cmp 判为相等的两个 key 哈希值必须相同, 否则同一 key 会落到不同分片.
+ * cmp 只比较 buffer 的一部分(如 key 之后带 payload)时, 哈希也只能看这一部分.
+ */
+typedef uint32_t(HASH)(Data *data);
+
+/* 每个分片独占一条 cache line, 避免锁之间的伪共享 */
+typedef struct RBShard {
+    pthread_rwlock_t lock;
+    RBTree *tree;
+} __attribute__((aligned(64))) RBShard;
+
+typedef struct RBShardedTree {
+    uint32_t nshards;
+    RBShard *shards;
+    Data *bounds;       // 范围分片: 第 i 个分片存放 [bounds[i-1], bounds[i]) 的 key, 共 nshards - 1 个
+    CMP *cmp;
+    HASH *hash;         // 哈希分片的自定义哈希
+    uint32_t hash_len;  // hash 为空的哈希分片: 默认哈希只看 key 的前 hash_len 字节; 范围分片为 0
+} RBShardedTree;
+
+/* key_size 非 0 时各分片为定长内联 key 树, node_hint 非 0 时各分片启用池 */
+RBShardedTree *rbt_sharded_new_range(Data *bounds, uint32_t nshards, CMP *cmp, uint32_t key_size, uint32_t node_hint);
+/*
+ * 哈希分片: hash 非空时使用 hash, hash_len 被忽略; hash 为空时对 key 的前 hash_len 字节
+ * 做 FNV-1a, hash_len 须为正且覆盖 cmp 比较的全部字节(只比较这些字节的 cmp 才与之一致).
+ */
+RBShardedTree *rbt_sharded_new_hash(uint32_t nshards, HASH *hash, uint32_t hash_len, CMP *cmp, uint32_t key_size,
+                                    uint32_t node_hint);
+void rbt_sharded_free(RBShardedTree *st);
+
+uint32_t rbt_hash_bytes(Data *data);  // 对整个 buffer 做 FNV-1a, 只与比较整个 buffer 的 cmp(如 data_cmp)一致
+
+void rbt_sharded_insert(RBShardedTree *st, Data *data);
+bool rbt_sharded_upsert(RBShardedTree *st, Data *data);         // 返回是否新插入
+bool rbt_sharded_search(RBShardedTree *st, Data *data, Data *out);  // 找到时把数据拷贝到 out(至多 out->buffer_type 字节)
+bool rbt_sharded_delete(RBShardedTree *st, Data *data);
+size_t rbt_sharded_size(RBShardedTree *st);
+
+/* 跨分片有序扫描 [lo, hi], 为空表示不设界; 回调在分片读锁内执行, 不可修改树 */
+size_t rbt_sharded_scan(RBShardedTree *st, Data *lo, Data *hi, SCAN *scan, void *arg);
+
+#endif
@@ -0,0 +1,424 @@
+#include "shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rbtree_balance.h"
+#include "utils.h"
+
+#define SN(st, off) ((RBShmNode *)((char *)(st)->base + (off)))
+#define RBT_SHM_CLASS(size) (((size) - 1) / RBT_SHM_ALIGN)
+
+/* "/name" 形式(只有开头一个 '/')为 POSIX 共享内存对象 */
+static bool rbt_shm_is_posix(const char *name) {
+    return name[0] == '/' && !strchr(name + 1, '/');
+}
+
+static int rbt_shm_open(const char *name, int flags) {
+    if (rbt_shm_is_posix(name)) {
+        return shm_open(name, flags, 0600);
+    }
+    return open(name, flags, 0600);
+}
+
+int rbt_shm_unlink(const char *name) {
+    return rbt_shm_is_posix(name) ? shm_unlink(name) : unlink(name);
+}
+
+static RBShmTree *rbt_shm_map(int fd, size_t length) {
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return NULL;
+
+    RBShmTree *st = malloc(sizeof(RBShmTree));
+    if (NULL == st) {
+        die("malloc new_shm_tree");
+    }
+    st->base = base;
+    st->length = length;
+    st->header = base;
+
+    return st;
+}
+
+RBShmTree *rbt_shm_create(const char *name, size_t bytes, uint32_t key_size) {
+    if (key_size == 0 || key_size > RBT_SHM_MAX_KEY || bytes < sizeof(RBShmHeader) + RBT_SHM_ALIGN) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int fd = rbt_shm_open(name, O_RDWR | O_CREAT | O_EXCL);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, bytes) != 0) {
+        int saved = errno;
+        close(fd);
+        rbt_shm_unlink(name);
+        errno = saved;
+        return NULL;
+    }
+
+    RBShmTree *st = rbt_shm_map(fd, bytes);
+    close(fd);
+    if (!st) {
+        rbt_shm_unlink(name);
+        return NULL;
+    }
+
+    RBShmHeader *header = st->header;
+    header->version = RBT_SHM_VERSION;
+    header->key_size = key_size;
+    header->length = bytes;
+    header->brk = (sizeof(RBShmHeader) + RBT_SHM_ALIGN - 1) & ~(uint64_t)(RBT_SHM_ALIGN - 1);
+    header->node_bytes = sizeof(RBShmNode) + key_size;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    /* 其他进程看到 magic 时其余字段都已就绪 */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, RBT_SHM_MAGIC, sizeof(RBT_SHM_MAGIC));
+
+    return st;
+}
+
+RBShmTree *rbt_shm_attach(const char *name) {
+    int fd = rbt_shm_open(name, O_RDWR);
+    if (fd < 0) return NULL;
+
+    struct stat st_buf;
+    if (fstat(fd, &st_buf) != 0 || (size_t)st_buf.st_size < sizeof(RBShmHeader)) {
+        close(fd);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    RBShmTree *st = rbt_shm_map(fd, st_buf.st_size);
+    close(fd);
+    if (!st) return NULL;
+
+    RBShmHeader *header = st->header;
+    if (memcmp(header->magic, RBT_SHM_MAGIC, sizeof(RBT_SHM_MAGIC)) != 0) {
+        rbt_shm_detach(st);
+        errno = EAGAIN;
+        return NULL;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (header->version != RBT_SHM_VERSION || header->length != (uint64_t)st_buf.st_size) {
+        rbt_shm_detach(st);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return st;
+}
+
+void rbt_shm_detach(RBShmTree *st) {
+    if (st) {
+        munmap(st->base, st->length);
+        free(st);
+    }
+}
+
+/* 段内分配器: 按 16 字节分级的空闲链表 + 顺序切分, 链表指针同样存偏移 */
+static RBShmOff rbt_shm_alloc(RBShmTree *st, uint32_t size) {
+    RBShmHeader *header = st->header;
+    uint32_t cls = RBT_SHM_CLASS(size);
+    if (cls >= RBT_SHM_CLASSES) return 0;
+
+    RBShmOff off = header->free_list[cls];
+    if (off) {
+        header->free_list[cls] = *(RBShmOff *)((char *)st->base + off);
+        return off;
+    }
+
+    uint64_t chunk = (uint64_t)(cls + 1) * RBT_SHM_ALIGN;
+    if (header->brk + chunk > header->length) return 0;
+    off = header->brk;
+    header->brk += chunk;
+
+    return off;
+}
+
+static void rbt_shm_free(RBShmTree *st, RBShmOff off, uint32_t size) {
+    RBShmHeader *header = st->header;
+    uint32_t cls = RBT_SHM_CLASS(size);
+
+    SN(st, off)->key_size = 0;
+    *(RBShmOff *)((char *)st->base + off) = header->free_list[cls];
+    header->free_list[cls] = off;
+}
+
+/* 平衡代码用的存取宏, 结点以段内偏移引用, 0 为空 */
+#define sn_left(st, off) (SN(st, off)->left)
+#define sn_right(st, off) (SN(st, off)->right)
+#define sn_parent(st, off) (SN(st, off)->parent)
+#define sn_color(st, off) ((off) ? SN(st, off)->color : BLACK)
+#define sn_set_left(st, off, v) (SN(st, off)->left = (v))
+#define sn_set_right(st, off, v) (SN(st, off)->right = (v))
+#define sn_set_parent(st, off, v) (SN(st, off)->parent = (v))
+#define sn_set_color(st, off, v) (SN(st, off)->color = (v))
+#define sn_root(st) ((st)->header->root)
+#define sn_set_root(st, v) ((st)->header->root = (v))
+
+RBT_BALANCE_DEFINE(rbt_shm_rb, sn, RBShmTree, RBShmOff, 0)
+
+/* 按 key 归并排序结点偏移 */
+static void rbt_shm_sort(RBShmTree *st, RBShmOff *offs, RBShmOff *tmp, size_t n, CMP *cmp) {
+    if (n < 2) return;
+
+    size_t half = n / 2;
+    rbt_shm_sort(st, offs, tmp, half, cmp);
+    rbt_shm_sort(st, offs + half, tmp, n - half, cmp);
+
+    memcpy(tmp, offs, half * sizeof(RBShmOff));
+    size_t i = 0, j = half, k = 0;
+    while (i < half && j < n) {
+        Data a = {SN(st, tmp[i])->key, SN(st, tmp[i])->key_size};
+        Data b = {SN(st, offs[j])->key, SN(st, offs[j])->key_size};
+        offs[k++] = cmp(&b, &a) < 0 ? offs[j++] : tmp[i++];
+    }
+    while (i < half) {
+        offs[k++] = tmp[i++];
+    }
+}
+
+/* 与 rbt_build_range 相同: 取中点为根, 不满的最底层染红 */
+static RBShmOff rbt_shm_build(RBShmTree *st, RBShmOff *offs, size_t lo, size_t hi, uint32_t depth, uint32_t red_depth) {
+    if (lo >= hi) return 0;
+
+    size_t mid = lo + (hi - lo) / 2;
+    RBShmOff p = offs[mid];
+    RBShmNode *node = SN(st, p);
+    node->left = rbt_shm_build(st, offs, lo, mid, depth + 1, red_depth);
+    node->right = rbt_shm_build(st, offs, mid + 1, hi, depth + 1, red_depth);
+    node->color = depth == red_depth ? RED : BLACK;
+    if (node->left) SN(st, node->left)->parent = p;
+    if (node->right) SN(st, node->right)->parent = p;
+
+    return p;
+}
+
+/*
+ * 写者死在修改中途, 链接和空闲链表都不可信. 段内所有结点块大小相同, 从头到 brk
+ * 逐块看提交标记: 已提交的重建为平衡树(相同 key 只留一个), 其余放回空闲链表.
+ */
+static void rbt_shm_repair(RBShmTree *st, CMP *cmp) {
+    RBShmHeader *header = st->header;
+    uint32_t cls = RBT_SHM_CLASS(header->node_bytes);
+    uint64_t chunk = (uint64_t)(cls + 1) * RBT_SHM_ALIGN;
+    uint64_t start = (sizeof(RBShmHeader) + RBT_SHM_ALIGN - 1) & ~(uint64_t)(RBT_SHM_ALIGN - 1);
+    size_t total = (header->brk - start) / chunk;
+
+    RBShmOff *offs = malloc((total + 1) * sizeof(RBShmOff));
+    RBShmOff *tmp = malloc((total / 2 + 1) * sizeof(RBShmOff));
+    if (NULL == offs || NULL == tmp) {
+        die("malloc rbt_shm_repair");
+    }
+
+    header->free_list[cls] = 0;
+    size_t n = 0;
+    for (RBShmOff off = start; off + chunk <= header->brk; off += chunk) {
+        if (SN(st, off)->key_size == header->key_size) {
+            offs[n++] = off;
+        } else {
+            rbt_shm_free(st, off, header->node_bytes);
+        }
+    }
+
+    rbt_shm_sort(st, offs, tmp, n, cmp);
+    size_t live = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (live) {
+            Data prev = {SN(st, offs[live - 1])->key, header->key_size};
+            Data key = {SN(st, offs[i])->key, header->key_size};
+            if (cmp(&prev, &key) == 0) {
+                rbt_shm_free(st, offs[i], header->node_bytes);
+                continue;
+            }
+        }
+        offs[live++] = offs[i];
+    }
+
+    header->root = rbt_shm_build(st, offs, 0, live, 0, rbt_build_red_depth(live));
+    if (header->root) {
+        SN(st, header->root)->parent = 0;
+    }
+    __atomic_store_n(&header->size, live, __ATOMIC_RELAXED);
+    header->writing = 0;
+
+    free(tmp);
+    free(offs);
+}
+
+/* 上一个持锁者死掉时, 若它正在写则先修复, 再把锁标记为一致 */
+static void rbt_shm_lock(RBShmTree *st, CMP *cmp) {
+    RBShmHeader *header = st->header;
+    int ret = pthread_mutex_lock(&header->lock);
+    if (ret == EOWNERDEAD) {
+        if (header->writing) {
+            rbt_shm_repair(st, cmp);
+        }
+        pthread_mutex_consistent(&header->lock);
+    } else if (ret != 0) {
+        die("rbt_shm_lock: %s", strerror(ret));
+    }
+}
+
+static void rbt_shm_unlock(RBShmTree *st) {
+    pthread_mutex_unlock(&st->header->lock);
+}
+
+/* 写标记与前后的结点写入不能被编译器重排, 进程可能死在任意两条写之间 */
+static void rbt_shm_set_writing(RBShmTree *st, uint32_t writing) {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&st->header->writing, writing, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static RBShmOff rbt_shm_find(RBShmTree *st, Data *data, CMP *cmp) {
+    RBShmOff p = st->header->root;
+    while (p) {
+        RBShmNode *node = SN(st, p);
+        Data key = {node->key, node->key_size};
+        int ret = cmp(data, &key);
+        if (ret < 0) {
+            p = node->left;
+        } else if (ret > 0) {
+            p = node->right;
+        } else {
+            return p;
+        }
+    }
+    return 0;
+}
+
+int rbt_shm_upsert(RBShmTree *st, Data *data, CMP *cmp) {
+    RBShmHeader *header = st->header;
+    if (data->buffer_type != header->key_size) {
+        die("rbt_shm_upsert: key size %u, segment expects %u", data->buffer_type, header->key_size);
+    }
+
+    int ret = 1;
+    rbt_shm_lock(st, cmp);
+    rbt_shm_set_writing(st, 1);
+
+    RBShmOff parent = 0, p = header->root;
+    int c = 0;
+    while (p) {
+        RBShmNode *node = SN(st, p);
+        Data key = {node->key, node->key_size};
+        c = cmp(data, &key);
+        if (c == 0) break;
+        parent = p;
+        p = c < 0 ? node->left : node->right;
+    }
+
+    if (p) {
+        memcpy(SN(st, p)->key, data->buffer, header->key_size);
+        ret = 0;
+    } else if (!(p = rbt_shm_alloc(st, header->node_bytes))) {
+        ret = -1;
+    } else {
+        RBShmNode *node = SN(st, p);
+        node->parent = parent;
+        node->left = node->right = 0;
+        node->color = RED;
+        memcpy(node->key, data->buffer, header->key_size);
+        /* 提交标记最后写, 修复时只认写完整的结点 */
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        __atomic_store_n(&node->key_size, header->key_size, __ATOMIC_RELAXED);
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+        if (!parent) {
+            header->root = p;
+        } else if (c < 0) {
+            SN(st, parent)->left = p;
+        } else {
+            SN(st, parent)->right = p;
+        }
+        rbt_shm_rb_fix_after_insert(st, p);
+        __atomic_store_n(&header->size, header->size + 1, __ATOMIC_RELAXED);  // 持锁写, 只有 rbt_shm_size 不持锁读
+    }
+
+    rbt_shm_set_writing(st, 0);
+    rbt_shm_unlock(st);
+    return ret;
+}
+
+bool rbt_shm_delete(RBShmTree *st, Data *data, CMP *cmp) {
+    RBShmHeader *header = st->header;
+    rbt_shm_lock(st, cmp);
+    rbt_shm_set_writing(st, 1);
+
+    RBShmOff p = rbt_shm_find(st, data, cmp);
+    if (p) {
+        /* 先撤提交标记, 死在摘除途中时修复也视为已删除 */
+        __atomic_store_n(&SN(st, p)->key_size, 0, __ATOMIC_RELAXED);
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        rbt_shm_rb_unlink(st, p);
+        rbt_shm_free(st, p, header->node_bytes);
+        __atomic_store_n(&header->size, header->size - 1, __ATOMIC_RELAXED);
+    }
+
+    rbt_shm_set_writing(st, 0);
+    rbt_shm_unlock(st);
+    return p != 0;
+}
+
+bool rbt_shm_search(RBShmTree *st, Data *data, CMP *cmp, Data *out) {
+    rbt_shm_lock(st, cmp);
+
+    RBShmOff p = rbt_shm_find(st, data, cmp);
+    if (p && out) {
+        RBShmNode *node = SN(st, p);
+        uint32_t len = node->key_size < out->buffer_type ? node->key_size : out->buffer_type;
+        memcpy(out->buffer, node->key, len);
+        out->buffer_type = len;
+    }
+
+    rbt_shm_unlock(st);
+    return p != 0;
+}
+
+size_t rbt_shm_scan(RBShmTree *st, Data *lo, Data *hi, CMP *cmp, DSCAN *scan, void *arg) {
+    size_t count = 0;
+    rbt_shm_lock(st, cmp);
+
+    /* 第一个不小于 lo 的结点 */
+    RBShmOff p = st->header->root, first = 0;
+    while (p) {
+        RBShmNode *node = SN(st, p);
+        Data key = {node->key, node->key_size};
+        if (!lo || cmp(lo, &key) <= 0) {
+            first = p;
+            p = node->left;
+        } else {
+            p = node->right;
+        }
+    }
+
+    for (p = first; p; p = rbt_shm_rb_next(st, p)) {
+        RBShmNode *node = SN(st, p);
+        Data key = {node->key, node->key_size};
+        if (hi && cmp(&key, hi) > 0) break;
+
+        count++;
+        if (scan(&key, arg)) break;
+    }
+
+    rbt_shm_unlock(st);
+    return count;
+}
+
+/* 不持锁: 写者持锁并以原子存储更新 size, 这里读到的是某次提交前后的值 */
+uint32_t rbt_shm_size(RBShmTree *st) {
+    return __atomic_load_n(&st->header->size, __ATOMIC_RELAXED);
+}
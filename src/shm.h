@@ -0,0 +1,71 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 共享内存树: 树头, 结点和分配器都放在同一段映射里, 链接存相对段首的偏移,
+ * 各进程映射到不同地址也能直接读写同一棵树.
+ * name 形如 "/name"(只含开头一个 '/')时使用 shm_open, 否则视为普通文件路径.
+ * 段大小在创建时固定; 进程间用段内的进程共享 robust 互斥锁同步, 读者之间也互斥.
+ * key 定长且内联在结点中, 至多 RBT_SHM_MAX_KEY 字节; cmp 是各进程自己的函数地址, 每次调用时传入.
+ *
+ * 持锁进程被杀死时, 下一个加锁者收到 EOWNERDEAD: 若死者正在修改(header->writing),
+ * 按段内结点的提交标记重建整棵树和空闲链表, 再标记锁一致后继续. 死者进行中的那次
+ * 插入/删除可能生效也可能没有, 原地替换的 key 可能新旧混合; 其余操作不受影响.
+ */
+#define RBT_SHM_MAGIC "RBTSHM"
+#define RBT_SHM_VERSION 2
+#define RBT_SHM_ALIGN 16
+#define RBT_SHM_CLASSES 64  // 16, 32, ..., 1024 字节
+
+typedef uint64_t RBShmOff;  // 相对段首的偏移, 0 表示空
+
+typedef struct RBShmNode {
+    RBShmOff parent;
+    RBShmOff left;
+    RBShmOff right;
+    Color color;
+    uint32_t key_size;  // 结点写好后最后写入, 为 0 表示空闲块或未完成的分配
+    unsigned char key[];
+} RBShmNode;
+
+#define RBT_SHM_MAX_KEY (RBT_SHM_CLASSES * RBT_SHM_ALIGN - sizeof(RBShmNode))
+
+typedef struct RBShmHeader {
+    char magic[8];  // 初始化完成后最后写入
+    uint32_t version;
+    uint32_t key_size;
+    uint64_t length;  // 段大小
+    uint64_t brk;     // 尚未切分区域的起点
+    RBShmOff free_list[RBT_SHM_CLASSES];
+    RBShmOff root;
+    uint32_t size;
+    uint32_t node_bytes;
+    uint32_t writing;  // 持锁修改期间为 1
+    pthread_mutex_t lock;
+} RBShmHeader;
+
+typedef struct RBShmTree {
+    void *base;  // 本进程中的映射地址
+    size_t length;
+    RBShmHeader *header;
+} RBShmTree;
+
+RBShmTree *rbt_shm_create(const char *name, size_t bytes, uint32_t key_size);  // 已存在时失败(EEXIST), key 过长时失败(EINVAL)
+RBShmTree *rbt_shm_attach(const char *name);  // 段尚未初始化完成时失败(EAGAIN)
+void rbt_shm_detach(RBShmTree *st);
+int rbt_shm_unlink(const char *name);
+
+int rbt_shm_upsert(RBShmTree *st, Data *data, CMP *cmp);  // 1 新插入, 0 替换已有, -1 段已满
+bool rbt_shm_delete(RBShmTree *st, Data *data, CMP *cmp);
+bool rbt_shm_search(RBShmTree *st, Data *data, CMP *cmp, Data *out);  // 找到时拷贝至多 out->buffer_type 字节
+size_t rbt_shm_scan(RBShmTree *st, Data *lo, Data *hi, CMP *cmp, DSCAN *scan, void *arg);  // 持锁回调, 回调中不能访问这棵树
+uint32_t rbt_shm_size(RBShmTree *st);
+
+#endif
@@ -0,0 +1,28 @@
+#include "stats.h"
+
+#include <string.h>
+
+#ifdef RBT_STATS
+__thread RBStats rbt_tls_stats;
+#endif
+
+void rbt_stats(RBTree *tree, RBStats *out) {
+#ifdef RBT_STATS
+    *out = rbt_tls_stats;
+    out->enabled = true;
+#else
+    memset(out, 0, sizeof(RBStats));
+#endif
+
+    out->size = tree ? tree->size : 0;
+    out->black_height = 0;
+    for (RBNode *p = tree ? tree->root : NULL; p; p = p->left) {
+        if (p->color == BLACK) out->black_height++;
+    }
+}
+
+void rbt_stats_reset(void) {
+#ifdef RBT_STATS
+    memset(&rbt_tls_stats, 0, sizeof(RBStats));
+#endif
+}
@@ -0,0 +1,62 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 热路径计数, 以 -DRBT_STATS 编译时启用(make STATS=1).
+ * 计数器是线程局部的, rbt_stats 返回调用线程自上次 rbt_stats_reset 以来的累计值;
+ * 未启用时各 RBT_STAT_* 宏展开为空, rbt_stats 只填写与树本身有关的字段.
+ */
+
+#define RBT_STATS_PATH_MAX 64  // 查找路径长度直方图的桶数, 更长的计入最后一个桶
+
+typedef struct RBStats {
+    bool enabled;  // 是否以 RBT_STATS 编译
+
+    uint64_t cmp_calls;       // rbtree.c 中对 CMP 的调用
+    uint64_t rotations;       // rbt_left_rotate + rbt_right_rotate
+    uint64_t recolors;        // rbt_set_color 中实际改变了颜色的次数
+    uint64_t insert_fixups;   // fix_after_insert 的循环次数
+    uint64_t delete_fixups;   // fix_after_delete 的循环次数
+    uint64_t mallocs;         // 结点/key 及池块的 malloc 次数
+    uint64_t frees;           // 对应的 free 次数
+    uint64_t searches;        // rbt_search_node 调用次数
+    uint64_t path_hist[RBT_STATS_PATH_MAX];  // path_hist[k]: 访问 k 个结点后结束的查找数
+
+    uint32_t size;          // 以下按 tree 当前状态计算
+    uint32_t black_height;  // 根到叶子路径上的黑结点数, 空树为 0
+} RBStats;
+
+#ifdef RBT_STATS
+
+extern __thread RBStats rbt_tls_stats;
+
+#define RBT_STAT_ADD(field, n) (rbt_tls_stats.field += (n))
+#define RBT_STAT_ONLY(...) __VA_ARGS__
+#define RBT_STAT_PATH(len) \
+    (rbt_tls_stats.path_hist[(len) < RBT_STATS_PATH_MAX ? (len) : RBT_STATS_PATH_MAX - 1]++)
+
+#else
+
+#define RBT_STAT_ADD(field, n) ((void)0)
+#define RBT_STAT_ONLY(...)
+#define RBT_STAT_PATH(len) ((void)0)
+
+#endif
+
+#define RBT_STAT_INC(field) RBT_STAT_ADD(field, 1)
+
+/* 带计数的比较, 未启用时就是 cmp(a, b) */
+static inline int rbt_cmp(CMP *cmp, Data *a, Data *b) {
+    RBT_STAT_INC(cmp_calls);
+    return cmp(a, b);
+}
+
+void rbt_stats(RBTree *tree, RBStats *out);  // tree 可为空, 此时只返回线程计数
+void rbt_stats_reset(void);                  // 清零调用线程的计数器
+
+#endif  // !STATS_H
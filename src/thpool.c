@@ -0,0 +1,207 @@
+#include "thpool.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define TP_DEQUE_INIT 64
+
+static __thread int tp_worker = -1;  // 当前线程的 worker 编号
+
+static void tpool_deque_init(TPDeque *deque) {
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->items = malloc(TP_DEQUE_INIT * sizeof(TPTask *));
+    if (NULL == deque->items) {
+        die("malloc tpool deque");
+    }
+    deque->head = deque->tail = 0;
+    deque->capacity = TP_DEQUE_INIT;
+}
+
+static void tpool_push(TPDeque *deque, TPTask *task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity) {
+        /* 先把已被窃取的头部空间挪回来, 仍不够再扩容 */
+        uint32_t count = deque->tail - deque->head;
+        if (deque->head == 0) {
+            deque->capacity *= 2;
+            TPTask **items = realloc(deque->items, deque->capacity * sizeof(TPTask *));
+            if (NULL == items) {
+                die("realloc tpool deque");
+            }
+            deque->items = items;
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                deque->items[i] = deque->items[deque->head + i];
+            }
+            deque->head = 0;
+            deque->tail = count;
+        }
+    }
+    deque->items[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+/* 自己取尾部, 窃取取头部 */
+static TPTask *tpool_take(TPDeque *deque, int steal) {
+    TPTask *task = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        task = steal ? deque->items[deque->head++] : deque->items[--deque->tail];
+        if (deque->head == deque->tail) {
+            deque->head = deque->tail = 0;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return task;
+}
+
+static TPTask *tpool_find(ThreadPool *pool, int self) {
+    TPTask *task = tpool_take(&pool->deques[self], 0);
+
+    for (uint32_t i = 1; !task && i < pool->nworkers; i++) {
+        task = tpool_take(&pool->deques[(self + i) % pool->nworkers], 1);
+    }
+    if (task) {
+        __atomic_fetch_sub(&pool->pending, 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static void tpool_exec(TPTask *task) {
+    task->fn(task->arg);
+    __atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+}
+
+typedef struct TPStart {
+    ThreadPool *pool;
+    int id;
+} TPStart;
+
+static void *tpool_worker(void *arg) {
+    TPStart *start = arg;
+    ThreadPool *pool = start->pool;
+    tp_worker = start->id;
+    free(start);
+
+    for (;;) {
+        TPTask *task = tpool_find(pool, tp_worker);
+        if (task) {
+            tpool_exec(task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->idle_lock);
+        while (!pool->stop && __atomic_load_n(&pool->pending, __ATOMIC_RELAXED) == 0) {
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+        }
+        int stop = pool->stop;
+        pthread_mutex_unlock(&pool->idle_lock);
+        if (stop) break;
+    }
+
+    return NULL;
+}
+
+ThreadPool *tpool_new(uint32_t nworkers) {
+    if (nworkers == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = ncpu > 0 ? (uint32_t)ncpu : 1;
+    }
+
+    ThreadPool *new_pool = malloc(sizeof(ThreadPool));
+    if (NULL == new_pool) {
+        die("malloc new_pool");
+    }
+    new_pool->nworkers = nworkers;
+    new_pool->pending = 0;
+    new_pool->stop = 0;
+    pthread_mutex_init(&new_pool->idle_lock, NULL);
+    pthread_cond_init(&new_pool->idle_cond, NULL);
+
+    new_pool->deques = malloc(nworkers * sizeof(TPDeque));
+    new_pool->threads = malloc(nworkers * sizeof(pthread_t));
+    if (NULL == new_pool->deques || NULL == new_pool->threads) {
+        die("malloc tpool workers");
+    }
+    for (uint32_t i = 0; i < nworkers; i++) {
+        tpool_deque_init(&new_pool->deques[i]);
+    }
+
+    /* 0 号 worker 由调用 tpool_run 的线程担任 */
+    for (uint32_t i = 1; i < nworkers; i++) {
+        TPStart *start = malloc(sizeof(TPStart));
+        if (NULL == start) {
+            die("malloc tpool start");
+        }
+        start->pool = new_pool;
+        start->id = i;
+        if (pthread_create(&new_pool->threads[i], NULL, tpool_worker, start)) {
+            die("pthread_create:");
+        }
+    }
+
+    return new_pool;
+}
+
+void tpool_free(ThreadPool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->idle_lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    for (uint32_t i = 1; i < pool->nworkers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (uint32_t i = 0; i < pool->nworkers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+void tpool_run(ThreadPool *pool, void (*fn)(void *arg), void *arg) {
+    (void)pool;  // 目前只支持同一时刻一个 tpool_run
+    int saved = tp_worker;
+    tp_worker = 0;
+    fn(arg);
+    tp_worker = saved;
+}
+
+void tpool_spawn(ThreadPool *pool, TPTask *task) {
+    task->done = 0;
+
+    /* 单线程池没有人来窃取, 直接执行 */
+    if (pool->nworkers == 1 || tp_worker < 0) {
+        tpool_exec(task);
+        return;
+    }
+
+    tpool_push(&pool->deques[tp_worker], task);
+    __atomic_fetch_add(&pool->pending, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&pool->idle_lock);
+    pthread_cond_signal(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+}
+
+void tpool_wait(ThreadPool *pool, TPTask *task) {
+    while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+        TPTask *other = tpool_find(pool, tp_worker);
+        if (other) {
+            tpool_exec(other);
+        } else {
+            sched_yield();
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef THPOOL_H
+#define THPOOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * fork-join 线程池: 每个 worker 一个双端队列, 自己从尾部取(LIFO),
+ * 空闲时从其他 worker 的头部窃取(FIFO). 任务放在调用者栈上, 由 tpool_wait 等待.
+ */
+typedef struct TPTask {
+    void (*fn)(void *arg);
+    void *arg;
+    int done;
+} TPTask;
+
+typedef struct TPDeque {
+    pthread_mutex_t lock;
+    TPTask **items;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t capacity;
+} TPDeque;
+
+typedef struct ThreadPool {
+    uint32_t nworkers;  // 含调用 tpool_run 的线程(0 号 worker)
+    pthread_t *threads;
+    TPDeque *deques;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    int pending;  // 已入队未被取走的任务数
+    int stop;
+} ThreadPool;
+
+ThreadPool *tpool_new(uint32_t nworkers);  // 为 0 时取 CPU 个数
+void tpool_free(ThreadPool *pool);
+
+void tpool_run(ThreadPool *pool, void (*fn)(void *arg), void *arg);  // 调用线程作为 0 号 worker 执行 fn
+void tpool_spawn(ThreadPool *pool, TPTask *task);                    // 只能在 tpool_run 内部调用
+void tpool_wait(ThreadPool *pool, TPTask *task);                     // 等待期间帮忙执行其他任务
+
+#endif
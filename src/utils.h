@@ -3,7 +3,7 @@
 
 #include "rbtree.h"
 
-void die(const char *fmt, ...);
+void die(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
 int data_cmp(Data *src, Data *dest);
 
 #endif  // !UTILS_H
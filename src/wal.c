@@ -0,0 +1,396 @@
+#include "wal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mapped.h"
+#include "utils.h"
+
+#define RBT_WAL_OP_BITS 2
+#define RBT_WAL_OP_MASK ((1u << RBT_WAL_OP_BITS) - 1)
+
+static uint32_t rbt_wal_sum(const RBWalRecord *rec, const void *key, uint32_t len) {
+    uint32_t hash = 2166136261u;
+    const unsigned char *p = (const unsigned char *)&rec->op_len;
+    for (size_t i = 0; i < sizeof(RBWalRecord) - sizeof(rec->checksum); i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    p = key;
+    for (uint32_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static char *rbt_wal_path(const char *path, const char *suffix) {
+    size_t len = strlen(path), slen = strlen(suffix);
+    char *out = malloc(len + slen + 1);
+    if (NULL == out) {
+        die("malloc wal path");
+    }
+    memcpy(out, path, len);
+    memcpy(out + len, suffix, slen + 1);
+    return out;
+}
+
+/* 读入整个日志, 文件不存在时视为空 */
+static char *rbt_wal_read(const char *log_path, size_t *len) {
+    *len = 0;
+    int fd = open(log_path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    char *buf = malloc(st.st_size);
+    if (NULL == buf) {
+        die("malloc wal read");
+    }
+    while (*len < (size_t)st.st_size) {
+        ssize_t n = read(fd, buf + *len, st.st_size - *len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        *len += n;
+    }
+    close(fd);
+    return buf;
+}
+
+/* 取出 off 处的记录; 截断或校验失败视为日志结束 */
+static bool rbt_wal_next(const char *buf, size_t len, size_t *off, RBWalRecord *rec, Data *key) {
+    if (len - *off < sizeof(RBWalRecord)) return false;
+
+    memcpy(rec, buf + *off, sizeof(RBWalRecord));
+    uint32_t key_len = rec->op_len >> RBT_WAL_OP_BITS;
+    uint32_t op = rec->op_len & RBT_WAL_OP_MASK;
+    if (op == 0 || key_len > len - *off - sizeof(RBWalRecord)) return false;
+
+    key->buffer = (void *)(buf + *off + sizeof(RBWalRecord));
+    key->buffer_type = key_len;
+    if (rbt_wal_sum(rec, key->buffer, key_len) != rec->checksum) return false;
+
+    *off += sizeof(RBWalRecord) + key_len;
+    return true;
+}
+
+static void rbt_wal_apply(RBTree *tree, CMP *cmp, RBWalOp op, Data *key) {
+    switch (op) {
+        case RBT_WAL_INSERT:
+            rbt_insert_data(tree, key, cmp);
+            break;
+        case RBT_WAL_UPSERT:
+            rbt_upsert(tree, key, cmp, NULL);
+            break;
+        case RBT_WAL_DELETE:
+            rbt_delete_data(tree, key, cmp);
+            break;
+    }
+}
+
+static int rbt_wal_write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * 持有锁调用. 已有线程在写出时等它结束, 否则自己带走当前缓冲中的全部记录:
+ * 交换缓冲后释放锁做 I/O, 其间到达的记录进入新缓冲, 由下一轮写出.
+ */
+static void rbt_wal_flush_locked(RBWal *wal, bool sync) {
+    while (wal->flushing) {
+        pthread_cond_wait(&wal->cond, &wal->lock);
+    }
+    if (wal->len == 0 && (!sync || wal->synced_lsn == wal->written_lsn)) return;
+
+    char *buf = wal->buf;
+    size_t len = wal->len;
+    uint64_t last = wal->next_lsn - 1;
+
+    size_t cap = wal->cap;
+    wal->buf = wal->spare;
+    wal->cap = wal->spare_cap;
+    wal->spare = buf;
+    wal->spare_cap = cap;
+    wal->len = 0;
+    wal->flushing = true;
+    pthread_mutex_unlock(&wal->lock);
+
+    if (rbt_wal_write_all(wal->fd, buf, len) != 0) {
+        die("wal write %s:", wal->log_path);
+    }
+    if (sync && fdatasync(wal->fd) != 0) {
+        die("wal fdatasync %s:", wal->log_path);
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    wal->written_lsn = last;
+    if (sync) {
+        wal->synced_lsn = last;
+        wal->syncs++;
+    }
+    wal->flushing = false;
+    pthread_cond_broadcast(&wal->cond);
+}
+
+/*
+ * 持有锁调用: 追加记录并按策略提交.
+ * 只扩容 buf: spare 可能正被写出线程在锁外使用, 它在交换回来后成为 buf 时再按需扩容.
+ */
+static void rbt_wal_log(RBWal *wal, RBWalOp op, Data *key) {
+    size_t need = sizeof(RBWalRecord) + key->buffer_type;
+    if (wal->len + need > wal->cap) {
+        size_t cap = wal->cap;
+        while (wal->len + need > cap) cap *= 2;
+        wal->buf = realloc(wal->buf, cap);
+        if (NULL == wal->buf) {
+            die("realloc wal buffer");
+        }
+        wal->cap = cap;
+    }
+
+    RBWalRecord rec;
+    rec.op_len = key->buffer_type << RBT_WAL_OP_BITS | op;
+    rec.lsn = wal->next_lsn++;
+    rec.checksum = rbt_wal_sum(&rec, key->buffer, key->buffer_type);
+    memcpy(wal->buf + wal->len, &rec, sizeof(rec));
+    memcpy(wal->buf + wal->len + sizeof(rec), key->buffer, key->buffer_type);
+    wal->len += need;
+    wal->records++;
+
+    if (wal->policy == RBT_SYNC_EACH) {
+        /* 别人的一次 fdatasync 可能已经带走了这条记录 */
+        while (wal->synced_lsn < rec.lsn) {
+            rbt_wal_flush_locked(wal, true);
+        }
+    } else if (wal->len >= RBT_WAL_BUF_LIMIT) {
+        rbt_wal_flush_locked(wal, false);
+    }
+}
+
+static void *rbt_wal_flusher(void *arg) {
+    RBWal *wal = arg;
+
+    pthread_mutex_lock(&wal->lock);
+    while (!wal->stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += wal->interval_ms / 1000;
+        ts.tv_nsec += (long)(wal->interval_ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        /* cond 也用于通知写出完成, 醒来后须等到超时才落盘 */
+        while (!wal->stop && pthread_cond_timedwait(&wal->cond, &wal->lock, &ts) != ETIMEDOUT);
+        rbt_wal_flush_locked(wal, true);
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    return NULL;
+}
+
+/* 快照头部记录的 lsn, 没有快照时为 0 */
+static uint64_t rbt_wal_snap_lsn(const char *snap_path) {
+    RBMapped *mapped = rbt_open_mapped(snap_path);
+    if (!mapped) return 0;
+
+    uint64_t lsn = mapped->header->lsn;
+    rbt_mapped_close(mapped);
+    return lsn;
+}
+
+RBWal *rbt_wal_open(RBTree *tree, const char *path, CMP *cmp, RBSyncPolicy policy, uint32_t interval_ms) {
+    RBWal *wal = malloc(sizeof(RBWal));
+    if (NULL == wal) {
+        die("malloc new_wal");
+    }
+    memset(wal, 0, sizeof(RBWal));
+
+    wal->tree = tree;
+    wal->cmp = cmp;
+    wal->log_path = rbt_wal_path(path, ".wal");
+    wal->snap_path = rbt_wal_path(path, ".snap");
+    wal->policy = policy;
+    wal->interval_ms = interval_ms ? interval_ms : 1;
+
+    /* 找到最后一条完整记录, 之后的残缺部分截掉, 新记录接在其后 */
+    uint64_t last = rbt_wal_snap_lsn(wal->snap_path);
+    size_t len, off = 0;
+    char *old = rbt_wal_read(wal->log_path, &len);
+    RBWalRecord rec;
+    Data key;
+    while (rbt_wal_next(old, len, &off, &rec, &key)) {
+        if (rec.lsn > last) last = rec.lsn;
+    }
+    free(old);
+
+    wal->fd = open(wal->log_path, O_WRONLY | O_CREAT, 0644);
+    if (wal->fd < 0 || ftruncate(wal->fd, off) != 0 || lseek(wal->fd, off, SEEK_SET) < 0) {
+        die("wal open %s:", wal->log_path);
+    }
+
+    wal->next_lsn = last + 1;
+    wal->written_lsn = wal->synced_lsn = last;
+    wal->cap = wal->spare_cap = 4096;
+    wal->buf = malloc(wal->cap);
+    wal->spare = malloc(wal->cap);
+    if (NULL == wal->buf || NULL == wal->spare) {
+        die("malloc wal buffer");
+    }
+
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->cond, NULL);
+    if (policy == RBT_SYNC_INTERVAL && pthread_create(&wal->flusher, NULL, rbt_wal_flusher, wal) != 0) {
+        die("pthread_create wal flusher");
+    }
+
+    return wal;
+}
+
+void rbt_wal_close(RBWal *wal) {
+    if (!wal) return;
+
+    if (wal->policy == RBT_SYNC_INTERVAL) {
+        pthread_mutex_lock(&wal->lock);
+        wal->stop = true;
+        pthread_cond_broadcast(&wal->cond);
+        pthread_mutex_unlock(&wal->lock);
+        pthread_join(wal->flusher, NULL);
+    }
+
+    rbt_wal_sync(wal);
+    close(wal->fd);
+    pthread_mutex_destroy(&wal->lock);
+    pthread_cond_destroy(&wal->cond);
+    free(wal->buf);
+    free(wal->spare);
+    free(wal->log_path);
+    free(wal->snap_path);
+    free(wal);
+}
+
+void rbt_wal_insert(RBWal *wal, Data *data) {
+    pthread_mutex_lock(&wal->lock);
+    rbt_insert_data(wal->tree, data, wal->cmp);
+    rbt_wal_log(wal, RBT_WAL_INSERT, data);
+    pthread_mutex_unlock(&wal->lock);
+}
+
+bool rbt_wal_upsert(RBWal *wal, Data *data) {
+    bool inserted;
+
+    pthread_mutex_lock(&wal->lock);
+    rbt_upsert(wal->tree, data, wal->cmp, &inserted);
+    rbt_wal_log(wal, RBT_WAL_UPSERT, data);
+    pthread_mutex_unlock(&wal->lock);
+
+    return inserted;
+}
+
+bool rbt_wal_delete(RBWal *wal, Data *data) {
+    pthread_mutex_lock(&wal->lock);
+    RBNode *node = rbt_search_node(wal->tree, data, wal->cmp);
+    if (node) {
+        rbt_erase_node(wal->tree, node);
+        rbt_wal_log(wal, RBT_WAL_DELETE, data);
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    return node != NULL;
+}
+
+void rbt_wal_sync(RBWal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    rbt_wal_flush_locked(wal, true);
+    pthread_mutex_unlock(&wal->lock);
+}
+
+/*
+ * 快照带上 lsn, 先换快照再清日志; 两步之间崩溃时旧日志按 lsn 跳过, 不会重复应用.
+ * rbt_save_at 返回前已 fsync 目录, 截断日志时新快照的 rename 已落盘, 崩溃后不会只剩旧快照和空日志.
+ */
+int rbt_wal_checkpoint(RBWal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    rbt_wal_flush_locked(wal, true);
+
+    int ret = rbt_save_at(wal->tree, wal->snap_path, wal->next_lsn - 1);
+    if (ret == 0 && (ftruncate(wal->fd, 0) != 0 || lseek(wal->fd, 0, SEEK_SET) < 0 || fdatasync(wal->fd) != 0)) {
+        ret = -1;
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    return ret;
+}
+
+static int rbt_wal_collect(Data *data, void *arg) {
+    Data **cursor = arg;
+    *(*cursor)++ = *data;
+    return 0;
+}
+
+RBTree *rbt_recover(const char *path, CMP *cmp) {
+    char *snap_path = rbt_wal_path(path, ".snap");
+    char *log_path = rbt_wal_path(path, ".wal");
+    RBTree *tree = NULL;
+    uint64_t snap_lsn = 0;
+
+    RBMapped *mapped = rbt_open_mapped(snap_path);
+    if (mapped) {
+        if (!rbt_mapped_verify(mapped)) {
+            rbt_mapped_close(mapped);
+            goto out;
+        }
+
+        /* 快照按中序已排好, 直接 O(n) 建树 */
+        uint32_t n = rbt_mapped_size(mapped);
+        Data *items = malloc(sizeof(Data) * (n ? n : 1));
+        if (NULL == items) {
+            die("malloc recover items");
+        }
+        Data *cursor = items;
+        rbt_mapped_scan(mapped, NULL, NULL, cmp, rbt_wal_collect, &cursor);
+
+        uint32_t key_size = mapped->header->key_size;
+        tree = key_size ? rbt_rbtree_new_fixed(key_size, n) : rbt_rbtree_new();
+        rbt_build_sorted(tree, items, cursor - items, cmp);
+        snap_lsn = mapped->header->lsn;
+        free(items);
+        rbt_mapped_close(mapped);
+    } else if (errno != ENOENT) {
+        goto out;
+    } else {
+        tree = rbt_rbtree_new();
+    }
+
+    size_t len, off = 0;
+    char *log = rbt_wal_read(log_path, &len);
+    RBWalRecord rec;
+    Data key;
+    while (rbt_wal_next(log, len, &off, &rec, &key)) {
+        if (rec.lsn > snap_lsn) {
+            rbt_wal_apply(tree, cmp, rec.op_len & RBT_WAL_OP_MASK, &key);
+        }
+    }
+    free(log);
+
+out:
+    free(snap_path);
+    free(log_path);
+    return tree;
+}
@@ -0,0 +1,75 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+ * 预写日志: path.wal 为日志, path.snap 为最近一次检查点(mapped.h 格式).
+ * 每次写操作先修改树再追加一条记录, 按同步策略落盘;
+ * 多个线程同时提交时由一个线程代为写入并 fdatasync(group commit).
+ * 崩溃后用 rbt_recover 载入快照并重放其后的日志, 不完整的尾部记录被丢弃.
+ */
+#define RBT_WAL_BUF_LIMIT (1 << 16)  // 缓冲超过该大小时立即写出
+
+typedef enum RBSyncPolicy {
+    RBT_SYNC_EACH,      // 每次操作返回前已落盘
+    RBT_SYNC_INTERVAL,  // 后台线程每 interval_ms 落盘一次
+    RBT_SYNC_NONE       // 只 write, 由操作系统决定何时落盘
+} RBSyncPolicy;
+
+typedef enum RBWalOp {
+    RBT_WAL_INSERT = 1,
+    RBT_WAL_UPSERT = 2,
+    RBT_WAL_DELETE = 3
+} RBWalOp;
+
+typedef struct RBWalRecord {
+    uint32_t checksum;  // 其后头部字段和 key 的 FNV-1a 32
+    uint32_t op_len;    // 低 2 位为 RBWalOp, 其余为 key 长度
+    uint64_t lsn;
+} RBWalRecord;
+
+typedef struct RBWal {
+    RBTree *tree;
+    CMP *cmp;
+    char *log_path;
+    char *snap_path;
+    int fd;
+    RBSyncPolicy policy;
+    uint32_t interval_ms;
+
+    pthread_mutex_t lock;  // 同时保护树和缓冲
+    pthread_cond_t cond;
+    char *buf;    // 待写出的记录
+    char *spare;  // 写出期间与 buf 交换, 写入者不必等待 I/O; 此时只归写出线程使用
+    size_t len;
+    size_t cap;        // buf 的容量
+    size_t spare_cap;  // spare 的容量, 两者随交换一起互换
+    uint64_t next_lsn;
+    uint64_t written_lsn;  // 不大于它的记录已 write
+    uint64_t synced_lsn;   // 不大于它的记录已 fdatasync
+    bool flushing;
+    bool stop;
+    pthread_t flusher;
+
+    uint64_t records;  // 统计
+    uint64_t syncs;
+} RBWal;
+
+RBWal *rbt_wal_open(RBTree *tree, const char *path, CMP *cmp, RBSyncPolicy policy, uint32_t interval_ms);  // 截掉日志不完整的尾部后接着追加
+void rbt_wal_close(RBWal *wal);  // 写出并落盘剩余记录, 不释放 tree
+
+void rbt_wal_insert(RBWal *wal, Data *data);
+bool rbt_wal_upsert(RBWal *wal, Data *data);  // 返回是否新插入
+bool rbt_wal_delete(RBWal *wal, Data *data);
+void rbt_wal_sync(RBWal *wal);
+int rbt_wal_checkpoint(RBWal *wal);  // 写快照并清空日志, 期间阻塞写入; 失败返回 -1
+
+RBTree *rbt_recover(const char *path, CMP *cmp);  // 快照 + 日志尾部; 快照损坏时返回 NULL, 没有快照时返回普通变长 key 树
+
+#endif
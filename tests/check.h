@@ -0,0 +1,99 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rbtree.h"
+
+/* 测试公用的断言, 随机数和红黑性质检查; 各测试程序失败时以非 0 退出 */
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                               \
+        }                                                                          \
+    } while (0)
+
+static inline uint64_t check_rand(uint64_t *state) {
+    uint64_t x = (*state += 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* 在子进程中执行 fn, 确认它经 die() 以非 0 退出 */
+static inline void check_dies(void (*fn)(void)) {
+    fflush(NULL);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        fn();
+        _exit(0);
+    }
+
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) != 0);
+}
+
+static inline int check_key(Data *data) {
+    int key;
+    memcpy(&key, data->buffer, sizeof(key));
+    return key;
+}
+
+static inline int check_cmp(Data *src, Data *dest) {
+    int x = check_key(src), y = check_key(dest);
+    return (x > y) - (x < y);
+}
+
+/* 检查以 node 为根的子树: 父指针, 无红红相连, 中序有序, 各路径黑高相同; 返回黑高 */
+static inline int check_rb_node(RBNode *node, RBNode *parent, CMP *cmp) {
+    if (!node) return 1;
+
+    CHECK(node->parent == parent);
+    if (node->color == RED) {
+        CHECK(color_of(node->left) == BLACK && color_of(node->right) == BLACK);
+    }
+    if (node->left) CHECK(cmp(&node->left->data, &node->data) <= 0);
+    if (node->right) CHECK(cmp(&node->right->data, &node->data) >= 0);
+
+    int lh = check_rb_node(node->left, node, cmp);
+    int rh = check_rb_node(node->right, node, cmp);
+    CHECK(lh == rh);
+    return lh + (node->color == BLACK);
+}
+
+/* rbt_augment_count 维护的子树结点数; 返回子树大小 */
+static inline uint32_t check_counts(RBNode *node) {
+    if (!node) return 0;
+
+    uint32_t n = 1 + check_counts(node->left) + check_counts(node->right);
+    CHECK(node->count == n);
+    return n;
+}
+
+/* 整棵树的性质, 以及 size 和最值缓存 */
+static inline void check_rb_tree(RBTree *tree, CMP *cmp) {
+    CHECK(color_of(tree->root) == BLACK);
+    check_rb_node(tree->root, NULL, cmp);
+
+    uint32_t n = 0;
+    RBNode *prev = NULL;
+    for (RBNode *p = rbt_min(tree); p; p = rbt_successor(p)) {
+        if (prev) CHECK(cmp(&prev->data, &p->data) <= 0);
+        prev = p;
+        n++;
+    }
+    CHECK(n == tree->size);
+    CHECK(prev == rbt_max(tree));
+}
+
+#endif
@@ -0,0 +1,87 @@
+/* 子树计数增强: 随机增删(含重复 key)后 select/rank/count_range 与计数模型比对 */
+#include "check.h"
+
+#define KEYS 300
+#define ROUNDS 6000
+
+static uint32_t cnt[KEYS];  // 模型: 每个 key 的出现次数
+
+static void check_queries(RBTree *tree, uint64_t *rng) {
+    check_rb_tree(tree, check_cmp);
+    CHECK(check_counts(tree->root) == tree->size);
+
+    /* select: 按顺序展开模型逐个比对 */
+    uint32_t k = 0;
+    for (int key = 0; key < KEYS; key++) {
+        for (uint32_t c = 0; c < cnt[key]; c++, k++) {
+            RBNode *node = rbt_select(tree, k);
+            CHECK(node && check_key(&node->data) == key);
+        }
+    }
+    CHECK(k == tree->size && rbt_select(tree, k) == NULL);
+
+    for (int i = 0; i < 50; i++) {
+        int lo = check_rand(rng) % (KEYS + 2) - 1;
+        int hi = check_rand(rng) % (KEYS + 2) - 1;
+        Data dl = {&lo, sizeof(lo)}, dh = {&hi, sizeof(hi)};
+
+        uint32_t below = 0, in_range = 0;
+        for (int key = 0; key < KEYS; key++) {
+            if (key < lo) below += cnt[key];
+            if (key >= lo && key <= hi) in_range += cnt[key];
+        }
+        CHECK(rbt_rank(tree, &dl, check_cmp) == below);
+        CHECK(rbt_count_range(tree, &dl, &dh, check_cmp) == in_range);
+    }
+}
+
+static void run(RBTree *tree, uint64_t seed) {
+    uint64_t rng = seed;
+    memset(cnt, 0, sizeof(cnt));
+
+    /* 先插入一部分再打开增强, 覆盖 rbt_set_augment 对已有结点的重算 */
+    for (int i = 0; i < 200; i++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+        rbt_insert_data(tree, &d, check_cmp);
+        cnt[key]++;
+    }
+    rbt_set_augment(tree, rbt_augment_count);
+    check_queries(tree, &rng);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+        uint64_t r = check_rand(&rng) % 4;
+
+        if (r == 0 || cnt[key] == 0) {
+            rbt_insert_data(tree, &d, check_cmp);
+            cnt[key]++;
+        } else if (r == 1) {
+            rbt_delete_data(tree, &d, check_cmp);
+            cnt[key]--;
+        } else if (r == 2) {
+            /* 从最小值一侧弹出, 覆盖最值缓存路径 */
+            RBNode *node = rbt_pop_min(tree);
+            cnt[check_key(&node->data)]--;
+            rbt_tree_node_free(tree, node);
+        } else {
+            /* 按名次删除 */
+            RBNode *node = rbt_select(tree, check_rand(&rng) % tree->size);
+            cnt[check_key(&node->data)]--;
+            rbt_erase_node(tree, node);
+        }
+
+        if (round % 500 == 0) check_queries(tree, &rng);
+    }
+    check_queries(tree, &rng);
+    rbt_delete_tree(tree);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        run(rbt_rbtree_new(), seed);
+        run(rbt_rbtree_new_fixed(sizeof(int), 128), seed);
+    }
+    return 0;
+}
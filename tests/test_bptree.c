@@ -0,0 +1,195 @@
+/*
+ * B+ 树: 先增长再收缩的随机增删覆盖分裂, 借位与合并, 与模型比对;
+ * 检查结点容量, 叶子等深, 分隔 key 的界和叶子链表, 以及游标和区间扫描.
+ */
+#include "bptree.h"
+#include "check.h"
+
+#define KEYS 4096
+#define ROUNDS 40000
+
+typedef struct Rec {
+    int key;
+    int val;  // 不参与比较, 用来确认 upsert 替换了已有 key
+} Rec;
+
+typedef struct Checker {
+    BPTree *tree;
+    int leaf_depth;
+    BPNode *prev_leaf;
+    uint32_t count;
+} Checker;
+
+static Rec *bp_rec(BPTree *tree, BPNode *node, uint32_t i) {
+    unsigned char *keys = node->leaf ? node->body : node->body + (tree->inner_cap + 2) * sizeof(BPNode *);
+    return (Rec *)(keys + (size_t)i * tree->key_size);
+}
+
+/* 子树中的 key 都在 [lo, hi) 内, lo/hi 为空表示不设界 */
+static void bp_check(Checker *c, BPNode *node, int depth, Rec *lo, Rec *hi) {
+    BPTree *tree = c->tree;
+    if (node != tree->root) {
+        uint32_t cap = node->leaf ? tree->leaf_cap : tree->inner_cap;
+        CHECK(node->n >= cap / 2 && node->n <= cap);
+    }
+
+    for (uint32_t i = 0; i < node->n; i++) {
+        Rec *r = bp_rec(tree, node, i);
+        if (i) CHECK(bp_rec(tree, node, i - 1)->key < r->key);
+        if (lo) CHECK(r->key >= lo->key);
+        if (hi) CHECK(r->key < hi->key);
+    }
+
+    if (node->leaf) {
+        if (c->leaf_depth < 0) c->leaf_depth = depth;
+        CHECK(depth == c->leaf_depth);
+        CHECK(node->prev == c->prev_leaf);
+        if (c->prev_leaf) CHECK(c->prev_leaf->next == node);
+        c->prev_leaf = node;
+        c->count += node->n;
+        return;
+    }
+
+    BPNode **children = (BPNode **)node->body;
+    for (uint32_t i = 0; i <= node->n; i++) {
+        bp_check(c, children[i], depth + 1, i ? bp_rec(tree, node, i - 1) : lo, i < node->n ? bp_rec(tree, node, i) : hi);
+    }
+}
+
+static void bp_equal(BPTree *tree, int *model) {
+    Checker c = {tree, -1, NULL, 0};
+    bp_check(&c, tree->root, 0, NULL, NULL);
+    CHECK(c.prev_leaf->next == NULL);
+    CHECK(c.count == tree->size);
+
+    /* 游标按序走过的恰为模型中的 key 和最新的值 */
+    BPCursor cursor;
+    Data key;
+    int k = 0;
+    uint32_t live = 0;
+    for (bp_first(tree, &cursor); bp_cursor_get(tree, &cursor, &key); bp_cursor_next(&cursor)) {
+        Rec r;
+        memcpy(&r, key.buffer, sizeof(r));
+        while (k < r.key) CHECK(model[k++] < 0);
+        CHECK(model[k] == r.val);
+        k++;
+        live++;
+    }
+    while (k < KEYS) CHECK(model[k++] < 0);
+    CHECK(live == tree->size);
+}
+
+typedef struct ScanCtx {
+    int *model;
+    int next;  // 下一个应扫到的 key 不小于它
+    size_t n;
+    size_t limit;
+} ScanCtx;
+
+static int scan_one(Data *key, void *arg) {
+    ScanCtx *ctx = arg;
+    Rec r;
+    memcpy(&r, key->buffer, sizeof(r));
+    CHECK(r.key >= ctx->next);
+    while (ctx->next < r.key) CHECK(ctx->model[ctx->next++] < 0);
+    CHECK(ctx->model[r.key] == r.val);
+    ctx->next = r.key + 1;
+    return ++ctx->n == ctx->limit;
+}
+
+static void bp_queries(BPTree *tree, int *model, uint64_t *rng) {
+    /* lower_bound 对每个可能的查询值 */
+    int expect = KEYS;
+    for (int q = KEYS; q >= -1; q--) {
+        if (q >= 0 && q < KEYS && model[q] >= 0) expect = q;
+
+        Rec probe = {q, 0};
+        Data d = {&probe, sizeof(probe)};
+        BPCursor cursor;
+        Data key;
+        bp_lower_bound(tree, &d, check_cmp, &cursor);
+        if (expect == KEYS) {
+            CHECK(!bp_cursor_get(tree, &cursor, &key));
+        } else {
+            CHECK(bp_cursor_get(tree, &cursor, &key) && check_key(&key) == expect);
+        }
+
+        Data out;
+        bool hit = q >= 0 && q < KEYS && model[q] >= 0;
+        CHECK(bp_search(tree, &d, check_cmp, &out) == hit);
+        if (hit) CHECK(((Rec *)out.buffer)->val == model[q]);
+    }
+
+    /* 随机闭区间扫描, 有时不设界或提前停止 */
+    for (int round = 0; round < 32; round++) {
+        Rec lo = {(int)(check_rand(rng) % (KEYS + 2)) - 1, 0};
+        Rec hi = {lo.key + (int)(check_rand(rng) % 256), 0};
+        bool open_lo = round % 7 == 0, open_hi = round % 5 == 0;
+
+        size_t in_range = 0;
+        for (int k = open_lo ? 0 : (lo.key < 0 ? 0 : lo.key); k < KEYS && (open_hi || k <= hi.key); k++) {
+            in_range += model[k] >= 0;
+        }
+
+        ScanCtx ctx = {model, open_lo || lo.key < 0 ? 0 : lo.key, 0, round % 3 == 0 ? 5 : SIZE_MAX};
+        Data dlo = {&lo, sizeof(lo)}, dhi = {&hi, sizeof(hi)};
+        size_t count = bp_range_scan(tree, open_lo ? NULL : &dlo, open_hi ? NULL : &dhi, check_cmp, scan_one, &ctx);
+        size_t want = in_range < ctx.limit ? in_range : ctx.limit;
+        CHECK(count == want && ctx.n == want);
+    }
+}
+
+static void run(uint32_t node_bytes, uint64_t seed) {
+    BPTree *tree = bp_tree_new(sizeof(Rec), node_bytes);
+    int model[KEYS];  // key -> 值, -1 表示不存在
+    memset(model, -1, sizeof(model));
+    uint64_t rng = seed;
+
+    /* 前半段插入为主, 后半段删除为主, 直到接近删空 */
+    for (int round = 0; round < ROUNDS; round++) {
+        Rec r = {(int)(check_rand(&rng) % KEYS), round};
+        Data d = {&r, sizeof(r)};
+        bool grow = round < ROUNDS / 2;
+
+        if (check_rand(&rng) % 4 < (grow ? 3u : 1u)) {
+            CHECK(bp_upsert(tree, &d, check_cmp) == (model[r.key] < 0));
+            model[r.key] = r.val;
+        } else {
+            CHECK(bp_delete(tree, &d, check_cmp) == (model[r.key] >= 0));
+            model[r.key] = -1;
+        }
+
+        if (round % 256 == 0) bp_equal(tree, model);
+        if (round % 8192 == 0) bp_queries(tree, model, &rng);
+    }
+    bp_equal(tree, model);
+    bp_queries(tree, model, &rng);
+
+    /* 删空后树回到单个空叶子 */
+    for (int k = 0; k < KEYS; k++) {
+        Rec r = {k, 0};
+        Data d = {&r, sizeof(r)};
+        CHECK(bp_delete(tree, &d, check_cmp) == (model[k] >= 0));
+        model[k] = -1;
+        if (k % 512 == 0) bp_equal(tree, model);
+    }
+    CHECK(tree->size == 0 && tree->root->leaf && tree->root->n == 0);
+    bp_queries(tree, model, &rng);
+
+    bp_tree_free(tree);
+}
+
+static void zero_key_size(void) {
+    bp_tree_new(0, 0);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        run(64, seed);  // 很小的结点, 树很深
+        run(0, seed);   // 默认 256 字节
+        run(4096, seed);
+    }
+
+    check_dies(zero_key_size);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/* 紧凑结点树和下标树: 随机增删后与模型比对, 并经各自的颜色/父链接检查红黑性质 */
+#include "check.h"
+#include "compact.h"
+
+#define KEYS 1024
+#define ROUNDS 30000
+
+static int compact_check(RBCompactNode *node, RBCompactNode *parent) {
+    if (!node) return 1;
+
+    CHECK(rbt_compact_parent(node) == parent);
+    if (rbt_compact_color(node) == RED) {
+        CHECK(!node->left || rbt_compact_color(node->left) == BLACK);
+        CHECK(!node->right || rbt_compact_color(node->right) == BLACK);
+    }
+
+    int lh = compact_check(node->left, node);
+    int rh = compact_check(node->right, node);
+    CHECK(lh == rh);
+    return lh + (rbt_compact_color(node) == BLACK);
+}
+
+static void compact_equal(RBCompactTree *tree, RBCompactNode **nodes) {
+    CHECK(!tree->root || rbt_compact_color(tree->root) == BLACK);
+    compact_check(tree->root, NULL);
+
+    /* 中序严格递增, 且恰为模型中的 key, 结点地址不变 */
+    uint32_t n = 0;
+    int prev = -1;
+    for (RBCompactNode *p = rbt_compact_first(tree); p; p = rbt_compact_next(p)) {
+        Data key = rbt_compact_key(tree, p);
+        int k = check_key(&key);
+        CHECK(k > prev && k < KEYS && nodes[k] == p);
+        prev = k;
+        n++;
+    }
+    uint32_t live = 0;
+    for (int k = 0; k < KEYS; k++) live += nodes[k] != NULL;
+    CHECK(n == live && n == tree->size);
+}
+
+static void run_compact(uint64_t seed, uint32_t hint) {
+    RBCompactTree *tree = rbt_compact_new(sizeof(int), hint);
+    RBCompactNode *nodes[KEYS] = {0};
+    uint64_t rng = seed;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+
+        if (!nodes[key]) {
+            bool inserted;
+            nodes[key] = rbt_compact_upsert(tree, &d, check_cmp, &inserted);
+            CHECK(inserted);
+        } else if (round & 1) {
+            CHECK(rbt_compact_search(tree, &d, check_cmp) == nodes[key]);
+            rbt_compact_erase(tree, nodes[key]);
+            nodes[key] = NULL;
+        } else {
+            CHECK(rbt_compact_delete(tree, &d, check_cmp));
+            CHECK(!rbt_compact_delete(tree, &d, check_cmp));
+            nodes[key] = NULL;
+        }
+
+        if (round % 128 == 0) compact_equal(tree, nodes);
+    }
+    compact_equal(tree, nodes);
+    rbt_compact_free(tree);
+}
+
+static int index_check(RBIndexTree *tree, uint32_t i, uint32_t parent) {
+    if (!i) return 1;
+
+    RBIndexNode *node = (RBIndexNode *)(tree->nodes + (size_t)i * tree->stride);
+    Color color = node->parent_color & 1;
+    CHECK(i < tree->used && node->parent_color >> 1 == parent);
+    if (color == RED) {
+        RBIndexNode *l = (RBIndexNode *)(tree->nodes + (size_t)node->left * tree->stride);
+        RBIndexNode *r = (RBIndexNode *)(tree->nodes + (size_t)node->right * tree->stride);
+        CHECK(!node->left || (l->parent_color & 1) == BLACK);
+        CHECK(!node->right || (r->parent_color & 1) == BLACK);
+    }
+
+    int lh = index_check(tree, node->left, i);
+    int rh = index_check(tree, node->right, i);
+    CHECK(lh == rh);
+    return lh + (color == BLACK);
+}
+
+static void index_equal(RBIndexTree *tree, uint32_t *nodes) {
+    if (tree->root) {
+        RBIndexNode *root = (RBIndexNode *)(tree->nodes + (size_t)tree->root * tree->stride);
+        CHECK((root->parent_color & 1) == BLACK);
+    }
+    index_check(tree, tree->root, 0);
+
+    uint32_t n = 0;
+    int prev = -1;
+    for (uint32_t i = rbt_index_first(tree); i; i = rbt_index_next(tree, i)) {
+        Data key = rbt_index_key(tree, i);
+        int k = check_key(&key);
+        CHECK(k > prev && k < KEYS && nodes[k] == i);
+        prev = k;
+        n++;
+    }
+    uint32_t live = 0;
+    for (int k = 0; k < KEYS; k++) live += nodes[k] != 0;
+    CHECK(n == live && n == tree->size);
+}
+
+static void run_index(uint64_t seed) {
+    /* 初始容量很小, 插入过程中数组多次扩容 */
+    RBIndexTree *tree = rbt_index_new(sizeof(int), 0);
+    uint32_t nodes[KEYS] = {0};
+    uint64_t rng = seed;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+
+        if (!nodes[key]) {
+            bool inserted;
+            nodes[key] = rbt_index_upsert(tree, &d, check_cmp, &inserted);
+            CHECK(inserted && nodes[key]);
+        } else if (round & 1) {
+            CHECK(rbt_index_search(tree, &d, check_cmp) == nodes[key]);
+            rbt_index_erase(tree, nodes[key]);
+            nodes[key] = 0;
+        } else {
+            CHECK(rbt_index_delete(tree, &d, check_cmp));
+            CHECK(!rbt_index_delete(tree, &d, check_cmp));
+            nodes[key] = 0;
+        }
+
+        if (round % 128 == 0) index_equal(tree, nodes);
+    }
+    index_equal(tree, nodes);
+
+    /* 空闲链表里的下标被复用, 不会越过已切分的上界 */
+    uint32_t used = tree->used;
+    for (int k = 0; k < KEYS; k++) {
+        if (nodes[k]) {
+            rbt_index_erase(tree, nodes[k]);
+            nodes[k] = 0;
+        }
+    }
+    CHECK(tree->size == 0 && tree->root == 0);
+    for (int k = 0; k < (int)used - 1; k++) {
+        Data d = {&k, sizeof(k)};
+        nodes[k] = rbt_index_upsert(tree, &d, check_cmp, NULL);
+    }
+    CHECK(tree->used == used);
+    index_equal(tree, nodes);
+    rbt_index_free(tree);
+}
+
+/* 块大小超出 uint32_t 时报错, 而不是截断成一个很小的块 */
+static void compact_overflow(void) {
+    rbt_compact_new(1 << 20, 1 << 20);
+}
+
+static void compact_huge_key(void) {
+    rbt_compact_new(UINT32_MAX - 8, 0);
+}
+
+static void index_huge_key(void) {
+    rbt_index_new(UINT32_MAX - 8, 0);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 4; seed++) {
+        run_compact(seed, 0);
+        run_compact(seed, 4096);
+        run_index(seed);
+    }
+
+    check_dies(compact_overflow);
+    check_dies(compact_huge_key);
+    check_dies(index_huge_key);
+    rbt_compact_free(rbt_compact_new(64, 1 << 20));
+    return 0;
+}
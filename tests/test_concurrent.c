@@ -0,0 +1,144 @@
+/*
+ * 单写多读并发树: 写者随机 upsert/delete, 读者无锁查找并校验读到的记录完整;
+ * 读线程反复注册/归还槽位, 总注册次数远超 RBT_MAX_READERS. 结束后与模型比对.
+ * 另检查回收按批进行: 没有读者时每 RBT_CONC_RECLAIM_BATCH 次替换清空一次, 读者停留时待释放结点只积累不释放.
+ */
+#include <pthread.h>
+
+#include "check.h"
+#include "concurrent.h"
+
+#define KEYS 512
+#define WRITES 100000
+#define READERS 4
+#define SESSIONS 100  // 每个读线程注册的次数
+
+typedef struct Rec {
+    int key;
+    int val;
+    int sum;  // key ^ val, 撕裂的数据校验不过
+} Rec;
+
+static RBConcTree *ct;
+static int done;
+
+static void *reader(void *arg) {
+    uint64_t rng = (uintptr_t)arg;
+    for (int s = 0; s < SESSIONS || !__atomic_load_n(&done, __ATOMIC_ACQUIRE); s++) {
+        RBReader *r = rbt_conc_reader(ct);
+        for (int i = 0; i < 200; i++) {
+            Rec probe = {(int)(check_rand(&rng) % KEYS), 0, 0}, got;
+            Data d = {&probe, sizeof(probe)}, out = {&got, sizeof(got)};
+            if (rbt_conc_search(ct, r, &d, &out)) {
+                CHECK(got.key == probe.key && got.sum == (got.key ^ got.val));
+            }
+        }
+        rbt_conc_reader_release(ct, r);
+    }
+    return NULL;
+}
+
+static void too_many_readers(void) {
+    RBConcTree *t = rbt_conc_new(rbt_rbtree_new(), check_cmp);
+    for (int i = 0; i <= RBT_MAX_READERS; i++) rbt_conc_reader(t);
+}
+
+static void batched_reclaim(void) {
+    RBConcTree *t = rbt_conc_new(rbt_rbtree_new_pooled(64), check_cmp);
+    Rec rec = {1, 0, 1};
+    Data d = {&rec, sizeof(rec)};
+    CHECK(rbt_conc_upsert(t, &d));
+
+    for (int i = 0; i < 5 * RBT_CONC_RECLAIM_BATCH; i++) {
+        CHECK(!rbt_conc_upsert(t, &d));
+        CHECK(t->nlimbo == (uint32_t)(i + 1) % RBT_CONC_RECLAIM_BATCH);
+    }
+
+    /* 读者停在当前 epoch(相当于 rbt_conc_search 进入后被挂起): 之后替换下来的结点都不能释放 */
+    RBReader *r = rbt_conc_reader(t);
+    r->epoch = t->epoch;
+    uint32_t pinned = 0, reclaims = 0, last_at = t->reclaim_at;
+    for (int i = 0; i < 20 * RBT_CONC_RECLAIM_BATCH; i++) {
+        CHECK(!rbt_conc_upsert(t, &d));
+        pinned++;
+        CHECK(t->nlimbo == pinned);
+        if (t->reclaim_at != last_at) {
+            reclaims++;
+            CHECK(t->reclaim_at >= 2 * t->nlimbo);  // 下一次至少再攒同样多
+            last_at = t->reclaim_at;
+        }
+    }
+    CHECK(reclaims > 0 && reclaims <= 5);
+
+    /* 读者离开后, 下一次回收把它们全部释放 */
+    rbt_conc_reader_release(t, r);
+    while (t->nlimbo) {
+        CHECK(t->nlimbo < t->reclaim_at);
+        CHECK(!rbt_conc_upsert(t, &d));
+    }
+    PoolStats st;
+    pool_stats(t->tree->pool, &st);
+    CHECK(t->tree->size == 1 && st.live == 2);  // 只剩树中结点和它的 key
+    rbt_conc_free(t);
+}
+
+int main(void) {
+    batched_reclaim();
+    ct = rbt_conc_new(rbt_rbtree_new(), check_cmp);
+    int model[KEYS];
+    memset(model, -1, sizeof(model));
+
+    pthread_t tids[READERS];
+    for (uintptr_t t = 0; t < READERS; t++) {
+        CHECK(pthread_create(&tids[t], NULL, reader, (void *)(t + 1)) == 0);
+    }
+
+    uint64_t rng = 42;
+    for (int i = 0; i < WRITES; i++) {
+        Rec rec = {(int)(check_rand(&rng) % KEYS), i, 0};
+        rec.sum = rec.key ^ rec.val;
+        /* 偶尔写入更长的记录, 覆盖大小变化的替换 */
+        unsigned char buf[sizeof(Rec) + 8] = {0};
+        memcpy(buf, &rec, sizeof(rec));
+        Data d = {buf, i % 5 == 0 ? (uint32_t)sizeof(buf) : (uint32_t)sizeof(rec)};
+
+        if (check_rand(&rng) % 3) {
+            CHECK(rbt_conc_upsert(ct, &d) == (model[rec.key] < 0));
+            model[rec.key] = i;
+        } else {
+            CHECK(rbt_conc_delete(ct, &d) == (model[rec.key] >= 0));
+            model[rec.key] = -1;
+        }
+        if (i % 1000 == 0) {
+            Rec ins = {KEYS + i, i, (KEYS + i) ^ i};
+            Data di = {&ins, sizeof(ins)};
+            rbt_conc_insert(ct, &di);
+            CHECK(rbt_conc_delete(ct, &di));
+        }
+    }
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    for (int t = 0; t < READERS; t++) pthread_join(tids[t], NULL);
+
+    /* 读者都已归还槽位, 可以重新占满 */
+    for (int i = 0; i < RBT_MAX_READERS; i++) CHECK(rbt_conc_reader(ct) == &ct->readers[i]);
+
+    check_rb_tree(ct->tree, check_cmp);
+    uint32_t live = 0;
+    for (int k = 0; k < KEYS; k++) {
+        Rec probe = {k, 0, 0};
+        Data d = {&probe, sizeof(probe)};
+        RBNode *node = rbt_search_node(ct->tree, &d, check_cmp);
+        CHECK((node != NULL) == (model[k] >= 0));
+        if (node) {
+            Rec got;
+            memcpy(&got, node->data.buffer, sizeof(got));
+            CHECK(got.val == model[k]);
+            live++;
+        }
+    }
+    CHECK(live == ct->tree->size);
+    rbt_conc_free(ct);
+
+    check_dies(too_many_readers);
+    return 0;
+}
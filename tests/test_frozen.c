@@ -0,0 +1,155 @@
+/* 冻结布局: 各种大小的随机 key 集合上, 查找/遍历/区间扫描与有序数组模型比对, 再解冻检查 */
+#include "check.h"
+#include "frozen.h"
+
+typedef struct ScanCtx {
+    int *keys;  // 期望依次扫到的 key
+    size_t n;
+    size_t limit;  // 扫到第 limit 个时让回调返回非 0
+} ScanCtx;
+
+static int scan_one(Data *key, void *arg) {
+    ScanCtx *ctx = arg;
+    CHECK(ctx->n < ctx->limit && check_key(key) == ctx->keys[ctx->n]);
+    ctx->n++;
+    return ctx->n == ctx->limit;
+}
+
+/* 模型: 有序的 keys[0..n), 取值为偶数, 奇数用来测未命中 */
+static void run(uint32_t n, uint64_t seed, bool fixed) {
+    uint64_t rng = seed;
+    RBTree *tree = fixed ? rbt_rbtree_new_fixed(sizeof(int), 0) : rbt_rbtree_new();
+    int *keys = malloc(sizeof(int) * (n + 1));
+    CHECK(keys);
+
+    /* 0, 2, 4, ... 中随机取 n 个, 打乱顺序插入 */
+    int next = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        next += 2 * (1 + check_rand(&rng) % 3);
+        keys[i] = next;
+    }
+    int *order = malloc(sizeof(int) * (n + 1));
+    CHECK(order);
+    memcpy(order, keys, sizeof(int) * n);
+    for (uint32_t i = n; i > 1; i--) {
+        uint32_t j = check_rand(&rng) % i;
+        int t = order[j];
+        order[j] = order[i - 1];
+        order[i - 1] = t;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        Data d = {&order[i], sizeof(int)};
+        rbt_insert_data(tree, &d, check_cmp);
+    }
+    free(order);
+
+    RBFrozen *frozen = rbt_freeze(tree, check_cmp);
+    CHECK(frozen && frozen->n == n);
+    rbt_delete_tree(tree);
+
+    /* 按位置遍历恰为有序 key */
+    uint32_t i = 0;
+    for (uint32_t k = rbt_frozen_first(frozen); k; k = rbt_frozen_next(frozen, k)) {
+        CHECK(i < n);
+        Data key = rbt_frozen_key(frozen, k);
+        CHECK(check_key(&key) == keys[i]);
+        i++;
+    }
+    CHECK(i == n);
+
+    /* 每个可能的查询值: lower_bound 对应第一个不小于它的 key */
+    int hi_key = n ? keys[n - 1] + 2 : 2;
+    uint32_t lb = 0;
+    for (int q = -1; q <= hi_key; q++) {
+        while (lb < n && keys[lb] < q) lb++;
+        Data d = {&q, sizeof(q)};
+        uint32_t k = rbt_frozen_lower_bound(frozen, &d);
+        if (lb == n) {
+            CHECK(k == 0);
+        } else {
+            Data key = rbt_frozen_key(frozen, k);
+            CHECK(k && check_key(&key) == keys[lb]);
+        }
+
+        Data out = {NULL, 0};
+        bool hit = lb < n && keys[lb] == q;
+        CHECK(rbt_frozen_search(frozen, &d, &out) == hit);
+        if (hit) CHECK(check_key(&out) == q);
+    }
+
+    /* 随机闭区间扫描, 有时提前停止 */
+    for (int round = 0; round < 64; round++) {
+        int lo = (int)(check_rand(&rng) % (hi_key + 2)) - 1;
+        int hi = lo + (int)(check_rand(&rng) % 64);
+        bool open_lo = round % 7 == 0, open_hi = round % 5 == 0;
+
+        uint32_t from = 0, to = 0;
+        while (from < n && !open_lo && keys[from] < lo) from++;
+        to = from;
+        while (to < n && (open_hi || keys[to] <= hi)) to++;
+
+        ScanCtx ctx = {keys + from, 0, round % 3 == 0 ? 3 : SIZE_MAX};
+        Data dlo = {&lo, sizeof(lo)}, dhi = {&hi, sizeof(hi)};
+        size_t count = rbt_frozen_scan(frozen, open_lo ? NULL : &dlo, open_hi ? NULL : &dhi, scan_one, &ctx);
+        size_t expect = to - from < ctx.limit ? to - from : ctx.limit;
+        CHECK(count == expect && ctx.n == expect);
+    }
+
+    /* 解冻后为合法的红黑树, 内容不变 */
+    RBTree *thawed = rbt_thaw(frozen);
+    check_rb_tree(thawed, check_cmp);
+    CHECK(thawed->size == n && thawed->key_size == (n || fixed ? sizeof(int) : 0));
+    i = 0;
+    for (RBNode *p = rbt_min(thawed); p; p = rbt_successor(p)) CHECK(check_key(&p->data) == keys[i++]);
+    if (n == 0) {
+        int key = 7;
+        Data d = {&key, sizeof(key)};
+        rbt_insert_data(thawed, &d, check_cmp);
+        CHECK(thawed->size == 1);
+    }
+    rbt_delete_tree(thawed);
+
+    rbt_frozen_free(frozen);
+    free(keys);
+}
+
+/* n 超过 2^31 时孩子下标超出 uint32; first/next 只做下标运算, 不访问 key, 可以直接构造 */
+static void huge_index(void) {
+    RBFrozen full = {NULL, UINT32_MAX, sizeof(int), check_cmp};  // 32 层满树
+    CHECK(rbt_frozen_first(&full) == 1u << 31);
+    CHECK(rbt_frozen_next(&full, 1u << 31) == 1u << 30);
+    CHECK(rbt_frozen_next(&full, (1u << 31) + 1) == 1u << 29);
+    CHECK(rbt_frozen_next(&full, 1) == 3u << 30);
+    CHECK(rbt_frozen_next(&full, UINT32_MAX - 1) == (UINT32_MAX >> 1));
+    CHECK(rbt_frozen_next(&full, UINT32_MAX) == 0);
+
+    RBFrozen part = {NULL, (1u << 31) + 5, sizeof(int), check_cmp};
+    CHECK(rbt_frozen_first(&part) == 1u << 31);
+    CHECK(rbt_frozen_next(&part, 1u << 31) == 1u << 30);
+    CHECK(rbt_frozen_next(&part, 1u << 30) == (1u << 31) + 1);
+    CHECK(rbt_frozen_next(&part, (1u << 30) + 4) == (1u << 29) + 2);  // 孩子超出 n 的左孩子, 后继为父结点
+    CHECK(rbt_frozen_next(&part, (1u << 31) - 1) == 0);
+}
+
+int main(void) {
+    huge_index();
+    for (uint32_t n = 0; n <= 70; n++) {
+        run(n, n + 1, false);
+        run(n, n + 1, true);
+    }
+    run(1000, 1, false);
+    run(4095, 2, true);
+    run(4096, 3, false);
+    run(4097, 4, true);
+
+    /* key 长度不一致时不能冻结 */
+    RBTree *tree = rbt_rbtree_new();
+    int a = 1;
+    int64_t b = 2;
+    Data da = {&a, sizeof(a)}, db = {&b, sizeof(b)};
+    rbt_insert_data(tree, &da, check_cmp);
+    rbt_insert_data(tree, &db, check_cmp);
+    CHECK(rbt_freeze(tree, check_cmp) == NULL);
+    rbt_delete_tree(tree);
+    return 0;
+}
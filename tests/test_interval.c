@@ -0,0 +1,112 @@
+/* 区间树: 随机增删后 max 字段, 重叠查询和任一重叠查询与暴力扫描比对 */
+#include <stdbool.h>
+
+#include "check.h"
+#include "interval.h"
+
+#define SLOTS 400
+#define ROUNDS 4000
+#define SPAN 1000
+
+typedef struct Item {
+    RBInterval iv;
+    int id;  // 负载, 确认查询返回的是正确结点
+} Item;
+
+static Item items[SLOTS];
+static bool live[SLOTS];
+
+/* 检查 max 并返回子树中最大的 end */
+static int64_t check_max(RBNode *node) {
+    if (!node) return INT64_MIN;
+
+    int64_t max = rbt_interval_of(node)->end;
+    int64_t l = check_max(node->left), r = check_max(node->right);
+    if (l > max) max = l;
+    if (r > max) max = r;
+    CHECK(rbt_interval_of(node)->max == max);
+    return max;
+}
+
+typedef struct Seen {
+    bool hit[SLOTS];
+    int64_t last_start;
+    size_t n;
+} Seen;
+
+static int collect(RBNode *node, void *arg) {
+    Seen *seen = arg;
+    Item *item = node->data.buffer;
+    CHECK(item->iv.start >= seen->last_start);  // 按 start 升序
+    seen->last_start = item->iv.start;
+    CHECK(!seen->hit[item->id]);
+    seen->hit[item->id] = true;
+    seen->n++;
+    return 0;
+}
+
+static bool overlaps(Item *item, int64_t start, int64_t end) {
+    return item->iv.start <= end && item->iv.end >= start;
+}
+
+static void check_queries(RBTree *tree, uint64_t *rng) {
+    check_rb_tree(tree, rbt_interval_cmp);
+    check_max(tree->root);
+
+    for (int q = 0; q < 40; q++) {
+        int64_t start = (int64_t)(check_rand(rng) % (SPAN + 200)) - 100;
+        int64_t end = start + (int64_t)(check_rand(rng) % 120);
+
+        Seen seen = {.last_start = INT64_MIN};
+        size_t n = rbt_interval_overlaps(tree, start, end, collect, &seen);
+        CHECK(n == seen.n);
+
+        size_t expect = 0;
+        for (int i = 0; i < SLOTS; i++) {
+            bool hit = live[i] && overlaps(&items[i], start, end);
+            CHECK(seen.hit[i] == hit);
+            expect += hit;
+        }
+        CHECK(n == expect);
+
+        RBNode *any = rbt_interval_any_overlap(tree, start, end);
+        if (expect) {
+            CHECK(any && overlaps(any->data.buffer, start, end));
+        } else {
+            CHECK(any == NULL);
+        }
+    }
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        uint64_t rng = seed;
+        RBTree *tree = rbt_interval_tree_new(sizeof(Item), seed == 1 ? 0 : 64);
+        memset(live, 0, sizeof(live));
+
+        for (int round = 0; round < ROUNDS; round++) {
+            int i = check_rand(&rng) % SLOTS;
+            Data d = {&items[i], sizeof(Item)};
+            if (live[i]) {
+                rbt_delete_data(tree, &d, rbt_interval_cmp);
+                live[i] = false;
+            } else {
+                /* 长短区间混合, 让 max 来自不同深度; 避免与已有区间完全相同 */
+                int64_t start = check_rand(&rng) % SPAN;
+                int64_t len = check_rand(&rng) % 8 == 0 ? check_rand(&rng) % 300 : check_rand(&rng) % 10;
+                items[i] = (Item){{start, start + len, 0}, i};
+                bool dup = false;
+                for (int j = 0; j < SLOTS; j++) {
+                    dup |= j != i && live[j] && rbt_interval_cmp(&d, &(Data){&items[j], sizeof(Item)}) == 0;
+                }
+                if (dup) continue;
+                rbt_insert_data(tree, &d, rbt_interval_cmp);
+                live[i] = true;
+            }
+            if (round % 200 == 0) check_queries(tree, &rng);
+        }
+        check_queries(tree, &rng);
+        rbt_delete_tree(tree);
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+/* join/split 与集合运算: 随机集合与位图模型比对, 检查红黑性质和子树计数 */
+#include <stdbool.h>
+
+#include "check.h"
+#include "join.h"
+
+#define KEYS 2048
+
+static RBTree *build(RBTree *like, bool *model, uint64_t *rng, int percent) {
+    RBTree *tree = like ? rbt_rbtree_new_like(like) : rbt_rbtree_new_pooled(64);
+    for (int k = 0; k < KEYS; k++) {
+        model[k] = (int)(check_rand(rng) % 100) < percent;
+        if (model[k]) {
+            Data d = {&k, sizeof(k)};
+            rbt_insert_data(tree, &d, check_cmp);
+        }
+    }
+    return tree;
+}
+
+static void check_tree(RBTree *tree, bool *model) {
+    check_rb_tree(tree, check_cmp);
+    if (tree->augment == rbt_augment_count) check_counts(tree->root);
+
+    RBNode *p = rbt_min(tree);
+    for (int k = 0; k < KEYS; k++) {
+        if (!model[k]) continue;
+        CHECK(p && check_key(&p->data) == k);
+        p = rbt_successor(p);
+    }
+    CHECK(p == NULL);
+}
+
+static void set_ops(uint64_t seed, bool counted) {
+    bool ma[KEYS], mb[KEYS];
+    uint64_t rng = seed;
+    /* 密度差别大时两棵树黑高相差较多, 覆盖 join 沿脊下降的路径 */
+    int pa = 1 + check_rand(&rng) % 99, pb = 1 + check_rand(&rng) % 99;
+
+    for (int op = 0; op < 3; op++) {
+        RBTree *a = build(NULL, ma, &rng, pa);
+        if (counted) rbt_set_augment(a, rbt_augment_count);
+        RBTree *b = build(a, mb, &rng, pb);
+
+        if (op == 0) {
+            rbt_union(a, b, check_cmp);
+            for (int k = 0; k < KEYS; k++) ma[k] = ma[k] || mb[k];
+        } else if (op == 1) {
+            rbt_intersection(a, b, check_cmp);
+            for (int k = 0; k < KEYS; k++) ma[k] = ma[k] && mb[k];
+        } else {
+            rbt_difference(a, b, check_cmp);
+            for (int k = 0; k < KEYS; k++) ma[k] = ma[k] && !mb[k];
+        }
+        check_tree(a, ma);
+        CHECK(b->size == 0 && b->root == NULL);
+        rbt_delete_tree(b);
+        rbt_delete_tree(a);
+    }
+}
+
+static void split_join(uint64_t seed, bool counted) {
+    bool model[KEYS], lo_model[KEYS], hi_model[KEYS];
+    uint64_t rng = seed;
+    RBTree *tree = build(NULL, model, &rng, 1 + check_rand(&rng) % 99);
+    if (counted) rbt_set_augment(tree, rbt_augment_count);
+
+    for (int round = 0; round < 20; round++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+        RBTree *lo, *hi;
+        rbt_split(tree, &d, check_cmp, &lo, &hi);
+
+        for (int k = 0; k < KEYS; k++) {
+            lo_model[k] = model[k] && k < key;
+            hi_model[k] = model[k] && k >= key;
+        }
+        CHECK(tree->size == 0 && tree->root == NULL);
+        check_tree(lo, lo_model);
+        check_tree(hi, hi_model);
+
+        /* 以 hi 的最小结点为枢轴接回 */
+        RBNode *pivot = rbt_pop_min(hi);
+        if (pivot) rbt_join(lo, pivot, hi);
+        check_tree(lo, model);
+        CHECK(hi->size == 0);
+
+        rbt_delete_tree(tree);
+        rbt_delete_tree(hi);
+        tree = lo;
+    }
+    rbt_delete_tree(tree);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 20; seed++) {
+        set_ops(seed, false);
+        set_ops(seed, true);
+        split_join(seed, false);
+        split_join(seed, true);
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * 有序映射: 同一串随机 upsert/search/delete/区间扫描同时作用于红黑树和 B+ 树两个引擎,
+ * 每步比较两者的返回值和取出的记录, 并与模型比对; 扫描比较完整的输出序列及提前停止.
+ */
+#include "check.h"
+#include "map.h"
+
+#define KEYS 2048
+#define ROUNDS 30000
+
+typedef struct Rec {
+    int key;
+    int val;  // 不参与比较, 用来确认 upsert 替换了已有 key
+} Rec;
+
+typedef struct Collect {
+    Rec out[KEYS];
+    size_t n;
+    size_t limit;  // 收到 limit 条后停止
+} Collect;
+
+static int collect(Data *data, void *arg) {
+    Collect *c = arg;
+    CHECK(data->buffer_type == sizeof(Rec) && c->n < KEYS);
+    memcpy(&c->out[c->n], data->buffer, sizeof(Rec));
+    return ++c->n == c->limit;
+}
+
+/* 两个引擎扫描 [lo, hi] 的结果相同, 且与模型一致 */
+static void scan_both(RBMap *maps[2], const int *model, int lo, int hi, size_t limit) {
+    static Collect c[2];
+    Rec rlo = {lo, 0}, rhi = {hi, 0};
+    Data dlo = {&rlo, sizeof(rlo)}, dhi = {&rhi, sizeof(rhi)};
+    size_t ret[2];
+    for (int e = 0; e < 2; e++) {
+        c[e].n = 0;
+        c[e].limit = limit;
+        ret[e] = rbt_map_scan(maps[e], lo < 0 ? NULL : &dlo, hi < 0 ? NULL : &dhi, collect, &c[e]);
+        CHECK(ret[e] == c[e].n);
+    }
+    CHECK(ret[0] == ret[1] && memcmp(c[0].out, c[1].out, ret[0] * sizeof(Rec)) == 0);
+
+    size_t n = 0;
+    for (int k = lo < 0 ? 0 : lo; k <= (hi < 0 ? KEYS - 1 : hi) && n < limit; k++) {
+        if (model[k] < 0) continue;
+        CHECK(n < ret[0] && c[0].out[n].key == k && c[0].out[n].val == model[k]);
+        n++;
+    }
+    CHECK(n == ret[0]);
+}
+
+static void run(uint32_t node_hint, uint64_t seed) {
+    RBMap *maps[2] = {
+        rbt_map_new(RBT_ENGINE_RB, sizeof(Rec), node_hint, check_cmp),
+        rbt_map_new(RBT_ENGINE_BPLUS, sizeof(Rec), 0, check_cmp),
+    };
+    CHECK(maps[0]->engine == RBT_ENGINE_RB && maps[1]->engine == RBT_ENGINE_BPLUS);
+    static int model[KEYS];
+    memset(model, -1, sizeof(model));
+    uint32_t live = 0;
+    uint64_t rng = seed;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t r = check_rand(&rng);
+        /* 前半段偏向插入, 后半段偏向删除, 两个引擎都经历增长和收缩 */
+        int grow = round < ROUNDS / 2 ? 6 : 3;
+        Rec rec = {(int)((r >> 8) % KEYS), round};
+        Data d = {&rec, sizeof(rec)};
+        bool ret[2];
+
+        switch (r % 10 < (uint64_t)grow ? 0 : r % 10 == 9 ? 3 : r % 2 ? 1 : 2) {
+            case 0:
+                for (int e = 0; e < 2; e++) ret[e] = rbt_map_upsert(maps[e], &d);
+                CHECK(ret[0] == ret[1] && ret[0] == (model[rec.key] < 0));
+                live += ret[0];
+                model[rec.key] = round;
+                break;
+            case 1: {
+                Data out[2];
+                for (int e = 0; e < 2; e++) ret[e] = rbt_map_search(maps[e], &d, &out[e]);
+                CHECK(ret[0] == ret[1] && ret[0] == (model[rec.key] >= 0));
+                if (ret[0]) {
+                    CHECK(out[0].buffer_type == sizeof(Rec) && out[1].buffer_type == sizeof(Rec));
+                    CHECK(memcmp(out[0].buffer, out[1].buffer, sizeof(Rec)) == 0);
+                    CHECK(((Rec *)out[0].buffer)->val == model[rec.key]);
+                }
+                CHECK(rbt_map_search(maps[round % 2], &d, NULL) == ret[0]);
+                break;
+            }
+            case 2:
+                for (int e = 0; e < 2; e++) ret[e] = rbt_map_delete(maps[e], &d);
+                CHECK(ret[0] == ret[1] && ret[0] == (model[rec.key] >= 0));
+                live -= ret[0];
+                model[rec.key] = -1;
+                break;
+            default: {
+                int lo = (int)(check_rand(&rng) % (KEYS + 1)) - 1, hi = lo + (int)(check_rand(&rng) % 200);
+                if (hi >= KEYS) hi = -1;
+                scan_both(maps, model, lo, hi, r % 3 ? SIZE_MAX : 1 + (r >> 32) % 20);
+            }
+        }
+        CHECK(rbt_map_size(maps[0]) == live && rbt_map_size(maps[1]) == live);
+    }
+
+    scan_both(maps, model, -1, -1, SIZE_MAX);
+    Rec rlo = {KEYS / 2, 0}, rhi = {KEYS / 4, 0};
+    Data dlo = {&rlo, sizeof(rlo)}, dhi = {&rhi, sizeof(rhi)};
+    for (int e = 0; e < 2; e++) CHECK(rbt_map_scan(maps[e], &dlo, &dhi, collect, &(Collect){.limit = SIZE_MAX}) == 0);
+
+    rbt_map_free(maps[0]);
+    rbt_map_free(maps[1]);
+}
+
+int main(void) {
+    run(0, 1);
+    run(256, 2);
+    rbt_map_free(NULL);
+    return 0;
+}
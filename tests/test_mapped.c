@@ -0,0 +1,190 @@
+/*
+ * 映射快照: 长短不一的 key 保存后按原样查找和区间扫描, 文件大小不随最长 key 膨胀;
+ * 校验和不符, 文件被截断, 孩子下标越界或成环, key 越出 key 区时都不会越界访问.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "mapped.h"
+
+#define KEYS 600
+#define LONG_KEY 4000  // 一个很长的 key, 不应把其他记录撑大
+
+typedef struct ScanCtx {
+    int next;  // 下一个应扫到的 key
+    size_t n;
+    size_t limit;
+} ScanCtx;
+
+static int scan_one(Data *key, void *arg) {
+    ScanCtx *ctx = arg;
+    CHECK(check_key(key) == ctx->next);
+    ctx->next += 2;
+    return ++ctx->n == ctx->limit;
+}
+
+static int scan_count(Data *key, void *arg) {
+    (void)key;
+    (*(size_t *)arg)++;
+    return 0;
+}
+
+/* key i 的长度: 大多很短, 偶尔较长, 一个特别长 */
+static uint32_t key_len(int k) {
+    if (k == 2 * (KEYS / 2)) return LONG_KEY;
+    return sizeof(int) + (k % 7 == 0 ? 100 : k % 13);
+}
+
+static void fill_key(unsigned char *buf, int k) {
+    memcpy(buf, &k, sizeof(k));
+    for (uint32_t i = sizeof(k); i < key_len(k); i++) buf[i] = (unsigned char)(k + i);
+}
+
+static uint64_t file_size(const char *path) {
+    struct stat st;
+    CHECK(stat(path, &st) == 0);
+    return st.st_size;
+}
+
+static void patch(const char *path, uint64_t off, const void *buf, size_t len) {
+    int fd = open(path, O_WRONLY);
+    CHECK(fd >= 0 && pwrite(fd, buf, len, off) == (ssize_t)len);
+    close(fd);
+}
+
+/* 被破坏的文件上查找和扫描所有 key 只需不越界并能结束 */
+static void probe_all(RBMapped *mapped) {
+    for (int k = -1; k <= 2 * KEYS; k++) {
+        Data d = {&k, sizeof(k)}, out;
+        if (rbt_mapped_search(mapped, &d, check_cmp, &out)) CHECK(check_key(&out) == k);
+    }
+    size_t n = 0;
+    CHECK(rbt_mapped_scan(mapped, NULL, NULL, check_cmp, scan_count, &n) == n && n <= KEYS);
+}
+
+static void round_trip(const char *path) {
+    RBTree *tree = rbt_rbtree_new();
+    unsigned char buf[LONG_KEY];
+    uint64_t key_bytes = 0;
+    for (int i = 0; i < KEYS; i++) {
+        int k = 2 * ((i * 7919) % KEYS);  // 乱序插入 0, 2, ..., 2(KEYS-1)
+        fill_key(buf, k);
+        Data d = {buf, key_len(k)};
+        rbt_insert_data(tree, &d, check_cmp);
+        key_bytes += (key_len(k) + 7) & ~7u;
+    }
+    CHECK(rbt_save(tree, path) == 0);
+    rbt_delete_tree(tree);
+
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    CHECK(access(tmp, F_OK) != 0);
+    CHECK(file_size(path) == sizeof(RBFileHeader) + KEYS * sizeof(RBFileNode) + key_bytes);
+
+    RBMapped *mapped = rbt_open_mapped(path);
+    CHECK(mapped && rbt_mapped_verify(mapped) && rbt_mapped_size(mapped) == KEYS);
+    CHECK(mapped->header->key_size == 0);
+
+    for (int k = -1; k <= 2 * KEYS; k++) {
+        Data d = {&k, sizeof(k)}, out;
+        bool hit = k >= 0 && k < 2 * KEYS && k % 2 == 0;
+        CHECK(rbt_mapped_search(mapped, &d, check_cmp, &out) == hit);
+        if (hit) {
+            fill_key(buf, k);
+            CHECK(out.buffer_type == key_len(k) && memcmp(out.buffer, buf, key_len(k)) == 0);
+        }
+    }
+
+    ScanCtx all = {0, 0, SIZE_MAX};
+    CHECK(rbt_mapped_scan(mapped, NULL, NULL, check_cmp, scan_one, &all) == KEYS && all.next == 2 * KEYS);
+
+    int lo = 101, hi = 300;
+    Data dlo = {&lo, sizeof(lo)}, dhi = {&hi, sizeof(hi)};
+    ScanCtx part = {102, 0, SIZE_MAX};
+    CHECK(rbt_mapped_scan(mapped, &dlo, &dhi, check_cmp, scan_one, &part) == 100 && part.next == 302);
+
+    ScanCtx stop = {0, 0, 5};
+    CHECK(rbt_mapped_scan(mapped, NULL, &dhi, check_cmp, scan_one, &stop) == 5);
+    rbt_mapped_close(mapped);
+}
+
+static void empty_and_fixed(const char *path) {
+    RBTree *tree = rbt_rbtree_new_fixed(sizeof(int), 0);
+    CHECK(rbt_save_at(tree, path, 42) == 0);
+    RBMapped *mapped = rbt_open_mapped(path);
+    CHECK(mapped && rbt_mapped_verify(mapped) && rbt_mapped_size(mapped) == 0);
+    CHECK(mapped->header->lsn == 42 && mapped->header->key_size == sizeof(int));
+    int k = 0;
+    Data d = {&k, sizeof(k)};
+    CHECK(!rbt_mapped_search(mapped, &d, check_cmp, NULL));
+    rbt_mapped_close(mapped);
+
+    for (k = 0; k < 100; k++) rbt_insert_data(tree, &d, check_cmp);
+    CHECK(rbt_save(tree, path) == 0);
+    CHECK(file_size(path) == sizeof(RBFileHeader) + 100 * (sizeof(RBFileNode) + 8));
+    rbt_delete_tree(tree);
+}
+
+static void corrupted(const char *path) {
+    uint64_t size = file_size(path);
+    uint64_t nodes = sizeof(RBFileHeader);
+    RBMapped *mapped;
+
+    /* key 区中的一个字节: 头部完好可以打开, 整体校验失败 */
+    unsigned char byte = 0x5a;
+    patch(path, size - 1, &byte, 1);
+    mapped = rbt_open_mapped(path);
+    CHECK(mapped && !rbt_mapped_verify(mapped));
+    rbt_mapped_close(mapped);
+
+    /* 孩子下标越界, 以及指回根形成环 */
+    uint32_t bad[] = {KEYS + 5, RBT_FILE_NIL - 1, 0};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        patch(path, nodes + offsetof(RBFileNode, left), &bad[i], sizeof(bad[i]));
+        patch(path, nodes + sizeof(RBFileNode) + offsetof(RBFileNode, right), &bad[i], sizeof(bad[i]));
+        mapped = rbt_open_mapped(path);
+        CHECK(mapped && !rbt_mapped_verify(mapped));
+        probe_all(mapped);
+        rbt_mapped_close(mapped);
+    }
+
+    /* key 越出 key 区 */
+    uint64_t off = UINT64_MAX - 2;
+    uint32_t len = UINT32_MAX;
+    patch(path, nodes + 2 * sizeof(RBFileNode) + offsetof(RBFileNode, key_off), &off, sizeof(off));
+    patch(path, nodes + 3 * sizeof(RBFileNode) + offsetof(RBFileNode, key_len), &len, sizeof(len));
+    mapped = rbt_open_mapped(path);
+    CHECK(mapped);
+    probe_all(mapped);
+    rbt_mapped_close(mapped);
+
+    /* 截断: 长度与头部不符, 或连头部都不完整 */
+    CHECK(truncate(path, size - 1) == 0);
+    errno = 0;
+    CHECK(!rbt_open_mapped(path) && errno == EINVAL);
+    CHECK(truncate(path, sizeof(RBFileHeader) - 1) == 0);
+    errno = 0;
+    CHECK(!rbt_open_mapped(path) && errno == EINVAL);
+
+    /* 魔数不对 */
+    CHECK(truncate(path, 0) == 0 && truncate(path, sizeof(RBFileHeader)) == 0);
+    CHECK(!rbt_open_mapped(path) && errno == EINVAL);
+}
+
+int main(void) {
+    char path[] = "/tmp/rbt_mapped_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    round_trip(path);
+    corrupted(path);
+    empty_and_fixed(path);
+
+    CHECK(unlink(path) == 0);
+    errno = 0;
+    CHECK(!rbt_open_mapped(path) && errno == ENOENT);
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * 线程池与并行批量操作: 各 rbt_par_* 的结果与串行版本比对, 建树覆盖 RBT_PAR_CUTOFF 附近的规模;
+ * 另以递归 fork-join 检查 tpool_wait 中嵌套 spawn 和窃取.
+ */
+#include "check.h"
+#include "parallel.h"
+
+#define SEG_BITS 20  // 按序合并的检查值: 首 key, 末 key 各占 20 位, 再加有序标记
+#define SEG_NONE (-1)
+
+static int64_t map_key(RBNode *node, void *arg) {
+    (void)arg;
+    return check_key(&node->data);
+}
+
+static int64_t combine_sum(int64_t x, int64_t y) {
+    return x + y;
+}
+
+/* 一段中序区间的 (首 key, 末 key, 是否有序); 满足结合律但不满足交换律, 合并顺序错了就会发现 */
+static int64_t seg_of(RBNode *node, void *arg) {
+    (void)arg;
+    int64_t k = check_key(&node->data);
+    return k << (SEG_BITS + 1) | k << 1 | 1;
+}
+
+static int64_t seg_combine(int64_t x, int64_t y) {
+    if (x == SEG_NONE) return y;
+    if (y == SEG_NONE) return x;
+
+    int64_t mask = (1 << SEG_BITS) - 1;
+    int64_t x_last = x >> 1 & mask, y_first = y >> (SEG_BITS + 1);
+    int64_t sorted = (x & y & 1) && x_last < y_first;
+    return (x >> (SEG_BITS + 1)) << (SEG_BITS + 1) | (y >> 1 & mask) << 1 | sorted;
+}
+
+static uint32_t *visits;
+
+static void visit(RBNode *node) {
+    __atomic_fetch_add(&visits[check_key(&node->data) / 2], 1, __ATOMIC_RELAXED);
+}
+
+/* 两棵树形状和颜色完全相同 */
+static void same_shape(RBNode *a, RBNode *b) {
+    if (!a || !b) {
+        CHECK(a == b);
+        return;
+    }
+    CHECK(a->color == b->color && check_key(&a->data) == check_key(&b->data));
+    same_shape(a->left, b->left);
+    same_shape(a->right, b->right);
+}
+
+static RBTree *new_tree(int kind) {
+    switch (kind) {
+        case 0: return rbt_rbtree_new();
+        case 1: return rbt_rbtree_new_fixed(sizeof(int), 0);
+        default: return rbt_rbtree_new_pooled(64);  // 池化树退化为串行
+    }
+}
+
+static void run(ThreadPool *pool, size_t n, int kind, bool counted) {
+    int *keys = malloc((n + 1) * sizeof(int));
+    Data *items = malloc((n + 1) * sizeof(Data));
+    CHECK(keys && items);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = 2 * (int)i;
+        items[i] = (Data){&keys[i], sizeof(int)};
+    }
+
+    RBTree *par = new_tree(kind), *seq = new_tree(kind);
+    if (counted) {
+        rbt_set_augment(par, rbt_augment_count);
+        rbt_set_augment(seq, rbt_augment_count);
+    }
+    rbt_par_build_sorted(pool, par, items, n, check_cmp);
+    rbt_build_sorted(seq, items, n, check_cmp);
+
+    check_rb_tree(par, check_cmp);
+    if (counted) check_counts(par->root);
+    CHECK(par->size == n);
+    CHECK(n == 0 || (check_key(&rbt_min(par)->data) == 0 && check_key(&rbt_max(par)->data) == keys[n - 1]));
+    same_shape(par->root, seq->root);
+
+    int64_t sum = (int64_t)n * ((int64_t)n - 1);
+    CHECK(rbt_par_reduce(pool, par, map_key, combine_sum, 0, NULL) == sum);
+    int64_t seg = rbt_par_reduce(pool, par, seg_of, seg_combine, SEG_NONE, NULL);
+    if (n == 0) {
+        CHECK(seg == SEG_NONE);
+    } else {
+        CHECK(seg == ((int64_t)keys[n - 1] << 1 | 1));  // 首 key 为 0, 且整体有序
+    }
+
+    visits = calloc(n + 1, sizeof(uint32_t));
+    CHECK(visits);
+    rbt_par_for_each(pool, par, visit);
+    for (size_t i = 0; i < n; i++) CHECK(visits[i] == 1);
+    free(visits);
+
+    CHECK(rbt_par_depth(pool, par) == rbt_depth(par->root));
+
+    rbt_par_destroy(pool, par);
+    rbt_delete_tree(seq);
+    free(items);
+    free(keys);
+}
+
+/* 递归 fork-join: 每层 spawn 左半, 自己做右半, 再在 tpool_wait 中等待(期间执行别人的任务) */
+typedef struct SumJob {
+    ThreadPool *pool;
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t result;
+} SumJob;
+
+static void sum_job(void *arg) {
+    SumJob *job = arg;
+    if (job->hi - job->lo <= 4) {
+        job->result = 0;
+        for (uint64_t i = job->lo; i < job->hi; i++) job->result += i * i;
+        return;
+    }
+
+    uint64_t mid = job->lo + (job->hi - job->lo) / 2;
+    SumJob left = {job->pool, job->lo, mid, 0}, right = {job->pool, mid, job->hi, 0};
+    TPTask task = {sum_job, &left, 0};
+    tpool_spawn(job->pool, &task);
+    sum_job(&right);
+    tpool_wait(job->pool, &task);
+    job->result = left.result + right.result;
+}
+
+static void nested(ThreadPool *pool) {
+    for (uint64_t n = 0; n <= 100000; n = n * 3 + 1) {
+        SumJob job = {pool, 0, n, 0};
+        tpool_run(pool, sum_job, &job);
+
+        uint64_t expect = 0;
+        for (uint64_t i = 0; i < n; i++) expect += i * i;
+        CHECK(job.result == expect);
+    }
+
+    /* tpool_run 之外 spawn 就地执行 */
+    SumJob job = {pool, 0, 100, 0};
+    TPTask task = {sum_job, &job, 0};
+    tpool_spawn(pool, &task);
+    CHECK(task.done && job.result == 328350);
+    tpool_wait(pool, &task);
+}
+
+int main(void) {
+    const size_t sizes[] = {0, 1, 2, 3, 100, RBT_PAR_CUTOFF - 1, RBT_PAR_CUTOFF, RBT_PAR_CUTOFF + 1,
+                            2 * RBT_PAR_CUTOFF - 1, 2 * RBT_PAR_CUTOFF, 2 * RBT_PAR_CUTOFF + 1,
+                            4 * RBT_PAR_CUTOFF + 3, 50000};
+    const uint32_t workers[] = {1, 2, 4};
+
+    for (size_t w = 0; w < sizeof(workers) / sizeof(workers[0]); w++) {
+        ThreadPool *pool = tpool_new(workers[w]);
+        CHECK(pool && pool->nworkers == workers[w]);
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (int kind = 0; kind < 3; kind++) {
+                run(pool, sizes[s], kind, false);
+            }
+            run(pool, sizes[s], 1, true);
+        }
+        nested(pool);
+        tpool_free(pool);
+    }
+    return 0;
+}
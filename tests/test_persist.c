@@ -0,0 +1,136 @@
+/*
+ * 持久化红黑树: 随机增删并不时取快照, 之后的修改不得影响快照;
+ * 每个版本都检查红黑性质, 缓存的黑高, 内容与模型一致.
+ */
+#include <stdbool.h>
+
+#include "check.h"
+#include "persist.h"
+
+#define KEYS 256
+#define ROUNDS 4000
+#define SNAPS 16
+
+typedef struct Rec {
+    int key;
+    int val;  // 插入相同 key 时替换
+} Rec;
+
+typedef struct Version {
+    RBPTree *tree;
+    int model[KEYS];  // -1 表示不存在
+} Version;
+
+static uint32_t check_pnode(PNode *node, CMP *cmp, uint32_t *size) {
+    if (!node) return 0;
+
+    CHECK(node->refs > 0);
+    if (node->color == RED) {
+        CHECK(!node->left || node->left->color == BLACK);
+        CHECK(!node->right || node->right->color == BLACK);
+    }
+    if (node->left) CHECK(cmp(&node->left->data, &node->data) < 0);
+    if (node->right) CHECK(cmp(&node->right->data, &node->data) > 0);
+
+    uint32_t lh = check_pnode(node->left, cmp, size);
+    uint32_t rh = check_pnode(node->right, cmp, size);
+    CHECK(lh == rh);
+    CHECK(node->bh == lh + (node->color == BLACK));
+    (*size)++;
+    return node->bh;
+}
+
+typedef struct ScanState {
+    int *model;
+    int next;  // 下一个应出现的 key 的下限
+    int hi;
+    size_t n;
+} ScanState;
+
+static int scan_check(Data *data, void *arg) {
+    ScanState *st = arg;
+    Rec rec;
+    memcpy(&rec, data->buffer, sizeof(rec));
+    /* 跳过的 key 在模型中必须不存在 */
+    for (; st->next < rec.key; st->next++) CHECK(st->model[st->next] < 0);
+    CHECK(rec.key <= st->hi && st->model[rec.key] == rec.val);
+    st->next = rec.key + 1;
+    st->n++;
+    return 0;
+}
+
+static void check_version(Version *v, uint64_t *rng) {
+    RBPTree *tree = v->tree;
+    uint32_t size = 0, live = 0;
+    CHECK(!tree->root || tree->root->color == BLACK);
+    check_pnode(tree->root, check_cmp, &size);
+    CHECK(size == tree->size);
+
+    for (int k = 0; k < KEYS; k++) {
+        Rec q = {k, 0};
+        Data d = {&q, sizeof(q)};
+        Data *found = rbt_persist_search(tree, &d);
+        if (v->model[k] < 0) {
+            CHECK(found == NULL);
+        } else {
+            CHECK(found && ((Rec *)found->buffer)->val == v->model[k]);
+            live++;
+        }
+    }
+    CHECK(live == tree->size);
+
+    int lo = check_rand(rng) % KEYS, hi = lo + check_rand(rng) % 64;
+    Rec rlo = {lo, 0}, rhi = {hi, 0};
+    Data dlo = {&rlo, sizeof(rlo)}, dhi = {&rhi, sizeof(rhi)};
+    ScanState st = {v->model, lo, hi, 0};
+    size_t n = rbt_persist_scan(tree, &dlo, &dhi, scan_check, &st);
+    CHECK(n == st.n);
+    for (; st.next <= hi && st.next < KEYS; st.next++) CHECK(v->model[st.next] < 0);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 4; seed++) {
+        uint64_t rng = seed;
+        Version cur = {rbt_persist_new(check_cmp), {0}};
+        Version snaps[SNAPS];
+        int nsnaps = 0;
+        memset(cur.model, -1, sizeof(cur.model));
+
+        for (int round = 0; round < ROUNDS; round++) {
+            uint64_t r = check_rand(&rng);
+            Rec rec = {(int)((r >> 8) % KEYS), round};
+            Data d = {&rec, sizeof(rec)};
+
+            if (r % 3 == 0) {
+                CHECK(rbt_persist_delete(cur.tree, &d) == (cur.model[rec.key] >= 0));
+                cur.model[rec.key] = -1;
+            } else {
+                rbt_persist_insert(cur.tree, &d);
+                cur.model[rec.key] = rec.val;
+            }
+
+            if (round % 97 == 0) {
+                /* 快照满了就随机释放一个 */
+                if (nsnaps == SNAPS) {
+                    int victim = check_rand(&rng) % nsnaps;
+                    rbt_snapshot_release(snaps[victim].tree);
+                    snaps[victim] = snaps[--nsnaps];
+                }
+                snaps[nsnaps] = cur;
+                snaps[nsnaps++].tree = rbt_snapshot(cur.tree);
+            }
+            if (round % 250 == 0) {
+                check_version(&cur, &rng);
+                for (int i = 0; i < nsnaps; i++) check_version(&snaps[i], &rng);
+            }
+        }
+
+        check_version(&cur, &rng);
+        for (int i = 0; i < nsnaps; i++) {
+            check_version(&snaps[i], &rng);
+            rbt_snapshot_release(snaps[i].tree);
+        }
+        rbt_snapshot_release(cur.tree);
+    }
+    return 0;
+}
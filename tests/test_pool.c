@@ -0,0 +1,91 @@
+/*
+ * 内存池计数: 反复申请释放同样大小的 chunk 时复用空闲链表, sys_allocs 在首轮之后不再增长;
+ * 超大对象每次直达 malloc/free. 池化树在规模不变的增删中同样不再向系统申请.
+ */
+#include "check.h"
+#include "pool.h"
+
+#define CHUNKS 2000
+#define ROUNDS 20
+
+static uint32_t chunk_size(int i) {
+    return 1 + (uint32_t)(i * 37) % POOL_MAX_CHUNK;
+}
+
+static void churn(void) {
+    Pool *pool = pool_new(0);
+    static void *ptrs[CHUNKS];
+    PoolStats st, first;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < CHUNKS; i++) {
+            ptrs[i] = pool_alloc(pool, chunk_size(i));
+            memset(ptrs[i], i & 0xff, chunk_size(i));
+        }
+        pool_stats(pool, &st);
+        CHECK(st.live == CHUNKS && st.allocs == (uint64_t)(round + 1) * CHUNKS);
+        if (round == 0) first = st;
+        CHECK(st.sys_allocs == first.sys_allocs && st.sys_frees == 0);
+
+        /* 逆序归还, 下一轮按同样大小申请时从空闲链表取回 */
+        for (int i = CHUNKS - 1; i >= 0; i--) {
+            const unsigned char *p = ptrs[i];
+            for (uint32_t j = sizeof(void *); j < chunk_size(i); j++) CHECK(p[j] == (i & 0xff));
+            pool_free(pool, ptrs[i], chunk_size(i));
+        }
+        pool_stats(pool, &st);
+        CHECK(st.live == 0 && st.frees == st.allocs);
+    }
+    CHECK(first.sys_allocs > 0 && first.big_live == 0);
+
+    /* 超大对象: 申请和释放都直接经过 malloc/free */
+    void *big[3];
+    for (int i = 0; i < 3; i++) big[i] = pool_alloc(pool, POOL_MAX_CHUNK + 1 + i);
+    pool_stats(pool, &st);
+    CHECK(st.big_live == 3 && st.sys_allocs == first.sys_allocs + 3);
+    for (int i = 0; i < 3; i++) pool_free(pool, big[i], POOL_MAX_CHUNK + 1 + i);
+    pool_stats(pool, &st);
+    CHECK(st.big_live == 0 && st.sys_frees == 3 && st.live == 0);
+
+    pool_destroy(pool);
+    pool_stats(NULL, &st);
+    CHECK(st.allocs == 0 && st.sys_allocs == 0 && st.live == 0);
+}
+
+/* 池化树先插满, 之后每删一个就插一个, 结点和 key 都复用已归还的 chunk */
+static void tree_churn(void) {
+    RBTree *tree = rbt_rbtree_new_pooled(1024);
+    uint64_t rng = 3;
+    int present[4096] = {0};
+    for (int k = 0; k < 4096; k += 2) {
+        Data d = {&k, sizeof(k)};
+        rbt_insert_data(tree, &d, check_cmp);
+        present[k] = 1;
+    }
+
+    PoolStats before, after;
+    pool_stats(tree->pool, &before);
+    CHECK(before.live == 2 * tree->size);  // 每个结点一个 chunk, key 一个 chunk
+
+    for (int i = 0; i < 50000; i++) {
+        int del = (int)(check_rand(&rng) % 4096), add = (int)(check_rand(&rng) % 4096);
+        if (!present[del] || present[add]) continue;
+        Data d = {&del, sizeof(del)}, a = {&add, sizeof(add)};
+        rbt_delete_data(tree, &d, check_cmp);
+        rbt_insert_data(tree, &a, check_cmp);
+        present[del] = 0;
+        present[add] = 1;
+    }
+    check_rb_tree(tree, check_cmp);
+
+    pool_stats(tree->pool, &after);
+    CHECK(after.allocs > before.allocs && after.live == before.live);
+    CHECK(after.sys_allocs == before.sys_allocs && after.sys_frees == 0);
+    rbt_delete_tree(tree);
+}
+
+int main(void) {
+    churn();
+    tree_churn();
+    return 0;
+}
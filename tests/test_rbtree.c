@@ -0,0 +1,500 @@
+/*
+ * 随机增删下的红黑性质, 以及删除只改指针: 其他结点的地址和数据不变.
+ * 另覆盖批量建树的各种规模和回退路径, 带提示插入, 唯一键插入, 游标和区间扫描, 批量查找, 以及弹出最值.
+ */
+#include "check.h"
+
+#define KEYS 512
+#define ROUNDS 20000
+
+static void run(RBTree *tree, uint64_t seed) {
+    RBNode *nodes[KEYS] = {0};  // 模型: key -> 插入时得到的结点, 为空表示不在树中
+    uint64_t rng = seed;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+
+        if (!nodes[key]) {
+            bool inserted;
+            nodes[key] = rbt_upsert(tree, &d, check_cmp, &inserted);
+            CHECK(inserted);
+        } else {
+            /* 轮流使用三种删除入口 */
+            switch (round % 3) {
+                case 0:
+                    rbt_delete_data(tree, &d, check_cmp);
+                    break;
+                case 1:
+                    rbt_erase_node(tree, nodes[key]);
+                    break;
+                default: {
+                    RBCursor cursor;
+                    rbt_cursor_init(&cursor, tree);
+                    CHECK(rbt_lower_bound(&cursor, &d, check_cmp));
+                    RBNode *next = rbt_successor(cursor.node);
+                    rbt_cursor_erase(&cursor);
+                    CHECK(cursor.node == next);
+                }
+            }
+            nodes[key] = NULL;
+        }
+
+        if (round % 64 == 0 || round == ROUNDS - 1) {
+            check_rb_tree(tree, check_cmp);
+            /* 删除其他 key 后, 仍在树中的结点地址不变且数据未被挪动 */
+            uint32_t live = 0;
+            for (int k = 0; k < KEYS; k++) {
+                Data q = {&k, sizeof(k)};
+                RBNode *found = rbt_search_node(tree, &q, check_cmp);
+                CHECK(found == nodes[k]);
+                if (found) {
+                    CHECK(check_key(&found->data) == k);
+                    live++;
+                }
+            }
+            CHECK(live == tree->size);
+        }
+    }
+
+    /* 删空 */
+    for (int k = 0; k < KEYS; k++) {
+        if (nodes[k]) rbt_erase_node(tree, nodes[k]);
+    }
+    CHECK(tree->size == 0 && tree->root == NULL);
+    CHECK(rbt_min(tree) == NULL && rbt_max(tree) == NULL);
+    rbt_delete_tree(tree);
+}
+
+/* 顺序插入再逆序/隔一删除, 覆盖旋转的镜像分支 */
+static void run_ordered(void) {
+    RBTree *tree = rbt_rbtree_new();
+    for (int k = 0; k < 1000; k++) {
+        Data d = {&k, sizeof(k)};
+        rbt_insert_data(tree, &d, check_cmp);
+    }
+    check_rb_tree(tree, check_cmp);
+    for (int k = 0; k < 1000; k += 2) {
+        Data d = {&k, sizeof(k)};
+        rbt_delete_data(tree, &d, check_cmp);
+        check_rb_tree(tree, check_cmp);
+    }
+    for (int k = 999; k > 0; k -= 2) {
+        Data d = {&k, sizeof(k)};
+        rbt_delete_data(tree, &d, check_cmp);
+        check_rb_tree(tree, check_cmp);
+    }
+    CHECK(tree->size == 0);
+    rbt_delete_tree(tree);
+}
+
+/* 缓存的最值与从根走到底的结点一致 */
+static void check_extremes(RBTree *tree) {
+    RBNode *lo = tree->root, *hi = tree->root;
+    while (lo && lo->left) lo = lo->left;
+    while (hi && hi->right) hi = hi->right;
+    CHECK(tree->leftmost == lo && tree->rightmost == hi);
+}
+
+static RBTree *build_tree(int kind) {
+    RBTree *tree;
+    switch (kind) {
+        case 0: tree = rbt_rbtree_new(); break;
+        case 1: tree = rbt_rbtree_new_fixed(sizeof(int) * 2, 0); break;
+        default: tree = rbt_rbtree_new_pooled(64);
+    }
+    rbt_set_augment(tree, rbt_augment_count);
+    return tree;
+}
+
+/* 0..1100 覆盖最底层各种填充程度; key 后带输入序号, 用来确认排序稳定 */
+static void run_build(void) {
+    enum { MAX = 1100 };
+    static int recs[MAX][2];
+    static Data items[MAX];
+    uint64_t rng = 7;
+
+    for (int n = 0; n <= MAX; n++) {
+        int kind = n % 3;
+
+        for (int i = 0; i < n; i++) {
+            recs[i][0] = 2 * i;
+            recs[i][1] = i;
+            items[i] = (Data){recs[i], sizeof(recs[i])};
+        }
+        RBTree *tree = build_tree(kind);
+        rbt_build_sorted(tree, items, n, check_cmp);
+        check_rb_tree(tree, check_cmp);
+        check_counts(tree->root);
+        check_extremes(tree);
+        CHECK(tree->size == (uint32_t)n);
+        int k = 0;
+        for (RBNode *p = rbt_min(tree); p; p = rbt_successor(p)) CHECK(check_key(&p->data) == 2 * k++);
+
+        /* 非空树退化为逐个插入: 再并入一批奇数 key */
+        for (int i = 0; i < n; i++) recs[i][0] = 2 * i + 1;
+        rbt_build_sorted(tree, items, n, check_cmp);
+        check_rb_tree(tree, check_cmp);
+        check_counts(tree->root);
+        check_extremes(tree);
+        CHECK(tree->size == 2 * (uint32_t)n);
+        k = 0;
+        for (RBNode *p = rbt_min(tree); p; p = rbt_successor(p)) CHECK(check_key(&p->data) == k++);
+        rbt_delete_tree(tree);
+
+        /* 乱序且大量重复的输入: 全部保留, 相等的 key 保持输入顺序 */
+        for (int i = 0; i < n; i++) {
+            recs[i][0] = (int)(check_rand(&rng) % (n / 4 + 1));
+            recs[i][1] = i;
+        }
+        tree = build_tree(kind);
+        rbt_build_unsorted(tree, items, n, check_cmp);
+        check_rb_tree(tree, check_cmp);
+        check_counts(tree->root);
+        check_extremes(tree);
+        CHECK(tree->size == (uint32_t)n);
+        RBNode *prev = NULL;
+        for (RBNode *p = rbt_min(tree); p; p = rbt_successor(p)) {
+            if (prev && check_key(&prev->data) == check_key(&p->data)) {
+                CHECK(((int *)prev->data.buffer)[1] < ((int *)p->data.buffer)[1]);
+            }
+            prev = p;
+        }
+
+        /* 非空树上的乱序建树同样逐个插入 */
+        rbt_build_unsorted(tree, items, n, check_cmp);
+        check_rb_tree(tree, check_cmp);
+        check_counts(tree->root);
+        CHECK(tree->size == 2 * (uint32_t)n);
+        rbt_delete_tree(tree);
+    }
+}
+
+static int cmp_calls;  // counting_cmp 的调用次数
+
+static int counting_cmp(Data *src, Data *dest) {
+    cmp_calls++;
+    return check_cmp(src, dest);
+}
+
+/* 带提示插入 key, 返回比较次数; 之后检查红黑性质和最值缓存 */
+static int insert_hint(RBTree *tree, RBNode *hint, int key) {
+    Data d = {&key, sizeof(key)};
+    RBNode *node = rbt_tree_node_new(tree, &d);
+    uint32_t size = tree->size;
+
+    cmp_calls = 0;
+    rbt_insert_hint(tree, hint, node, counting_cmp);
+    int calls = cmp_calls;
+
+    check_rb_tree(tree, check_cmp);
+    check_extremes(tree);
+    CHECK(tree->size == size + 1);
+    return calls;
+}
+
+static RBNode *find(RBTree *tree, int key) {
+    Data d = {&key, sizeof(key)};
+    return rbt_search_node(tree, &d, check_cmp);
+}
+
+static void run_hint(void) {
+    RBTree *tree = rbt_rbtree_new();
+    for (int k = 10; k <= 1000; k += 10) {
+        Data d = {&k, sizeof(k)};
+        rbt_insert_data(tree, &d, check_cmp);
+    }
+
+    /* 正确的提示: 后继或前驱, 只与 hint 和它的邻居比较 */
+    for (int k = 15; k < 1000; k += 20) {
+        CHECK(insert_hint(tree, find(tree, k + 5), k) <= 2);
+        CHECK(insert_hint(tree, find(tree, k), k + 1) <= 2);
+    }
+
+    /* 错误的提示: 退化为从根查找, 仍插在正确位置 */
+    CHECK(insert_hint(tree, rbt_min(tree), 777) > 2);
+    CHECK(insert_hint(tree, rbt_max(tree), 333) > 2);
+    RBNode *p = find(tree, 777);
+    CHECK(check_key(&rbt_precursor(p)->data) <= 777 && check_key(&rbt_successor(p)->data) >= 777);
+
+    /* 无提示: 大于最大值时走追加快速路径, 否则普通插入 */
+    CHECK(insert_hint(tree, NULL, 2000) == 1 && check_key(&rbt_max(tree)->data) == 2000);
+    insert_hint(tree, NULL, 444);
+    CHECK(find(tree, 444));
+
+    /* 提示在两端: 新的最值被缓存 */
+    CHECK(insert_hint(tree, rbt_min(tree), 1) <= 2 && check_key(&rbt_min(tree)->data) == 1);
+    CHECK(insert_hint(tree, rbt_max(tree), 3000) <= 2 && check_key(&rbt_max(tree)->data) == 3000);
+
+    /* 相等的 key: 插在 hint 之前, 所有相等结点连续 */
+    RBNode *hint = find(tree, 500);
+    for (int i = 0; i < 20; i++) {
+        CHECK(insert_hint(tree, hint, 500) <= 2);
+        CHECK(rbt_successor(rbt_precursor(hint)) == hint && check_key(&rbt_precursor(hint)->data) == 500);
+    }
+    int equal = 0;
+    for (p = rbt_min(tree); p; p = rbt_successor(p)) equal += check_key(&p->data) == 500;
+    CHECK(equal == 21);
+
+    /* 空树上的提示被忽略 */
+    RBTree *empty = rbt_rbtree_new();
+    CHECK(insert_hint(empty, NULL, 5) == 0);
+    rbt_delete_tree(empty);
+    rbt_delete_tree(tree);
+}
+
+/* 池化树经 pool->allocs 确认重复 key 时不分配 */
+static void run_unique(void) {
+    RBTree *tree = rbt_rbtree_new_pooled(64);
+    RBNode *nodes[KEYS] = {0};
+    uint64_t rng = 3;
+    bool inserted;
+
+    /* 升序输入每次只与最右结点比较一次 */
+    for (int k = 0; k < KEYS; k += 2) {
+        Data d = {&k, sizeof(k)};
+        cmp_calls = 0;
+        nodes[k] = rbt_find_or_insert(tree, &d, counting_cmp, &inserted);
+        CHECK(inserted && cmp_calls == (k ? 1 : 0) && rbt_max(tree) == nodes[k]);
+    }
+    int last = KEYS - 2;
+    Data dl = {&last, sizeof(last)};
+    cmp_calls = 0;
+    CHECK(rbt_find_or_insert(tree, &dl, counting_cmp, NULL) == nodes[last] && cmp_calls == 1);
+    check_rb_tree(tree, check_cmp);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+        uint64_t allocs = tree->pool->allocs;
+        uint32_t size = tree->size;
+
+        if (round & 1) {
+            RBNode *got = rbt_find_or_insert(tree, &d, check_cmp, &inserted);
+            CHECK(inserted == !nodes[key]);
+            if (inserted) {
+                CHECK(tree->size == size + 1 && tree->pool->allocs > allocs);
+                nodes[key] = got;
+            } else {
+                CHECK(got == nodes[key] && tree->size == size && tree->pool->allocs == allocs);
+            }
+        } else {
+            /* 已存在时返回已有结点, 传入的结点仍归调用者 */
+            RBNode *node = rbt_tree_node_new(tree, &d);
+            RBNode *got = rbt_insert_unique(tree, node, check_cmp, &inserted);
+            CHECK(inserted == !nodes[key]);
+            if (inserted) {
+                CHECK(got == node && tree->size == size + 1);
+                nodes[key] = got;
+            } else {
+                CHECK(got == nodes[key] && got != node && tree->size == size);
+                rbt_tree_node_free(tree, node);
+            }
+        }
+
+        if (round % 512 == 0) {
+            check_rb_tree(tree, check_cmp);
+            check_extremes(tree);
+        }
+        if (round % 3 == 0 && nodes[key]) {
+            rbt_erase_node(tree, nodes[key]);
+            nodes[key] = NULL;
+        }
+    }
+    check_rb_tree(tree, check_cmp);
+    rbt_delete_tree(tree);
+}
+
+typedef struct ScanCtx {
+    int next;  // 下一个应扫到的 key
+    size_t n;
+    size_t limit;  // 扫到第 limit 个时让回调返回非 0
+} ScanCtx;
+
+static int scan_one(RBNode *node, void *arg) {
+    ScanCtx *ctx = arg;
+    CHECK(check_key(&node->data) == ctx->next);
+    ctx->next += 2;
+    return ++ctx->n == ctx->limit;
+}
+
+/* key 为 0, 2, ..., 2(n-1); lo/hi 为 INT32_MIN/INT32_MAX 时不设界 */
+static void check_range(RBTree *tree, int n, int lo, int hi, size_t limit) {
+    Data dlo = {&lo, sizeof(lo)}, dhi = {&hi, sizeof(hi)};
+    bool open_lo = lo == INT32_MIN, open_hi = hi == INT32_MAX;
+    int first = open_lo || lo < 0 ? 0 : (lo + 1) / 2 * 2;
+    int last = open_hi || hi >= 2 * (n - 1) ? 2 * (n - 1) : hi / 2 * 2;
+    size_t expect = last >= first ? (size_t)(last - first) / 2 + 1 : 0;
+    if (hi < 0) expect = 0;
+    if (expect > limit) expect = limit;
+
+    ScanCtx ctx = {first, 0, limit};
+    CHECK(rbt_range_scan(tree, open_lo ? NULL : &dlo, open_hi ? NULL : &dhi, check_cmp, scan_one, &ctx) == expect);
+    CHECK(ctx.n == expect);
+}
+
+static void run_cursor(void) {
+    enum { N = 200 };
+    RBTree *tree = rbt_rbtree_new_fixed(sizeof(int), 0);
+    for (int i = 0; i < N; i++) {
+        int k = 2 * ((i * 73) % N);
+        Data d = {&k, sizeof(k)};
+        rbt_insert_data(tree, &d, check_cmp);
+    }
+
+    /* 区间扫描: 不设界, 单侧设界, 空区间, 提前停止 */
+    check_range(tree, N, INT32_MIN, INT32_MAX, SIZE_MAX);
+    check_range(tree, N, INT32_MIN, 101, SIZE_MAX);
+    check_range(tree, N, 150, INT32_MAX, SIZE_MAX);
+    check_range(tree, N, 51, 51, SIZE_MAX);
+    check_range(tree, N, 60, 40, SIZE_MAX);
+    check_range(tree, N, -10, -1, SIZE_MAX);
+    check_range(tree, N, 2 * N, INT32_MAX, SIZE_MAX);
+    check_range(tree, N, INT32_MIN, INT32_MAX, 5);
+    check_range(tree, N, 10, 100, 1);
+    uint64_t rng = 11;
+    for (int round = 0; round < 200; round++) {
+        int lo = (int)(check_rand(&rng) % (2 * N + 4)) - 2;
+        int hi = lo + (int)(check_rand(&rng) % 60) - 5;
+        check_range(tree, N, lo, hi, round % 4 == 0 ? 3 : SIZE_MAX);
+    }
+
+    /* lower/upper bound 对每个可能的查询值 */
+    RBCursor cursor;
+    rbt_cursor_init(&cursor, tree);
+    for (int q = -1; q <= 2 * N; q++) {
+        Data d = {&q, sizeof(q)};
+        int lower = q < 0 ? 0 : (q + 1) / 2 * 2, upper = q < 0 ? 0 : q / 2 * 2 + 2;
+        CHECK(rbt_lower_bound(&cursor, &d, check_cmp) == (lower < 2 * N));
+        if (lower < 2 * N) CHECK(check_key(&cursor.node->data) == lower);
+        CHECK(rbt_upper_bound(&cursor, &d, check_cmp) == (upper < 2 * N));
+        if (upper < 2 * N) CHECK(check_key(&cursor.node->data) == upper);
+    }
+
+    /* 越过末尾后 prev 回到最大结点, 再逆序走到头 */
+    int q = 2 * N;
+    Data d = {&q, sizeof(q)};
+    CHECK(!rbt_upper_bound(&cursor, &d, check_cmp) && cursor.node == NULL);
+    CHECK(rbt_cursor_prev(&cursor) && cursor.node == rbt_max(tree));
+    int k = 2 * (N - 1), steps = 1;
+    while (rbt_cursor_prev(&cursor)) {
+        k -= 2;
+        CHECK(check_key(&cursor.node->data) == k);
+        steps++;
+    }
+    CHECK(k == 0 && steps == N && cursor.node == NULL);
+    CHECK(!rbt_cursor_next(&cursor));
+    rbt_cursor_last(&cursor, tree);
+    CHECK(cursor.node == rbt_max(tree) && !rbt_cursor_next(&cursor));
+
+    /* 遍历中删除: 删掉 4 的倍数, 游标前进到被删结点的后继 */
+    rbt_cursor_init(&cursor, tree);
+    k = 0;
+    bool more = true;
+    while (more) {
+        CHECK(check_key(&cursor.node->data) == k);
+        more = k % 4 == 0 ? rbt_cursor_erase(&cursor) : rbt_cursor_next(&cursor);
+        k += 2;
+    }
+    CHECK(k == 2 * N && !rbt_cursor_erase(&cursor));
+    check_rb_tree(tree, check_cmp);
+    check_extremes(tree);
+    CHECK(tree->size == N / 2);
+    for (RBNode *p = rbt_min(tree); p; p = rbt_successor(p)) CHECK(check_key(&p->data) % 4 == 2);
+
+    /* 删到空, 最后一次删除后游标越过末尾 */
+    rbt_cursor_init(&cursor, tree);
+    while (rbt_cursor_erase(&cursor));
+    CHECK(tree->size == 0 && tree->root == NULL && rbt_min(tree) == NULL && rbt_max(tree) == NULL);
+    rbt_cursor_init(&cursor, tree);
+    CHECK(cursor.node == NULL && !rbt_cursor_prev(&cursor));
+    rbt_delete_tree(tree);
+}
+
+/* 批量查找的每一路与逐个 rbt_search_node 一致, 批大小覆盖 RBT_BATCH_WIDTH 前后 */
+static void run_batch(RBTree *tree) {
+    enum { MAX = 1000 };
+    static int qs[MAX];
+    static Data data[MAX];
+    static Data *keys[MAX];
+    static RBNode *out[MAX];
+    const size_t sizes[] = {0, 1, RBT_BATCH_WIDTH - 1, RBT_BATCH_WIDTH, RBT_BATCH_WIDTH + 1, MAX};
+    uint64_t rng = 5;
+
+    /* 偶数 key 在树中, 奇数不在 */
+    for (int k = 0; k < 2 * MAX; k += 2) {
+        Data d = {&k, sizeof(k)};
+        rbt_insert_data(tree, &d, check_cmp);
+    }
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        for (size_t i = 0; i < n; i++) {
+            qs[i] = (int)(check_rand(&rng) % (2 * MAX + 20)) - 10;
+            data[i] = (Data){&qs[i], sizeof(int)};
+            keys[i] = &data[i];
+            out[i] = (RBNode *)&out;  // 确认每一路都被写入
+        }
+        rbt_search_batch(tree, keys, n, out, check_cmp);
+
+        size_t hits = 0;
+        for (size_t i = 0; i < n; i++) {
+            CHECK(out[i] == rbt_search_node(tree, keys[i], check_cmp));
+            hits += out[i] != NULL;
+        }
+        if (n >= RBT_BATCH_WIDTH) CHECK(hits > 0 && hits < n);
+    }
+    rbt_delete_tree(tree);
+}
+
+/* 两端交替弹出(含重复 key), 每次弹出后最值缓存与树一致 */
+static void run_pop(RBTree *tree, uint64_t seed) {
+    uint32_t cnt[KEYS] = {0};
+    uint64_t rng = seed;
+    for (int i = 0; i < 2 * KEYS; i++) {
+        int key = check_rand(&rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+        rbt_insert_data(tree, &d, check_cmp);
+        cnt[key]++;
+    }
+
+    int lo = 0, hi = KEYS - 1;
+    while (tree->size) {
+        bool max = check_rand(&rng) % 3 != 0;
+        RBNode *node = max ? rbt_pop_max(tree) : rbt_pop_min(tree);
+        while (!cnt[lo]) lo++;
+        while (!cnt[hi]) hi--;
+        CHECK(node && node->parent == NULL && node->left == NULL && node->right == NULL);
+        CHECK(check_key(&node->data) == (max ? hi : lo));
+        cnt[max ? hi : lo]--;
+        rbt_tree_node_free(tree, node);
+
+        check_extremes(tree);
+        if (tree->size % 64 == 0) check_rb_tree(tree, check_cmp);
+        if (tree->size) CHECK(check_key(&rbt_max(tree)->data) >= check_key(&rbt_min(tree)->data));
+    }
+    CHECK(tree->root == NULL && rbt_pop_max(tree) == NULL && rbt_pop_min(tree) == NULL);
+    rbt_delete_tree(tree);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 4; seed++) {
+        run(rbt_rbtree_new(), seed);
+        run(rbt_rbtree_new_pooled(64), seed);
+        run(rbt_rbtree_new_fixed(sizeof(int), 64), seed);
+        run(rbt_rbtree_new_fixed(sizeof(int), 0), seed);
+    }
+    run_ordered();
+    run_build();
+    run_hint();
+    run_unique();
+    run_cursor();
+    run_batch(rbt_rbtree_new());
+    run_batch(rbt_rbtree_new_fixed(sizeof(int), 0));
+    run_batch(rbt_rbtree_new_pooled(64));
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        run_pop(rbt_rbtree_new(), seed);
+        run_pop(rbt_rbtree_new_fixed(sizeof(int), 64), seed);
+    }
+    return 0;
+}
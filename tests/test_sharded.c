@@ -0,0 +1,196 @@
+/*
+ * 分片树: key 之后带 payload 的记录, cmp 只比较 key.
+ * 默认哈希只看 key 前缀, 同一 key 换了 payload 仍落到同一分片; 与模型比对增删查和有序扫描.
+ * 另有多线程读写: 各写线程负责互不相交的 key, 读线程同时查找, 结束后与各自的模型比对.
+ */
+#include <pthread.h>
+
+#include "check.h"
+#include "sharded.h"
+
+#define KEYS 2048
+#define ROUNDS 20000
+
+typedef struct Rec {
+    int key;
+    int val;  // payload, 不参与比较
+} Rec;
+
+typedef struct ScanCtx {
+    int *model;
+    int next;
+    size_t n;
+} ScanCtx;
+
+static int scan_one(RBNode *node, void *arg) {
+    ScanCtx *ctx = arg;
+    Rec r;
+    memcpy(&r, node->data.buffer, sizeof(r));
+    CHECK(r.key >= ctx->next);
+    while (ctx->next < r.key) CHECK(ctx->model[ctx->next++] < 0);
+    CHECK(ctx->model[r.key] == r.val);
+    ctx->next = r.key + 1;
+    ctx->n++;
+    return 0;
+}
+
+static uint32_t key_hash(Data *data) {
+    return (uint32_t)check_key(data) * 2654435761u;
+}
+
+static void run(RBShardedTree *st, uint64_t seed) {
+    int model[KEYS];
+    memset(model, -1, sizeof(model));
+    uint64_t rng = seed;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        Rec r = {(int)(check_rand(&rng) % KEYS), round};
+        Data d = {&r, sizeof(r)};
+
+        switch (check_rand(&rng) % 3) {
+            case 0:
+            case 1:
+                CHECK(rbt_sharded_upsert(st, &d) == (model[r.key] < 0));
+                model[r.key] = r.val;
+                break;
+            default:
+                CHECK(rbt_sharded_delete(st, &d) == (model[r.key] >= 0));
+                model[r.key] = -1;
+        }
+
+        /* 查找时 payload 不同, 也应找到同一条记录 */
+        Rec probe = {r.key, -round}, got = {0, 0};
+        Data q = {&probe, sizeof(probe)}, out = {&got, sizeof(got)};
+        CHECK(rbt_sharded_search(st, &q, &out) == (model[r.key] >= 0));
+        if (model[r.key] >= 0) CHECK(got.key == r.key && got.val == model[r.key]);
+    }
+
+    size_t live = 0;
+    for (int k = 0; k < KEYS; k++) live += model[k] >= 0;
+    CHECK(rbt_sharded_size(st) == live);
+
+    ScanCtx ctx = {model, 0, 0};
+    CHECK(rbt_sharded_scan(st, NULL, NULL, scan_one, &ctx) == live && ctx.n == live);
+
+    Rec lo = {KEYS / 4, 0}, hi = {KEYS / 2, 0};
+    Data dlo = {&lo, sizeof(lo)}, dhi = {&hi, sizeof(hi)};
+    size_t in_range = 0;
+    for (int k = lo.key; k <= hi.key; k++) in_range += model[k] >= 0;
+    ScanCtx part = {model, lo.key, 0};
+    CHECK(rbt_sharded_scan(st, &dlo, &dhi, scan_one, &part) == in_range && part.n == in_range);
+
+    rbt_sharded_free(st);
+}
+
+#define WRITERS 4
+#define READERS 2
+#define THREAD_OPS 20000
+
+typedef struct Worker {
+    RBShardedTree *st;
+    int id;          // 负责 key % WRITERS == id 的 key
+    int model[KEYS];  // 只记录自己负责的 key
+} Worker;
+
+static int stop_readers;
+
+static void *writer(void *arg) {
+    Worker *w = arg;
+    uint64_t rng = w->id + 100;
+    memset(w->model, -1, sizeof(w->model));
+
+    for (int i = 0; i < THREAD_OPS; i++) {
+        int key = (int)(check_rand(&rng) % (KEYS / WRITERS)) * WRITERS + w->id;
+        Rec r = {key, i * KEYS + key};  // val % KEYS == key, 读者据此发现撕裂的记录
+        Data d = {&r, sizeof(r)};
+        if (check_rand(&rng) % 3) {
+            CHECK(rbt_sharded_upsert(w->st, &d) == (w->model[key] < 0));
+            w->model[key] = r.val;
+        } else {
+            CHECK(rbt_sharded_delete(w->st, &d) == (w->model[key] >= 0));
+            w->model[key] = -1;
+        }
+    }
+    return NULL;
+}
+
+static int scan_sorted(RBNode *node, void *arg) {
+    int *prev = arg;
+    Rec r;
+    memcpy(&r, node->data.buffer, sizeof(r));
+    CHECK(r.key > *prev && r.val % KEYS == r.key);
+    *prev = r.key;
+    return 0;
+}
+
+static void *reader(void *arg) {
+    RBShardedTree *st = arg;
+    uint64_t rng = 7;
+    while (!__atomic_load_n(&stop_readers, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < 100; i++) {
+            Rec probe = {(int)(check_rand(&rng) % KEYS), 0}, got = {-1, -1};
+            Data q = {&probe, sizeof(probe)}, out = {&got, sizeof(got)};
+            if (rbt_sharded_search(st, &q, &out)) CHECK(got.key == probe.key && got.val % KEYS == got.key);
+        }
+        int prev = -1;
+        rbt_sharded_scan(st, NULL, NULL, scan_sorted, &prev);
+    }
+    return NULL;
+}
+
+static void run_threads(RBShardedTree *st) {
+    static Worker workers[WRITERS];
+    pthread_t wt[WRITERS], rt[READERS];
+
+    stop_readers = 0;
+    for (int r = 0; r < READERS; r++) CHECK(pthread_create(&rt[r], NULL, reader, st) == 0);
+    for (int w = 0; w < WRITERS; w++) {
+        workers[w].st = st;
+        workers[w].id = w;
+        CHECK(pthread_create(&wt[w], NULL, writer, &workers[w]) == 0);
+    }
+    for (int w = 0; w < WRITERS; w++) pthread_join(wt[w], NULL);
+    __atomic_store_n(&stop_readers, 1, __ATOMIC_RELEASE);
+    for (int r = 0; r < READERS; r++) pthread_join(rt[r], NULL);
+
+    int model[KEYS];
+    size_t live = 0;
+    for (int k = 0; k < KEYS; k++) {
+        model[k] = workers[k % WRITERS].model[k];
+        live += model[k] >= 0;
+    }
+    CHECK(rbt_sharded_size(st) == live);
+    ScanCtx ctx = {model, 0, 0};
+    CHECK(rbt_sharded_scan(st, NULL, NULL, scan_one, &ctx) == live && ctx.n == live);
+    rbt_sharded_free(st);
+}
+
+static void zero_hash_len(void) {
+    rbt_sharded_new_hash(4, NULL, 0, check_cmp, sizeof(Rec), 0);
+}
+
+static void hash_len_too_long(void) {
+    rbt_sharded_new_hash(4, NULL, sizeof(Rec) + 1, check_cmp, sizeof(Rec), 0);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        run(rbt_sharded_new_hash(8, NULL, sizeof(int), check_cmp, sizeof(Rec), 1024), seed);
+        run(rbt_sharded_new_hash(8, NULL, sizeof(int), check_cmp, 0, 0), seed);
+        run(rbt_sharded_new_hash(5, key_hash, 0, check_cmp, sizeof(Rec), 0), seed);
+
+        Rec b[3] = {{KEYS / 8, 0}, {KEYS / 3, 0}, {KEYS / 2 + 1, 0}};
+        Data bounds[3] = {{&b[0], sizeof(Rec)}, {&b[1], sizeof(Rec)}, {&b[2], sizeof(Rec)}};
+        run(rbt_sharded_new_range(bounds, 4, check_cmp, sizeof(Rec), 0), seed);
+    }
+
+    run_threads(rbt_sharded_new_hash(1, NULL, sizeof(int), check_cmp, sizeof(Rec), 1024));
+    run_threads(rbt_sharded_new_hash(16, NULL, sizeof(int), check_cmp, sizeof(Rec), 1024));
+    Rec b[3] = {{KEYS / 4, 0}, {KEYS / 2, 0}, {3 * KEYS / 4, 0}};
+    Data bounds[3] = {{&b[0], sizeof(Rec)}, {&b[1], sizeof(Rec)}, {&b[2], sizeof(Rec)}};
+    run_threads(rbt_sharded_new_range(bounds, 4, check_cmp, 0, 0));
+
+    check_dies(zero_hash_len);
+    check_dies(hash_len_too_long);
+    return 0;
+}
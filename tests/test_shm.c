@@ -0,0 +1,204 @@
+/*
+ * 共享内存树: 随机增删后与模型比对, 经偏移检查红黑性质; 另一映射看到同一棵树.
+ * 子进程持锁死掉后, 下一次操作修复它写了一半的树.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "shm.h"
+
+#define KEYS 1024
+#define ROUNDS 30000
+
+#define NODE(st, off) ((RBShmNode *)((char *)(st)->base + (off)))
+
+static int shm_check(RBShmTree *st, RBShmOff off, RBShmOff parent) {
+    if (!off) return 1;
+
+    RBShmNode *node = NODE(st, off);
+    CHECK(node->parent == parent);
+    if (node->color == RED) {
+        CHECK(!node->left || NODE(st, node->left)->color == BLACK);
+        CHECK(!node->right || NODE(st, node->right)->color == BLACK);
+    }
+
+    int lh = shm_check(st, node->left, off);
+    int rh = shm_check(st, node->right, off);
+    CHECK(lh == rh);
+    return lh + (node->color == BLACK);
+}
+
+typedef struct ScanCtx {
+    bool *model;
+    int prev;
+    uint32_t n;
+} ScanCtx;
+
+static int scan_one(Data *key, void *arg) {
+    ScanCtx *ctx = arg;
+    int k = check_key(key);
+    CHECK(k > ctx->prev && k < KEYS && ctx->model[k]);
+    ctx->prev = k;
+    ctx->n++;
+    return 0;
+}
+
+/* 先经加锁的扫描比对内容, 有待修复的树此时已修好, 再检查结构 */
+static void shm_equal(RBShmTree *st, bool *model) {
+    ScanCtx ctx = {model, -1, 0};
+    uint32_t live = 0;
+    for (int k = 0; k < KEYS; k++) live += model[k];
+    CHECK(rbt_shm_scan(st, NULL, NULL, check_cmp, scan_one, &ctx) == live);
+    CHECK(ctx.n == live && rbt_shm_size(st) == live);
+
+    RBShmOff root = st->header->root;
+    CHECK(!root || NODE(st, root)->color == BLACK);
+    shm_check(st, root, 0);
+}
+
+static void shm_ops(RBShmTree *st, RBShmTree *other, bool *model, uint64_t *rng, int rounds) {
+    for (int round = 0; round < rounds; round++) {
+        int key = check_rand(rng) % KEYS;
+        Data d = {&key, sizeof(key)};
+
+        if (!model[key]) {
+            CHECK(rbt_shm_upsert(st, &d, check_cmp) == 1);
+            model[key] = true;
+        } else if (round & 1) {
+            CHECK(rbt_shm_upsert(other, &d, check_cmp) == 0);
+        } else {
+            CHECK(rbt_shm_delete(other, &d, check_cmp));
+            CHECK(!rbt_shm_delete(st, &d, check_cmp));
+            model[key] = false;
+        }
+
+        if (round % 128 == 0) {
+            shm_equal(st, model);
+            shm_equal(other, model);
+        }
+    }
+}
+
+/* 子进程持锁后按 mode 破坏树再退出, 不释放锁: 0 只读, 1 写到一半 */
+static void shm_crash(RBShmTree *st, int mode, int victim) {
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        RBShmHeader *header = st->header;
+        pthread_mutex_lock(&header->lock);
+        if (mode) {
+            header->writing = 1;
+            /* 摘除 victim 途中: 提交标记已撤, 链接和空闲链表残缺 */
+            RBShmOff p = header->root;
+            while (p && *(int *)NODE(st, p)->key != victim) {
+                p = victim < *(int *)NODE(st, p)->key ? NODE(st, p)->left : NODE(st, p)->right;
+            }
+            NODE(st, p)->key_size = 0;
+            NODE(st, header->root)->left = p;
+            NODE(st, header->root)->right = 0;
+            memset(header->free_list, 0xff, sizeof(header->free_list));
+            header->size = 0;
+        }
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status));
+}
+
+/* rbt_shm_size 不持锁, 与持锁的写者并发: 插入阶段只增不减, 且不超过已插入的个数 */
+static uint32_t inserted;
+
+static void *size_poller(void *arg) {
+    RBShmTree *st = arg;
+    uint32_t last = 0, n;
+    while ((n = rbt_shm_size(st)) < KEYS) {
+        CHECK(n >= last && n <= __atomic_load_n(&inserted, __ATOMIC_ACQUIRE));
+        last = n;
+    }
+    return NULL;
+}
+
+static void size_race(const char *path) {
+    RBShmTree *st = rbt_shm_create(path, 1 << 20, sizeof(int));
+    CHECK(st);
+    inserted = 0;
+    pthread_t tid;
+    CHECK(pthread_create(&tid, NULL, size_poller, st) == 0);
+    for (int k = 0; k < KEYS; k++) {
+        Data d = {&k, sizeof(k)};
+        __atomic_store_n(&inserted, k + 1, __ATOMIC_RELEASE);
+        CHECK(rbt_shm_upsert(st, &d, check_cmp) == 1);
+    }
+    pthread_join(tid, NULL);
+    CHECK(rbt_shm_size(st) == KEYS);
+    rbt_shm_detach(st);
+    CHECK(rbt_shm_unlink(path) == 0);
+}
+
+int main(void) {
+    char path[] = "/tmp/rbt_shm_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    unlink(path);
+
+    RBShmTree *st = rbt_shm_create(path, 1 << 20, sizeof(int));
+    CHECK(st);
+    RBShmTree *other = rbt_shm_attach(path);
+    CHECK(other && other->base != st->base);
+
+    bool model[KEYS] = {0};
+    uint64_t rng = 1;
+    shm_ops(st, other, model, &rng, ROUNDS);
+    shm_equal(other, model);
+
+    /* 读者死掉: 树不变; 写者死掉: 重建后 victim 已删除, 空闲块可复用 */
+    shm_crash(other, 0, 0);
+    shm_equal(st, model);
+    for (int k = 0; k < KEYS; k++) {
+        if (!model[k]) continue;
+        shm_crash(other, 1, k);
+        model[k] = false;
+        shm_equal(st, model);
+        break;
+    }
+    shm_ops(st, other, model, &rng, ROUNDS / 10);
+    shm_equal(other, model);
+
+    for (int k = 0; k < KEYS; k++) {
+        int got = -1;
+        Data d = {&k, sizeof(k)}, out = {&got, sizeof(got)};
+        CHECK(rbt_shm_search(other, &d, check_cmp, &out) == model[k]);
+        if (model[k]) CHECK(got == k);
+    }
+
+    /* 段写满后插入失败, 树保持完好 */
+    int key = KEYS;
+    Data d = {&key, sizeof(key)};
+    int ret;
+    while ((ret = rbt_shm_upsert(st, &d, check_cmp)) == 1) key++;
+    CHECK(ret == -1);
+    CHECK(st->header->root && shm_check(st, st->header->root, 0) > 0);
+
+    rbt_shm_detach(other);
+    rbt_shm_detach(st);
+    CHECK(rbt_shm_unlink(path) == 0);
+
+    /* 放不进最大分级的 key 在创建时拒绝, 而不是插入时报段满 */
+    errno = 0;
+    CHECK(!rbt_shm_create(path, 1 << 20, RBT_SHM_MAX_KEY + 1) && errno == EINVAL);
+    st = rbt_shm_create(path, 1 << 20, RBT_SHM_MAX_KEY);
+    CHECK(st);
+    char *big = calloc(1, RBT_SHM_MAX_KEY);
+    CHECK(big);
+    Data db = {big, RBT_SHM_MAX_KEY};
+    CHECK(rbt_shm_upsert(st, &db, check_cmp) == 1 && rbt_shm_upsert(st, &db, check_cmp) == 0);
+    free(big);
+    rbt_shm_detach(st);
+    CHECK(rbt_shm_unlink(path) == 0);
+
+    size_race(path);
+    return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * 统计计数: 已知插入序列上的比较/旋转/分配次数, 查找路径直方图和黑高.
+ * 普通构建下计数恒为 0, 只检查与树本身有关的字段; make STATS=1 test 时检查全部计数.
+ */
+#include "check.h"
+#include "join.h"
+#include "stats.h"
+
+static uint64_t calls;  // counting_cmp 的调用次数
+
+static int counting_cmp(Data *src, Data *dest) {
+    calls++;
+    return check_cmp(src, dest);
+}
+
+/* 升序插入 1..7: 首个结点不比较, 其余各与最右结点比较一次; 3, 5, 7 插入时各旋转一次 */
+static void known_inserts(void) {
+    RBTree *tree = rbt_rbtree_new();
+    RBStats st;
+    rbt_stats_reset();
+    calls = 0;
+    for (int k = 1; k <= 7; k++) {
+        Data d = {&k, sizeof(k)};
+        rbt_insert_data(tree, &d, counting_cmp);
+    }
+    rbt_stats(tree, &st);
+
+    /* 结果为 2(4(3, 6(5, 7)), 1) 的形状, 最左路径 2 -> 1 均为黑 */
+    CHECK(st.size == 7 && st.black_height == 2);
+    CHECK(calls == 6);
+#ifdef RBT_STATS
+    CHECK(st.enabled);
+    CHECK(st.cmp_calls == 6);
+    CHECK(st.rotations == 3);
+    CHECK(st.mallocs == 14);  // 每个结点一次结点, 一次数据
+    CHECK(st.searches == 0 && st.frees == 0);
+#else
+    CHECK(!st.enabled && st.cmp_calls == 0 && st.rotations == 0 && st.mallocs == 0);
+#endif
+
+    rbt_stats_reset();
+    rbt_delete_tree(tree);
+    rbt_stats(NULL, &st);
+    CHECK(st.size == 0 && st.black_height == 0);
+#ifdef RBT_STATS
+    CHECK(st.frees == 14 && st.mallocs == 0);
+#endif
+}
+
+/* 7 个结点的满树: 命中时路径长 1, 2, 2, 3, 3, 3, 3, 未命中时走到叶子下方, 长 3 */
+static void path_hist(void) {
+    int keys[7];
+    Data items[7];
+    for (int i = 0; i < 7; i++) {
+        keys[i] = 2 * i + 2;
+        items[i] = (Data){&keys[i], sizeof(int)};
+    }
+    RBTree *tree = rbt_rbtree_new_fixed(sizeof(int), 0);
+    rbt_build_sorted(tree, items, 7, check_cmp);
+
+    RBStats st;
+    rbt_stats_reset();
+    for (int q = 1; q <= 15; q++) {
+        Data d = {&q, sizeof(q)};
+        CHECK((rbt_search_node(tree, &d, check_cmp) != NULL) == (q % 2 == 0 && q <= 14));
+    }
+    rbt_stats(tree, &st);
+    CHECK(st.size == 7 && st.black_height == 3);
+#ifdef RBT_STATS
+    CHECK(st.searches == 15);
+    CHECK(st.path_hist[0] == 0 && st.path_hist[1] == 1 && st.path_hist[2] == 2 && st.path_hist[3] == 4 + 8);
+    uint64_t total = 0, cmps = 0;
+    for (int i = 0; i < RBT_STATS_PATH_MAX; i++) {
+        total += st.path_hist[i];
+        cmps += i * st.path_hist[i];
+    }
+    CHECK(total == st.searches && cmps == st.cmp_calls);
+#else
+    for (int i = 0; i < RBT_STATS_PATH_MAX; i++) CHECK(st.path_hist[i] == 0);
+#endif
+    rbt_delete_tree(tree);
+}
+
+/* 随机增删查: rbtree.c 中每次比较都经过 rbt_cmp, 计数与回调实际被调用的次数相同 */
+static void random_ops(void) {
+    RBTree *tree = rbt_rbtree_new_pooled(64);
+    uint64_t rng = 9;
+    RBStats st;
+    rbt_stats_reset();
+    calls = 0;
+
+    for (int round = 0; round < 20000; round++) {
+        int key = check_rand(&rng) % 512;
+        Data d = {&key, sizeof(key)};
+        switch (round % 4) {
+            case 0: rbt_insert_data(tree, &d, counting_cmp); break;
+            case 1: rbt_upsert(tree, &d, counting_cmp, NULL); break;
+            case 2: rbt_delete_data(tree, &d, counting_cmp); break;
+            default: rbt_search_node(tree, &d, counting_cmp);
+        }
+    }
+    rbt_stats(tree, &st);
+    check_rb_tree(tree, check_cmp);
+#ifdef RBT_STATS
+    CHECK(st.cmp_calls == calls && st.searches > 0);
+#else
+    CHECK(st.cmp_calls == 0 && calls > 0);
+#endif
+    rbt_delete_tree(tree);
+}
+
+/* 拆分和集合运算同样经过 rbt_cmp */
+static void join_ops(void) {
+    for (int op = 0; op < 4; op++) {
+        RBTree *a = rbt_rbtree_new_fixed(sizeof(int), 256), *b = rbt_rbtree_new_like(a);
+        for (int k = 0; k < 300; k++) {
+            Data d = {&k, sizeof(k)};
+            if (k % 2 == 0) rbt_insert_data(a, &d, check_cmp);
+            if (k % 3 == 0) rbt_insert_data(b, &d, check_cmp);
+        }
+
+        RBStats st;
+        rbt_stats_reset();
+        calls = 0;
+        RBTree *lo = NULL, *hi = NULL;
+        int key = 151;
+        Data d = {&key, sizeof(key)};
+        switch (op) {
+            case 0: rbt_split(a, &d, counting_cmp, &lo, &hi); break;
+            case 1: rbt_union(a, b, counting_cmp); break;
+            case 2: rbt_intersection(a, b, counting_cmp); break;
+            default: rbt_difference(a, b, counting_cmp);
+        }
+        rbt_stats(NULL, &st);
+        CHECK(calls > 0);
+#ifdef RBT_STATS
+        CHECK(st.cmp_calls == calls);
+#else
+        CHECK(st.cmp_calls == 0);
+#endif
+        if (op == 0) {
+            CHECK(lo->size + hi->size == 150);
+            rbt_delete_tree(lo);
+            rbt_delete_tree(hi);
+        } else {
+            check_rb_tree(a, check_cmp);
+        }
+        rbt_delete_tree(b);
+        rbt_delete_tree(a);
+    }
+}
+
+int main(void) {
+    known_inserts();
+    path_hist();
+    random_ops();
+    join_ops();
+    return 0;
+}
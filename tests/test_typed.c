@@ -0,0 +1,79 @@
+/* RBT_DEFINE 生成的类型化树: 随机增删后与模型及同步操作的 CMP 树比对, 并检查红黑性质 */
+#include "check.h"
+#include "rbtree_typed.h"
+
+RBT_DEFINE(itree, int, RBT_CMP_NUM(a, b))
+
+#define KEYS 1024
+#define ROUNDS 30000
+
+static int typed_check(itree_node *node, itree_node *parent) {
+    if (!node) return 1;
+
+    CHECK(node->parent == parent);
+    if (node->color == RED) {
+        CHECK(!node->left || node->left->color == BLACK);
+        CHECK(!node->right || node->right->color == BLACK);
+    }
+
+    int lh = typed_check(node->left, node);
+    int rh = typed_check(node->right, node);
+    CHECK(lh == rh);
+    return lh + (node->color == BLACK);
+}
+
+static void typed_equal(itree *tree, itree_node **nodes, RBTree *ref) {
+    CHECK(!tree->root || tree->root->color == BLACK);
+    typed_check(tree->root, NULL);
+    check_rb_tree(ref, check_cmp);
+
+    uint32_t n = 0;
+    int prev = -1;
+    RBNode *q = rbt_min(ref);
+    for (itree_node *p = itree_first(tree); p; p = itree_next(p)) {
+        CHECK(p->key > prev && p->key < KEYS && nodes[p->key] == p);
+        CHECK(q && check_key(&q->data) == p->key);
+        prev = p->key;
+        q = rbt_successor(q);
+        n++;
+    }
+    CHECK(q == NULL && ref->size == tree->size);
+    uint32_t live = 0;
+    for (int k = 0; k < KEYS; k++) live += nodes[k] != NULL;
+    CHECK(n == live && n == tree->size);
+}
+
+int main(void) {
+    for (uint64_t seed = 1; seed <= 4; seed++) {
+        itree tree;
+        itree_init(&tree);
+        itree_node *nodes[KEYS] = {0};
+        RBTree *ref = rbt_rbtree_new_fixed(sizeof(int), 0);  // 同样的操作走 CMP 路径
+        uint64_t rng = seed;
+
+        for (int round = 0; round < ROUNDS; round++) {
+            int key = check_rand(&rng) % KEYS;
+            Data d = {&key, sizeof(key)};
+            if (!nodes[key]) {
+                nodes[key] = itree_insert(&tree, key);
+                rbt_insert_data(ref, &d, check_cmp);
+            } else if (round & 1) {
+                CHECK(itree_search(&tree, key) == nodes[key]);
+                itree_erase(&tree, nodes[key]);
+                rbt_delete_data(ref, &d, check_cmp);
+                nodes[key] = NULL;
+            } else {
+                CHECK(itree_delete(&tree, key) && !itree_delete(&tree, key));
+                rbt_delete_data(ref, &d, check_cmp);
+                nodes[key] = NULL;
+            }
+
+            if (round % 128 == 0) typed_equal(&tree, nodes, ref);
+        }
+        typed_equal(&tree, nodes, ref);
+        itree_clear(&tree);
+        rbt_delete_tree(ref);
+        CHECK(tree.size == 0 && itree_first(&tree) == NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,307 @@
+/*
+ * 预写日志: 子进程写入后被 SIGKILL, 父进程恢复并与模型比对.
+ * RBT_SYNC_EACH / RBT_SYNC_INTERVAL(等过一个周期)应恢复全部操作,
+ * RBT_SYNC_NONE 只保证恢复出操作序列的某个前缀, 且不短于最后一次检查点.
+ * 另在子进程写入途中随时 SIGKILL, 并逐字节截断/改坏最后一条记录, 恢复结果都应是某个前缀.
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "wal.h"
+
+#define KEYS 256
+#define OPS 3000
+#define CHECKPOINT_AT 1500
+
+typedef struct Rec {
+    int key;
+    int val;  // upsert 时被替换, 用来确认恢复的是最新一次写入
+} Rec;
+
+typedef struct Op {
+    bool del;
+    Rec rec;
+} Op;
+
+static Op ops[OPS];
+static char dir[] = "/tmp/rbt_wal_XXXXXX";
+static char path[64];
+
+static void gen_ops(uint64_t seed) {
+    uint64_t rng = seed;
+    for (int i = 0; i < OPS; i++) {
+        uint64_t r = check_rand(&rng);
+        ops[i].del = r % 4 == 0;
+        ops[i].rec.key = (r >> 8) % KEYS;
+        ops[i].rec.val = i;
+    }
+}
+
+/* 模型: 执行前 k 个操作后各 key 的值, -1 表示不存在 */
+static void model_step(int *model, int i) {
+    model[ops[i].rec.key] = ops[i].del ? -1 : ops[i].rec.val;
+}
+
+static bool model_equal(int *model, RBTree *tree) {
+    uint32_t live = 0;
+    for (int k = 0; k < KEYS; k++) {
+        Rec q = {k, 0};
+        Data d = {&q, sizeof(q)};
+        RBNode *node = rbt_search_node(tree, &d, check_cmp);
+        if (model[k] < 0) {
+            if (node) return false;
+            continue;
+        }
+        Rec got;
+        if (!node || node->data.buffer_type != sizeof(Rec)) return false;
+        memcpy(&got, node->data.buffer, sizeof(got));
+        if (got.val != model[k]) return false;
+        live++;
+    }
+    return live == tree->size;
+}
+
+/* 恢复出的状态对应的最长操作前缀, 对不上任何前缀时返回 -1 */
+static int recovered_prefix(RBTree *tree) {
+    int model[KEYS];
+    memset(model, -1, sizeof(model));
+
+    int found = model_equal(model, tree) ? 0 : -1;
+    for (int i = 0; i < OPS; i++) {
+        model_step(model, i);
+        if (model_equal(model, tree)) found = i + 1;
+    }
+    return found;
+}
+
+static void apply(RBWal *wal, int i) {
+    Data d = {&ops[i].rec, sizeof(Rec)};
+    if (ops[i].del) {
+        rbt_wal_delete(wal, &d);
+    } else {
+        rbt_wal_upsert(wal, &d);
+    }
+}
+
+static void remove_files(void) {
+    char file[96];
+    snprintf(file, sizeof(file), "%s.wal", path);
+    unlink(file);
+    snprintf(file, sizeof(file), "%s.snap", path);
+    unlink(file);
+}
+
+static void crash_and_recover(RBSyncPolicy policy) {
+    remove_files();
+
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        RBTree *tree = rbt_rbtree_new();
+        RBWal *wal = rbt_wal_open(tree, path, check_cmp, policy, 5);
+        for (int i = 0; i < OPS; i++) {
+            if (i == CHECKPOINT_AT && rbt_wal_checkpoint(wal) != 0) _exit(2);
+            apply(wal, i);
+        }
+        if (policy == RBT_SYNC_INTERVAL) usleep(100 * 1000);
+        kill(getpid(), SIGKILL);
+        _exit(3);
+    }
+
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+
+    RBTree *tree = rbt_recover(path, check_cmp);
+    CHECK(tree);
+    check_rb_tree(tree, check_cmp);
+    int prefix = recovered_prefix(tree);
+    if (policy == RBT_SYNC_NONE) {
+        CHECK(prefix >= CHECKPOINT_AT);
+    } else {
+        CHECK(prefix == OPS);
+    }
+
+    /* 尾部追加半条记录(写到一半时崩溃), 恢复结果不变 */
+    char file[96];
+    snprintf(file, sizeof(file), "%s.wal", path);
+    FILE *f = fopen(file, "ab");
+    CHECK(f);
+    RBWalRecord torn = {0x12345678u, sizeof(Rec) << 2 | RBT_WAL_UPSERT, ~0ULL};
+    fwrite(&torn, sizeof(torn), 1, f);
+    fclose(f);
+
+    RBTree *again = rbt_recover(path, check_cmp);
+    CHECK(again && recovered_prefix(again) == prefix);
+    rbt_delete_tree(again);
+
+    /* 重新打开会截掉残缺尾部并接着追加; 正常关闭后恢复出全部操作 */
+    RBWal *wal = rbt_wal_open(tree, path, check_cmp, policy, 5);
+    for (int i = prefix; i < OPS; i++) apply(wal, i);
+    rbt_wal_close(wal);
+    rbt_delete_tree(tree);
+
+    tree = rbt_recover(path, check_cmp);
+    CHECK(tree && recovered_prefix(tree) == OPS);
+    rbt_delete_tree(tree);
+}
+
+static uint64_t log_size(void) {
+    char file[96];
+    struct stat st;
+    snprintf(file, sizeof(file), "%s.wal", path);
+    CHECK(stat(file, &st) == 0);
+    return st.st_size;
+}
+
+/* 父进程在子进程写入途中的任意时刻 SIGKILL; 每次操作都 fdatasync, 较慢, 杀死时多半正在写 */
+static void kill_mid_write(void) {
+    for (int delay = 0; delay <= 20000; delay += 2500) {
+        remove_files();
+        pid_t pid = fork();
+        CHECK(pid >= 0);
+        if (pid == 0) {
+            RBTree *tree = rbt_rbtree_new();
+            RBWal *wal = rbt_wal_open(tree, path, check_cmp, RBT_SYNC_EACH, 0);
+            for (int i = 0; i < OPS; i++) apply(wal, i);
+            _exit(0);
+        }
+        usleep(delay);
+        kill(pid, SIGKILL);
+        int status;
+        CHECK(waitpid(pid, &status, 0) == pid);
+
+        RBTree *tree = rbt_recover(path, check_cmp);
+        CHECK(tree);
+        check_rb_tree(tree, check_cmp);
+        CHECK(recovered_prefix(tree) >= 0);
+        rbt_delete_tree(tree);
+    }
+}
+
+/* 最后一条记录只写了一部分, 或内容被改坏: 恢复出前 OPS - 1 个操作, 重新打开时截掉这条记录 */
+static void torn_tail(void) {
+    remove_files();
+    ops[OPS - 1].del = false;  // 删除不存在的 key 不写日志, 保证最后一个操作留下记录
+    RBTree *tree = rbt_rbtree_new();
+    RBWal *wal = rbt_wal_open(tree, path, check_cmp, RBT_SYNC_EACH, 0);
+    for (int i = 0; i < OPS; i++) apply(wal, i);
+    rbt_wal_close(wal);
+    rbt_delete_tree(tree);
+
+    char file[96];
+    snprintf(file, sizeof(file), "%s.wal", path);
+    uint64_t size = log_size(), rec_size = sizeof(RBWalRecord) + sizeof(Rec);
+    CHECK(size % rec_size == 0);
+    int model[KEYS];
+    memset(model, -1, sizeof(model));
+    for (int i = 0; i < OPS - 1; i++) model_step(model, i);
+
+    char last[sizeof(RBWalRecord) + sizeof(Rec)];
+    FILE *f = fopen(file, "rb");
+    CHECK(f && fseek(f, (long)(size - rec_size), SEEK_SET) == 0 && fread(last, rec_size, 1, f) == 1);
+    fclose(f);
+
+    for (uint64_t cut = 1; cut < rec_size; cut++) {
+        CHECK(truncate(file, size - cut) == 0);
+        tree = rbt_recover(path, check_cmp);
+        CHECK(tree && model_equal(model, tree));
+        rbt_delete_tree(tree);
+    }
+
+    /* 长度完整但校验和不符(扇区只写了一半) */
+    for (uint64_t byte = 0; byte < rec_size; byte++) {
+        char bad[sizeof(last)];
+        memcpy(bad, last, rec_size);
+        bad[byte] ^= 0x40;
+        CHECK(truncate(file, size - rec_size) == 0);
+        f = fopen(file, "ab");
+        CHECK(f && fwrite(bad, rec_size, 1, f) == 1);
+        fclose(f);
+        tree = rbt_recover(path, check_cmp);
+        CHECK(tree && model_equal(model, tree));
+        rbt_delete_tree(tree);
+    }
+
+    tree = rbt_recover(path, check_cmp);
+    wal = rbt_wal_open(tree, path, check_cmp, RBT_SYNC_EACH, 0);
+    CHECK(log_size() == size - rec_size);
+    apply(wal, OPS - 1);
+    rbt_wal_close(wal);
+    rbt_delete_tree(tree);
+    tree = rbt_recover(path, check_cmp);
+    CHECK(tree && recovered_prefix(tree) == OPS);
+    rbt_delete_tree(tree);
+}
+
+/* 多线程写入大记录, 缓冲频繁扩容的同时另一个线程在写出 */
+typedef struct Writer {
+    RBWal *wal;
+    int id;
+} Writer;
+
+#define BIG 3000
+#define PER_THREAD 200
+
+static void *writer(void *arg) {
+    Writer *w = arg;
+    unsigned char buf[BIG];
+    for (int i = 0; i < PER_THREAD; i++) {
+        int key = w->id * PER_THREAD + i;
+        size_t len = sizeof(int) + (size_t)(key * 37) % (BIG - sizeof(int));
+        memset(buf, key & 0xff, len);
+        memcpy(buf, &key, sizeof(key));
+        Data d = {buf, (uint32_t)len};
+        rbt_wal_upsert(w->wal, &d);
+    }
+    return NULL;
+}
+
+static void concurrent_big_records(RBSyncPolicy policy) {
+    remove_files();
+
+    RBTree *tree = rbt_rbtree_new();
+    RBWal *wal = rbt_wal_open(tree, path, check_cmp, policy, 1);
+    pthread_t tids[4];
+    Writer ws[4];
+    for (int t = 0; t < 4; t++) {
+        ws[t] = (Writer){wal, t};
+        CHECK(pthread_create(&tids[t], NULL, writer, &ws[t]) == 0);
+    }
+    for (int t = 0; t < 4; t++) pthread_join(tids[t], NULL);
+    rbt_wal_close(wal);
+    rbt_delete_tree(tree);
+
+    tree = rbt_recover(path, check_cmp);
+    CHECK(tree && tree->size == 4 * PER_THREAD);
+    for (RBNode *node = rbt_min(tree); node; node = rbt_successor(node)) {
+        int key = check_key(&node->data);
+        const unsigned char *p = node->data.buffer;
+        CHECK(node->data.buffer_type == sizeof(int) + (size_t)(key * 37) % (BIG - sizeof(int)));
+        for (uint32_t j = sizeof(int); j < node->data.buffer_type; j++) CHECK(p[j] == (key & 0xff));
+    }
+    rbt_delete_tree(tree);
+}
+
+int main(void) {
+    CHECK(mkdtemp(dir));
+    snprintf(path, sizeof(path), "%s/db", dir);
+
+    RBSyncPolicy policies[] = {RBT_SYNC_EACH, RBT_SYNC_INTERVAL, RBT_SYNC_NONE};
+    for (int p = 0; p < 3; p++) {
+        gen_ops(p + 1);
+        crash_and_recover(policies[p]);
+        concurrent_big_records(policies[p]);
+    }
+    kill_mid_write();
+    torn_tail();
+
+    remove_files();
+    rmdir(dir);
+    return 0;
+}